@@ -1,6 +1,7 @@
 #include <Arduino.h>
 
 #include "controlFan.h"
+#include "timeService.h"
 
 /// @brief Set everything to auto and zero seconds.
 /// @return false -> dont't turn on the fan
@@ -8,17 +9,22 @@ boolean ControlFan::init() {
   controlFanState = CF_OFF;
   cntOnSeconds = 0;
   cntOffSeconds = 0;
+  schedule.init();
   return false; // don't start the fan
 }
 
 /// @brief ControlFan function that is called regularly in loop(). It decides wether to turn on the
 /// fan or turn it off. It depends on the usersetpoint mode, which can be iterated by
 /// incremenetUserSetpoint().
+/// In mode AUTO the weekly schedule is respected: no run in quiet hours and a shorter pause in
+/// preferred hours, see setWeekHour().
 /// @param isVentilationUsefull decides in mode AUTO, if fan is turned on
 /// @return true if fan shall actually be turned on.
 boolean ControlFan::loop(boolean isVentilationUsefull) {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
   boolean turnFanOn = false;
+  boolean isQuiet = schedule.isQuietHour(weekHour);
+  unsigned long fanOffMS = schedule.isPreferredHour(weekHour) ? FanOFF_PREFERRED_MS : FanOFF_MS;
   switch (controlFanState) {
   case CF_INIT:
     // usually, this init state is not entered, because init() is probably already called during
@@ -36,16 +42,17 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
 #ifdef DEBUGFANHANDLING
       Serial.println("OFF");
 #endif
-      if (now - lastFanRunTime >= FanOFF_MS) {
+      if (pauseSkipped || now - lastFanRunTime >= fanOffMS) {
         // Fan was off long enough, maybe turn it on again
-        // if userMode == auto and ventilationIsUsefull -> change to on
-        if ((userSetpointState == CF_AUTO) && isVentilationUsefull) {
+        // if userMode == auto and ventilationIsUsefull and no quiet hour -> change to on
+        if ((userSetpointState == CF_AUTO) && isVentilationUsefull && !isQuiet) {
 #ifdef DEBUGFANHANDLING
           Serial.println("AUTO -> fan on");
 #endif
           controlFanState = CF_ON;
           cntOffSeconds = 0;
           lastFanRunTime = now;
+          pauseSkipped = false;
         }
 
         // if userMode == on -> change to ON
@@ -56,6 +63,7 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
           controlFanState = CF_ON;
           cntOffSeconds = 0;
           lastFanRunTime = now;
+          pauseSkipped = false;
         }
       }
       lastFanSMTime = now;
@@ -69,6 +77,11 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
 #endif
       cntOnSeconds = cntOnSeconds + (now - lastFanSMTime) / 1000;
       cntOnSeconds = min(cntOnSeconds, (uint16_t)65435); // keep value 100s below max
+      for (uint8_t i = 0; i < fanGroupSize; i++) {
+        if (fanOnMask & (1 << i)) {
+          fanRunSeconds[i] += (now - lastFanSMTime) / 1000;
+        }
+      }
       // if userMode == OFF -> change to OFF
       if (userSetpointState == CF_OFF) {
 #ifdef DEBUGFANHANDLING
@@ -77,6 +90,28 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
         controlFanState = CF_OFF;
         cntOnSeconds = 0; // reset to zero
         lastFanRunTime = now;
+        pauseSkipped = false;
+      }
+      // quiet hour started in mode auto -> off
+      else if ((userSetpointState == CF_AUTO) && isQuiet) {
+#ifdef DEBUGFANHANDLING
+        Serial.println("quiet hour -> fan off");
+#endif
+        controlFanState = CF_OFF;
+        cntOnSeconds = 0; // reset to zero
+        lastFanRunTime = now;
+        pauseSkipped = false;
+      }
+      // ventilation doesn't pay off anymore in mode auto -> off
+      else if ((userSetpointState == CF_AUTO) && !runPaysOff &&
+               (now - lastFanRunTime >= FanMIN_ON_MS)) {
+#ifdef DEBUGFANHANDLING
+        Serial.println("run doesn't pay off -> fan off");
+#endif
+        controlFanState = CF_OFF;
+        cntOnSeconds = 0; // reset to zero
+        lastFanRunTime = now;
+        pauseSkipped = false;
       }
       // Fan was on long enough, maybe turn it off
       else if (now - lastFanRunTime >= FanON_MS) {
@@ -86,6 +121,7 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
         controlFanState = CF_OFF;
         cntOnSeconds = 0; // reset to zero
         lastFanRunTime = now;
+        pauseSkipped = false;
       }
       lastFanSMTime = now;
     }
@@ -95,9 +131,113 @@ boolean ControlFan::loop(boolean isVentilationUsefull) {
     controlFanState = CF_INIT;
     break;
   }
+  updateFanGroup(now);
   return turnFanOn;
 } // end loop()
 
+/// @brief Decide which fans of the group are switched on. When the fan turns on, the fans for this
+/// run are chosen and started one after another with FAN_STAGGER_MS in between. When the fan turns
+/// off, all fans are stopped at once.
+/// @param now actual time in ms
+void ControlFan::updateFanGroup(uint64_t now) {
+  if (controlFanState != CF_ON) {
+    runMask = 0;
+    fanOnMask = 0;
+    return;
+  }
+  if (runMask == 0) {
+    // a new run starts (or the group changed): choose the fans for this run
+    runMask = chooseRunMask();
+  }
+  // stop fans, which are not part of this run anymore
+  fanOnMask &= runMask;
+  if (fanOnMask == runMask) {
+    return; // all fans of this run are running
+  }
+  if (fanStarted && (now - lastFanStartTime < FAN_STAGGER_MS)) {
+    return; // wait before starting the next fan
+  }
+  // start the next fan, the one with the least runtime first
+  int8_t next = -1;
+  for (uint8_t i = 0; i < fanGroupSize; i++) {
+    if ((runMask & ~fanOnMask) & (1 << i)) {
+      if ((next < 0) || (fanRunSeconds[i] < fanRunSeconds[next])) {
+        next = i;
+      }
+    }
+  }
+  if (next >= 0) {
+#ifdef DEBUGFANHANDLING
+    Serial.print("start fan ");
+    Serial.println(next);
+#endif
+    fanOnMask |= (1 << next);
+    lastFanStartTime = now;
+    fanStarted = true;
+  }
+}
+
+/// @brief Choose the fans for the next run: all fans with an active role, but at most
+/// FAN_GROUP_MAX_ACTIVE. Then the fans with the least runtime are taken to balance the runtimes.
+/// @return bitmask of the fans for the next run
+uint8_t ControlFan::chooseRunMask() {
+  uint8_t mask = 0;
+  uint8_t cnt = 0;
+  uint8_t maxActive = (FAN_GROUP_MAX_ACTIVE > 0) ? FAN_GROUP_MAX_ACTIVE : FAN_GROUP_MAX;
+  while (cnt < maxActive) {
+    int8_t best = -1;
+    for (uint8_t i = 0; i < fanGroupSize; i++) {
+      if ((mask & (1 << i)) || !(fanRoles[i] & activeRoles)) {
+        continue; // already chosen or wrong role
+      }
+      if ((best < 0) || (fanRunSeconds[i] < fanRunSeconds[best])) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break; // no more eligible fans
+    }
+    mask |= (1 << best);
+    cnt++;
+  }
+  return mask;
+}
+
+/// @brief Set the number of fans in the group, i.e. the number of bound plugs
+/// @param size number of fans, limited to FAN_GROUP_MAX
+void ControlFan::setFanGroupSize(uint8_t size) {
+  size = min(size, (uint8_t)FAN_GROUP_MAX);
+  if (size != fanGroupSize) {
+    fanGroupSize = size;
+    runMask = 0; // choose the fans of the actual run again
+  }
+}
+
+/// @brief Set the roles, which shall run while ventilating, e.g. only the inlet fans
+/// @param roles FanRole bits
+void ControlFan::setActiveRoles(uint8_t roles) {
+  if (roles != activeRoles) {
+    activeRoles = roles;
+    runMask = 0; // choose the fans of the actual run again
+  }
+}
+
+/// @brief get the fans of the group, which shall actually be switched on
+/// @return bitmask, bit i is fan i
+uint8_t ControlFan::getFanGroupMask() {
+  return fanOnMask;
+}
+
+/// @brief get the accumulated runtime of one fan of the group
+/// @param fanIdx index of the fan
+/// @return runtime in seconds
+uint32_t ControlFan::getFanRunSeconds(uint8_t fanIdx) {
+  if (fanIdx >= FAN_GROUP_MAX) {
+    return 0;
+  }
+  return fanRunSeconds[fanIdx];
+}
+
 /// @brief get the setpoint chosen by the user Off, Auto or On
 /// @return the set point
 ControlFanStates ControlFan::getUserSetpoint() {
@@ -158,8 +298,27 @@ void ControlFan::createLogChar(char *logCtrlStr) {
            cntOnSeconds, cntOffSeconds);
 }
 
-/// @brief Reset the fan Run time. This is usefull, when the mode is switched manually to restart or
-/// stop the fan immediately.
+/// @brief Skip the pause after the last run. This is usefull, when the mode is switched manually to
+/// restart the fan immediately.
 void ControlFan::resetFanRunTime() {
-  lastFanRunTime -= FanOFF_MS;
-}
\ No newline at end of file
+  pauseSkipped = true;
+}
+/// @brief Set the actual local time for the weekly schedule. Call it regularly, e.g. from the
+/// RTCHelper::getLocalWeekHour()
+/// @param hour hour of the week, 0 = Sunday 0:00 ... 167 = Saturday 23:00
+void ControlFan::setWeekHour(uint8_t hour) {
+  weekHour = hour;
+}
+
+/// @brief get the weekly schedule, e.g. to edit it
+/// @return schedule
+FanSchedule &ControlFan::getSchedule() {
+  return schedule;
+}
+
+/// @brief Tell the fan control, if a running ventilation is still worth it, e.g. from the learned
+/// MoistureModel. In mode AUTO a run is ended after FanMIN_ON_MS, if it doesn't pay off.
+/// @param paysOff false to end the run
+void ControlFan::setRunPaysOff(boolean paysOff) {
+  runPaysOff = paysOff;
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 // how often shall fan states be checked?
 // best be multiple of 1000 for more accurate counting in seconds
 #define FANwaitMS 2000
@@ -5,6 +7,10 @@
 // how long is the fan on and off?
 #define FanON_MS 16 * 60 * 1000
 #define FanOFF_MS 10 * 60 * 1000
+// minimum runtime before a run in mode AUTO may be ended early, see setRunPaysOff()
+#define FanMIN_ON_MS 5 * 60 * 1000
+// pause between two runs in preferred hours of the schedule, see fanSchedule.h
+#define FanOFF_PREFERRED_MS 5 * 60 * 1000
 
 // print debug?
 // define DEBUGFANHANDLING
@@ -12,8 +18,30 @@
 // LENGTH of string for control data logging
 #define LOGCTRLSTR_LENGTH 22
 
+// Fan group: every plug bound to the zigbee switch is one fan of the group. The index of a fan is
+// its position in the list of bound devices. At most 8, the fans are bits of an uint8_t.
+#define FAN_GROUP_MAX 4
+// delay between the start of two fans of the group, so they don't trip the breaker together
+#define FAN_STAGGER_MS 5000
+// how many fans of the group may run at the same time? 0 = all eligible fans.
+// If fewer fans may run than are eligible, the fans with the least runtime are chosen.
+#define FAN_GROUP_MAX_ACTIVE 0
+// role of each fan of the group (index = binding order)
+#define FAN_GROUP_ROLES {FAN_ROLE_ANY, FAN_ROLE_ANY, FAN_ROLE_ANY, FAN_ROLE_ANY}
+// which roles shall run when ventilating? e.g. FAN_ROLE_EXHAUST to run only the exhaust fans
+#define FAN_GROUP_ACTIVE_ROLES FAN_ROLE_ANY
+
 enum ControlFanStates { CF_INIT, CF_OFF, CF_AUTO, CF_ON };
 
+#include "fanSchedule.h"
+
+enum FanRole : uint8_t {
+  FAN_ROLE_NONE = 0,    // never switched on
+  FAN_ROLE_INLET = 1,   // blows outside air in
+  FAN_ROLE_EXHAUST = 2, // blows inside air out
+  FAN_ROLE_ANY = 3      // runs with inlet and exhaust fans
+};
+
 /// @brief ControlFan class to handle the control logic with the modes on, off and auto. The user is
 /// able to toggle through this modes by calling incrementuserSetpoint(). ControlFan takes care,
 /// that the cheap ventilator get a timeout after e.g. 16 min and restarts after 15 min. The
@@ -30,18 +58,50 @@ public:
   ControlFanStates incrementUserSetpoint();
 
   ControlFan()
-      : controlFanState(CF_INIT), userSetpointState(CF_AUTO), cntOnSeconds(0), cntOffSeconds(0) {}
+      : controlFanState(CF_INIT), userSetpointState(CF_AUTO), lastFanSMTime(0), lastFanRunTime(0),
+        pauseSkipped(false), cntOnSeconds(0), cntOffSeconds(0), fanGroupSize(0),
+        activeRoles(FAN_GROUP_ACTIVE_ROLES), runMask(0), fanOnMask(0), lastFanStartTime(0),
+        fanStarted(false), fanRoles FAN_GROUP_ROLES, fanRunSeconds{}, weekHour(SCHED_WEEKHOURS),
+        runPaysOff(true) {}
 
   void createLogChar(char *logStr);
 
   void resetFanRunTime();
   void getModeCharacter(char *modeChar);
 
+  void setFanGroupSize(uint8_t size);
+  void setActiveRoles(uint8_t roles);
+  uint8_t getFanGroupMask();
+  uint32_t getFanRunSeconds(uint8_t fanIdx);
+
+  void setWeekHour(uint8_t hour);
+  FanSchedule &getSchedule();
+
+  void setRunPaysOff(boolean paysOff);
+
 private:
   ControlFanStates controlFanState;
   ControlFanStates userSetpointState;
-  unsigned long lastFanSMTime;  // time to check state machine
-  unsigned long lastFanRunTime; // time to check actual fan runtim
+  uint64_t lastFanSMTime;  // time to check state machine
+  uint64_t lastFanRunTime; // time to check actual fan runtim
+  boolean pauseSkipped;    // the mode was changed, don't wait for the pause after the last run
   uint16_t cntOnSeconds;
   uint16_t cntOffSeconds;
+
+  void updateFanGroup(uint64_t now);
+  uint8_t chooseRunMask();
+
+  uint8_t fanGroupSize;            // number of fans (bound plugs) in the group
+  uint8_t activeRoles;             // FanRole bits that shall run while ventilating
+  uint8_t runMask;                 // fans chosen for the actual run
+  uint8_t fanOnMask;               // fans actually switched on (staggered subset of runMask)
+  uint64_t lastFanStartTime;       // time the last fan of the group was started
+  boolean fanStarted;              // true, if lastFanStartTime is valid
+  FanRole fanRoles[FAN_GROUP_MAX]; // role of each fan
+  uint32_t fanRunSeconds[FAN_GROUP_MAX]; // accumulated runtime of each fan for balancing
+
+  FanSchedule schedule;
+  uint8_t weekHour; // actual local hour of the week, SCHED_WEEKHOURS if unknown
+
+  boolean runPaysOff; // false, if further ventilation is not worth it
 };
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "fanSchedule.h"
+
+static const ScheduleRule scheduleRules[] = SCHEDULE_RULES;
+
+/// @brief Load the edited schedule from the flash, or evaluate the SCHEDULE_RULES table into the
+/// bitmaps for quiet and preferred hours, if it was never edited
+void FanSchedule::init() {
+  if (!load()) {
+    setDefault();
+  }
+}
+
+/// @brief Evaluate the SCHEDULE_RULES table into the bitmaps
+void FanSchedule::setDefault() {
+  memset(quietBits, 0, sizeof(quietBits));
+  memset(preferredBits, 0, sizeof(preferredBits));
+
+  for (const ScheduleRule &rule : scheduleRules) {
+    applyRule(rule);
+  }
+}
+
+/// @brief Set the hours of one rule in the bitmaps
+void FanSchedule::applyRule(const ScheduleRule &rule) {
+  for (uint8_t day = 0; day < 7; day++) {
+    if (!(rule.days & (1 << day))) {
+      continue;
+    }
+    if (rule.startHour <= rule.endHour) {
+      setHours(rule.type, day, rule.startHour, rule.endHour);
+    } else {
+      // rule continues after midnight into the next day
+      setHours(rule.type, day, rule.startHour, 24);
+      setHours(rule.type, (day + 1) % 7, 0, rule.endHour);
+    }
+  }
+}
+
+/// @brief set the type of the hours [startHour, endHour) of one day. An hour is either quiet or
+/// preferred or normal.
+void FanSchedule::setHours(ScheduleType type, uint8_t day, uint8_t startHour, uint8_t endHour) {
+  for (uint8_t hour = startHour; hour < min(endHour, (uint8_t)24); hour++) {
+    uint8_t weekHour = day * 24 + hour;
+    uint8_t bit = 1 << (weekHour % 8);
+    quietBits[weekHour / 8] &= ~bit;
+    preferredBits[weekHour / 8] &= ~bit;
+    if (type == SCHED_QUIET) {
+      quietBits[weekHour / 8] |= bit;
+    } else if (type == SCHED_PREFERRED) {
+      preferredBits[weekHour / 8] |= bit;
+    }
+  }
+}
+
+boolean FanSchedule::getBit(const uint8_t *bits, uint8_t weekHour) {
+  if (weekHour >= SCHED_WEEKHOURS) {
+    return false; // no valid time -> no schedule
+  }
+  return (bits[weekHour / 8] >> (weekHour % 8)) & 1;
+}
+
+/// @brief Is the fan supposed to be quiet in this hour?
+/// @param weekHour hour of the week in local time, 0 = Sunday 0:00 ... 167 = Saturday 23:00
+/// @return true in quiet hours
+boolean FanSchedule::isQuietHour(uint8_t weekHour) {
+  return getBit(quietBits, weekHour);
+}
+
+/// @brief Is this a preferred hour to run the fan (e.g. cheap tariff)?
+/// @param weekHour hour of the week in local time, 0 = Sunday 0:00 ... 167 = Saturday 23:00
+/// @return true in preferred hours
+boolean FanSchedule::isPreferredHour(uint8_t weekHour) {
+  return getBit(preferredBits, weekHour);
+}
+
+/// @brief Change the type of some hours of the week and store the schedule in the flash. The hours
+/// are given like a rule of SCHEDULE_RULES.
+/// @param type SCHED_QUIET, SCHED_PREFERRED or SCHED_NORMAL to clear the hours
+/// @param days SCHED_SUNDAY ... SCHED_SATURDAY bits
+/// @param startHour first hour 0 ... 23
+/// @param endHour hour after the last one 0 ... 24, if smaller than startHour, the hours continue
+/// after midnight into the next day
+void FanSchedule::edit(ScheduleType type, uint8_t days, uint8_t startHour, uint8_t endHour) {
+  applyRule(ScheduleRule{type, days, startHour, endHour});
+  save();
+}
+
+/// @brief Forget the edited schedule and use the SCHEDULE_RULES table again
+void FanSchedule::reset() {
+  Preferences prefs;
+  prefs.begin("fansched", false);
+  prefs.clear();
+  prefs.end();
+  setDefault();
+}
+
+/// @brief Print the schedule, one line per day: q quiet, p preferred, . normal hour
+void FanSchedule::print() {
+  static const char *dayNames[] = {"So", "Mo", "Di", "Mi", "Do", "Fr", "Sa"};
+  char line[24 + 1];
+  Serial.println("Wochenplan: q ruhig, p bevorzugt, . normal");
+  Serial.println("   0         1         2");
+  Serial.println("   012345678901234567890123");
+  for (uint8_t day = 0; day < 7; day++) {
+    for (uint8_t hour = 0; hour < 24; hour++) {
+      uint8_t weekHour = day * 24 + hour;
+      line[hour] = isQuietHour(weekHour) ? 'q' : (isPreferredHour(weekHour) ? 'p' : '.');
+    }
+    line[24] = '\0';
+    Serial.print(dayNames[day]);
+    Serial.print(" ");
+    Serial.println(line);
+  }
+}
+
+/// @brief load the edited schedule from the flash
+/// @return false, if there is none
+boolean FanSchedule::load() {
+  Preferences prefs;
+  prefs.begin("fansched", true);
+  boolean valid = (prefs.getUChar("version", 0) == SCHED_DATA_VERSION) &&
+                  (prefs.getBytes("quiet", quietBits, sizeof(quietBits)) == sizeof(quietBits)) &&
+                  (prefs.getBytes("preferred", preferredBits, sizeof(preferredBits)) ==
+                   sizeof(preferredBits));
+  prefs.end();
+  return valid;
+}
+
+/// @brief store the schedule in the flash
+void FanSchedule::save() {
+  Preferences prefs;
+  prefs.begin("fansched", false);
+  prefs.putUChar("version", SCHED_DATA_VERSION);
+  prefs.putBytes("quiet", quietBits, sizeof(quietBits));
+  prefs.putBytes("preferred", preferredBits, sizeof(preferredBits));
+  prefs.end();
+}
@@ -0,0 +1,79 @@
+// fanSchedule.h
+
+#pragma once
+
+// Weekly schedule for the fan: quiet hours and preferred hours in local time.
+// Each rule covers the hours [startHour, endHour) on the given days. If endHour is smaller than
+// startHour, the rule continues after midnight into the next day, e.g. 22 -> 6.
+
+// days of the week for the rules, bit 0 = Sunday ... bit 6 = Saturday
+#define SCHED_SUNDAY 0x01
+#define SCHED_MONDAY 0x02
+#define SCHED_TUESDAY 0x04
+#define SCHED_WEDNESDAY 0x08
+#define SCHED_THURSDAY 0x10
+#define SCHED_FRIDAY 0x20
+#define SCHED_SATURDAY 0x40
+#define SCHED_WORKDAYS 0x3E
+#define SCHED_WEEKEND 0x41
+#define SCHED_EVERYDAY 0x7F
+
+// The default schedule table: {type, days, startHour, endHour}
+// In quiet hours the fan is not started in mode AUTO and a running fan is stopped.
+// In preferred hours (e.g. cheap tariff) the pause between two runs is FanOFF_PREFERRED_MS.
+// Example: quiet every night, preferred on weekends
+//   {{SCHED_QUIET, SCHED_EVERYDAY, 22, 6}, {SCHED_PREFERRED, SCHED_WEEKEND, 10, 16}}
+// The default rule without days disables the schedule.
+// The schedule can be edited with the serial command W. The edited schedule is stored in the flash
+// (Preferences) and replaces this table, until it is reset with "W 0".
+#define SCHEDULE_RULES                                                                             \
+  {                                                                                                \
+    {SCHED_QUIET, 0, 0, 0},                                                                        \
+  }
+
+#define SCHED_DATA_VERSION 1
+
+// 7 days * 24 hours
+#define SCHED_WEEKHOURS 168
+
+enum ScheduleType : uint8_t {
+  SCHED_QUIET,
+  SCHED_PREFERRED,
+  SCHED_NORMAL // neither quiet nor preferred, only used to edit the schedule
+};
+
+typedef struct {
+  ScheduleType type;
+  uint8_t days;
+  uint8_t startHour;
+  uint8_t endHour;
+} ScheduleRule;
+
+/// @brief FanSchedule class to answer for each hour of the week, if it is a quiet or preferred
+/// hour. The rules are evaluated once by init() into a bitmap with one bit per hour of the week, so
+/// the lookup in each loop() is a single bit test. The bitmap can be edited at runtime and is then
+/// stored in the flash (Preferences).
+class FanSchedule {
+public:
+  void init();
+
+  void edit(ScheduleType type, uint8_t days, uint8_t startHour, uint8_t endHour);
+  void reset();
+  void print();
+
+  boolean isQuietHour(uint8_t weekHour);
+  boolean isPreferredHour(uint8_t weekHour);
+
+  FanSchedule() : quietBits{}, preferredBits{} {}
+
+private:
+  void applyRule(const ScheduleRule &rule);
+  void setHours(ScheduleType type, uint8_t day, uint8_t startHour, uint8_t endHour);
+  void setDefault();
+  boolean load();
+  void save();
+  boolean getBit(const uint8_t *bits, uint8_t weekHour);
+
+  uint8_t quietBits[SCHED_WEEKHOURS / 8];     // bit per hour of the week: quiet hour
+  uint8_t preferredBits[SCHED_WEEKHOURS / 8]; // bit per hour of the week: preferred hour
+};
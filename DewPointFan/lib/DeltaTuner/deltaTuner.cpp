@@ -0,0 +1,198 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "deltaTuner.h"
+#include "timeService.h"
+
+// increase, if the layout of the stored data changes
+#define TUNER_DATA_VERSION 1
+
+/// @brief Load the learned data from the flash and set the dew point difference of the season
+void DeltaTuner::init() {
+  load();
+  deltaP = armToDeltaP(data.arm[season]);
+  tunerState = TUNER_IDLE;
+}
+
+/// @brief Call it after each new average. Tracks the runs in mode AUTO and scores them.
+/// @param inner averaged indoor measurement
+/// @param outer averaged outdoor measurement
+/// @param fanOn true if the fan is running
+/// @param isAuto true if the user setpoint is AUTO, runs in mode ON are not scored
+/// @param month actual local month 1..12
+void DeltaTuner::update(AvgMeasurement inner, AvgMeasurement outer, boolean fanOn,
+                        boolean isAuto, uint8_t month) {
+#if TUNER_ENABLED == 1
+  uint64_t now = timeService.nowMs();
+  boolean valid = (inner.validCnt >= 1) && (outer.validCnt >= 1) && !isnan(inner.dewPoint) &&
+                  !isnan(outer.dewPoint);
+
+  uint8_t newSeason = (month % 12) / 3; // Dec, Jan, Feb -> 0
+  if (month >= 1 && month <= 12 && newSeason != season) {
+    season = newSeason;
+    deltaP = armToDeltaP(data.arm[season]);
+  }
+
+  switch (tunerState) {
+  case TUNER_IDLE:
+    if (fanOn && isAuto && valid) {
+      startDewPointI = inner.dewPoint;
+      startMargin = inner.dewPoint - outer.dewPoint;
+      tunerState = TUNER_RUN;
+    }
+    break;
+  case TUNER_RUN:
+    if (!fanOn) {
+      runEndTime = now;
+      tunerState = TUNER_AFTER;
+    } else if (!isAuto) {
+      tunerState = TUNER_IDLE; // switched to ON -> don't score this run
+    }
+    break;
+  case TUNER_AFTER:
+    if (!valid) {
+      break; // wait for valid data
+    }
+    if (fanOn || (now - runEndTime >= TUNER_AFTER_MS)) {
+      // the indoor dew point was observed long enough or the next run starts
+      scoreRun(startDewPointI - inner.dewPoint);
+      tunerState = TUNER_IDLE;
+    }
+    break;
+  default:
+    tunerState = TUNER_IDLE;
+    break;
+  }
+#endif
+}
+
+/// @brief Learn the score of the completed run for its start margin and choose the dew point
+/// difference for the next runs
+/// @param score decrease of the indoor dew point in K, negative if the run added moisture
+void DeltaTuner::scoreRun(float score) {
+  uint8_t arm = marginToArm(startMargin);
+  uint16_t runs = data.runs[season][arm];
+  float alpha = max(1.0f / (runs + 1), TUNER_ALPHA_MIN);
+  data.score[season][arm] += alpha * (score - data.score[season][arm]);
+  if (runs < 65535) {
+    data.runs[season][arm] = runs + 1;
+  }
+
+  lastDeltaP = deltaP;
+  lastMargin = startMargin;
+  lastScore = score;
+  data.arm[season] = chooseArm();
+  deltaP = armToDeltaP(data.arm[season]);
+  adjusted = true; // log every scored run, even if deltaP stays the same
+  save();
+#ifdef DEBUGTUNERHANDLING
+  printStatus();
+#endif
+}
+
+/// @brief Choose the margin for the next runs: the smallest margin, whose runs pay off. If no
+/// margin is known to pay off, the margin is increased above the largest failing one. Sometimes the
+/// next smaller margin is tried.
+/// @return arm index
+uint8_t DeltaTuner::chooseArm() {
+  const float *score = data.score[season];
+  const uint16_t *runs = data.runs[season];
+  uint8_t best = data.arm[season];
+  int highestFailing = -1;
+  boolean found = false;
+  for (uint8_t i = 0; i < TUNER_ARMS; i++) {
+    if (runs[i] < TUNER_MIN_RUNS) {
+      continue; // not trusted yet
+    }
+    if (score[i] >= TUNER_MIN_GAIN_K) {
+      if (!found) {
+        best = i;
+        found = true;
+      }
+    } else {
+      highestFailing = i;
+    }
+  }
+  if (highestFailing >= 0 && (!found || best <= highestFailing)) {
+    // runs with this margin don't pay off -> demand more
+    best = min(highestFailing + 1, TUNER_ARMS - 1);
+  }
+  if (best > 0 && random(100) < TUNER_EXPLORE_PCT) {
+    best--; // explore a smaller margin
+  }
+  return best;
+}
+
+uint8_t DeltaTuner::marginToArm(float margin) {
+  int arm = (int)((margin - TUNER_DELTAP_MIN) / TUNER_DELTAP_STEP);
+  return constrain(arm, 0, TUNER_ARMS - 1);
+}
+
+float DeltaTuner::armToDeltaP(uint8_t arm) {
+  return constrain(TUNER_DELTAP_MIN + arm * TUNER_DELTAP_STEP, TUNER_DELTAP_MIN, TUNER_DELTAP_MAX);
+}
+
+/// @brief get the tuned dew point difference for the actual season
+/// @return dew point difference in K
+float DeltaTuner::getDeltaP() {
+#if TUNER_ENABLED == 1
+  return deltaP;
+#else
+  return DELTAP;
+#endif
+}
+
+/// @brief Reports once, if a run was scored and the result shall be logged with createLogChar()
+/// @return true if a new log line is available
+boolean DeltaTuner::hasAdjustment() {
+  boolean isNew = adjusted;
+  adjusted = false;
+  return isNew;
+}
+
+/// @brief Fill the string with the last adjustment, see TUNER_CSV_HEADER
+/// @param tunerLogStr char array length TUNERLOGSTR_LENGTH
+void DeltaTuner::createLogChar(char *tunerLogStr) {
+  snprintf(tunerLogStr, TUNERLOGSTR_LENGTH, "%u;%+3.1f;%+4.2f;%u;%3.1f;%3.1f", season, lastMargin,
+           lastScore, data.runs[season][marginToArm(lastMargin)], lastDeltaP, deltaP);
+}
+
+/// @brief Print the learned scores of the actual season
+void DeltaTuner::printStatus() {
+  Serial.print("Tuner season ");
+  Serial.print(season);
+  Serial.print(": deltaP=");
+  Serial.println(deltaP);
+  for (uint8_t i = 0; i < TUNER_ARMS; i++) {
+    Serial.print("  margin ");
+    Serial.print(armToDeltaP(i));
+    Serial.print("K: score ");
+    Serial.print(data.score[season][i]);
+    Serial.print("K runs ");
+    Serial.println(data.runs[season][i]);
+  }
+}
+
+/// @brief Load the learned data from the flash. Without valid data, DELTAP is used.
+void DeltaTuner::load() {
+  Preferences prefs;
+  prefs.begin("tuner", true);
+  boolean valid = (prefs.getUChar("version", 0) == TUNER_DATA_VERSION) &&
+                  (prefs.getBytes("data", &data, sizeof(data)) == sizeof(data));
+  prefs.end();
+  if (!valid) {
+    memset(&data, 0, sizeof(data));
+    for (uint8_t s = 0; s < TUNER_SEASONS; s++) {
+      data.arm[s] = marginToArm(DELTAP);
+    }
+  }
+}
+
+/// @brief Store the learned data in the flash
+void DeltaTuner::save() {
+  Preferences prefs;
+  prefs.begin("tuner", false);
+  prefs.putUChar("version", TUNER_DATA_VERSION);
+  prefs.putBytes("data", &data, sizeof(data));
+  prefs.end();
+}
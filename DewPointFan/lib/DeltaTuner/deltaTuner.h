@@ -0,0 +1,91 @@
+// deltaTuner.h
+
+#pragma once
+
+// Enable the tuning of DELTAP? 0: DELTAP from processSensorData.h is used all year.
+#define TUNER_ENABLED 1
+
+// bounds and step of the tuned dew point difference in K
+#define TUNER_DELTAP_MIN 1.0f
+#define TUNER_DELTAP_MAX 5.0f
+#define TUNER_DELTAP_STEP 0.5f
+// number of steps from min to max: (MAX - MIN) / STEP + 1
+#define TUNER_ARMS 9
+
+// how long is the indoor dew point observed after a run to see the rebound from the walls?
+#define TUNER_AFTER_MS 30 * 60 * 1000
+// a run must lower the indoor dew point by this many K (measured TUNER_AFTER_MS after the run) to
+// pay off
+#define TUNER_MIN_GAIN_K 0.1f
+// how many runs with a start margin are needed, before the score of this margin is trusted
+#define TUNER_MIN_RUNS 3
+// in how many percent of the decisions a smaller margin than the best known is tried
+#define TUNER_EXPLORE_PCT 10
+// smallest weight of a new score, so old scores are forgotten slowly
+#define TUNER_ALPHA_MIN 0.1f
+
+// seasons: winter (Dec-Feb), spring, summer, autumn
+#define TUNER_SEASONS 4
+
+// log file for the adjustments on the sd card and length of one log line
+#define TUNERFILENAME "/tuner.csv"
+#define TUNERLOGSTR_LENGTH 48
+#define TUNER_CSV_HEADER F("Date;Season;Margin_K;Score_K;Runs;DeltaP_old;DeltaP_new")
+
+// print debug?
+// define DEBUGTUNERHANDLING
+
+#include "processSensorData.h"
+
+/// @brief DeltaTuner class to tune the dew point difference DELTAP, which is needed to start the
+/// fan in mode AUTO, for each season. Each completed run is scored by the change of the indoor dew
+/// point from the start of the run until TUNER_AFTER_MS after the end. The score is learned for the
+/// margin (DP_i - DP_o) at the start of the run. The smallest margin, whose runs pay off, is used.
+/// Sometimes a smaller margin is tried to learn if it pays off as well (bandit style exploration).
+/// The learned scores are stored in the flash (Preferences) and every adjustment is logged.
+class DeltaTuner {
+public:
+  void init();
+
+  void update(AvgMeasurement inner, AvgMeasurement outer, boolean fanOn, boolean isAuto,
+              uint8_t month);
+
+  float getDeltaP();
+  boolean hasAdjustment();
+  void createLogChar(char *tunerLogStr);
+  void printStatus();
+
+  DeltaTuner()
+      : tunerState(TUNER_IDLE), deltaP(DELTAP), season(0), startDewPointI(0), startMargin(0),
+        runEndTime(0), adjusted(false), lastMargin(0), lastScore(0), lastDeltaP(DELTAP),
+        data{} {}
+
+private:
+  enum DeltaTunerStates { TUNER_IDLE, TUNER_RUN, TUNER_AFTER } tunerState;
+
+  void scoreRun(float score);
+  uint8_t chooseArm();
+  uint8_t marginToArm(float margin);
+  float armToDeltaP(uint8_t arm);
+  void load();
+  void save();
+
+  float deltaP;           // actual tuned dew point difference
+  uint8_t season;         // actual season
+  float startDewPointI;   // indoor dew point at the start of the run
+  float startMargin;      // DP_i - DP_o at the start of the run
+  uint64_t runEndTime;
+
+  // last adjustment for the log
+  boolean adjusted;
+  float lastMargin;
+  float lastScore;
+  float lastDeltaP;
+
+  // learned data, stored in the flash
+  struct {
+    float score[TUNER_SEASONS][TUNER_ARMS];   // mean score of the runs per start margin
+    uint16_t runs[TUNER_SEASONS][TUNER_ARMS]; // number of runs per start margin
+    uint8_t arm[TUNER_SEASONS];               // chosen margin per season
+  } data;
+};
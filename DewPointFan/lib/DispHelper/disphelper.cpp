@@ -3,6 +3,7 @@
 #include "processSensorData.h"
 
 #include "disphelper.h"
+#include "timeService.h"
 
 /// @brief initialize the display helper
 /// @param versionStr Version to display
@@ -25,11 +26,11 @@ boolean DispHelper::init(char *versionStr) {
   u8x8.println("init ... ");
   u8x8.setCursor(0, 6);
   u8x8.println(versionStr);
-  lastDispTime = millis();
+  lastDispTime = timeService.nowMs();
   dispState = DISP_TIME;
 
   // initialize activity timer (display just turned on)
-  lastActivityTime = millis();
+  lastActivityTime = timeService.nowMs();
 
   return true;
 }
@@ -44,7 +45,7 @@ void DispHelper::setDisplayPower(bool on) {
   if (on) {
     u8x8.setPowerSave(0);
     // reset activity timer when turning the display on
-    lastActivityTime = millis();
+    lastActivityTime = timeService.nowMs();
   } else {
     u8x8.setPowerSave(1);
   }
@@ -53,14 +54,14 @@ void DispHelper::setDisplayPower(bool on) {
 
 /// @brief Reset the inactivity timer (user activity) and turn on display
 void DispHelper::resetActivityTimer() {
-  lastActivityTime = millis();
+  lastActivityTime = timeService.nowMs();
   setDisplayPower(true);
 }
 
 /// @brief DispHelper function that is called regularly in loop()
 /// @return the page to show
 DispHelperState DispHelper::loop() {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
 
   // Check for inactivity timeout and turn off display if needed
   if (displayOn) {
@@ -147,6 +148,14 @@ DispHelperState DispHelper::loop() {
     dispState = DISP_INIT;
     break;
   }
+  if (showPage != DISP_NOTHING) {
+    shownPage = showPage;
+    refreshRequested = false;
+  } else if (refreshRequested) {
+    // draw the page again with the changed data, the time of the page is not changed
+    showPage = shownPage;
+    refreshRequested = false;
+  }
   return showPage;
 } // end loop()
 
@@ -155,7 +164,13 @@ DispHelperState DispHelper::loop() {
 void DispHelper::showSpecificDisplay(DispHelperState targetState) {
   dispState = DISP_SPECIFIC;
   specificDispState = targetState;
-  lastDispTime = millis();
+  lastDispTime = timeService.nowMs();
+}
+
+/// @brief The data of the page changed: loop() returns the shown page again, so it is drawn with
+/// the new data. Nothing is drawn while the display is off.
+void DispHelper::refresh() {
+  refreshRequested = displayOn;
 }
 
 void DispHelper::showMode(ControlFanStates controlFanState) {
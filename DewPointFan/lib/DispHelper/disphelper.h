@@ -67,9 +67,11 @@ public:
   void showSensorReset();
 
   void showSpecificDisplay(DispHelperState targetState);
+  void refresh();
 
   DispHelper()
-      : dispState(DISP_INIT), specificDispState(DISP_NOTHING), lastDispTime(0),
+      : dispState(DISP_INIT), specificDispState(DISP_NOTHING), shownPage(DISP_NOTHING),
+        refreshRequested(false), lastDispTime(0),
         u8x8(/* clock=*/SCL, /* data=*/SDA,
              /* reset=*/U8X8_PIN_NONE), // OLEDs without Reset of the Display
         displayOn(true),                // Display startet eingeschaltet
@@ -79,10 +81,12 @@ public:
 private:
   DispHelperState dispState;
   DispHelperState specificDispState;
-  unsigned long lastDispTime;
+  DispHelperState shownPage; // last page returned by loop()
+  bool refreshRequested;     // return shownPage again at the next loop()
+  uint64_t lastDispTime;
   U8X8_SSD1306_128X64_NONAME_HW_I2C u8x8;
 
   bool displayOn; // aktueller An/Aus-Status des Displays
 
-  unsigned long lastActivityTime; // milliseconds of last user activity
+  uint64_t lastActivityTime; // milliseconds of last user activity
 };
\ No newline at end of file
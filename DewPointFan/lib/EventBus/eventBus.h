@@ -0,0 +1,53 @@
+// eventBus.h
+
+#pragma once
+
+// Publish/subscribe within one task: publish() calls the handlers of the event type directly, in
+// the order they subscribed. So a consumer only runs, when something changed, instead of polling
+// the getters of the producer. All memory is static and there is no queue: an event for another
+// task is sent as a message (see Mailbox) and published again in the receiving task.
+// This code does not depend on Arduino, so it can be tested on the host as well.
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief EventBus: handlers per event type. E needs a member type, which is less than TYPES.
+template <typename E, size_t TYPES, size_t MAX_HANDLERS> class EventBus {
+public:
+  /// @brief handler of an event, called in the task of publish()
+  typedef void (*Handler)(const E &event);
+
+  EventBus() : handlerCnt{}, publishCnt(0) {}
+
+  /// @brief Call fn for every event of the type. Only call it before the first publish().
+  /// @return false if there are already MAX_HANDLERS for the type
+  bool subscribe(uint8_t type, Handler fn) {
+    if (type >= TYPES || handlerCnt[type] >= MAX_HANDLERS) {
+      return false;
+    }
+    handlers[type][handlerCnt[type]++] = fn;
+    return true;
+  }
+
+  /// @brief Call all handlers of the event type, only call from the task of the bus
+  void publish(const E &event) {
+    uint8_t type = event.type;
+    if (type >= TYPES) {
+      return;
+    }
+    publishCnt++;
+    for (uint8_t i = 0; i < handlerCnt[type]; i++) {
+      handlers[type][i](event);
+    }
+  }
+
+  /// @brief number of events published since the start
+  uint32_t getPublishCount() const {
+    return publishCnt;
+  }
+
+private:
+  Handler handlers[TYPES][MAX_HANDLERS];
+  uint8_t handlerCnt[TYPES];
+  uint32_t publishCnt;
+};
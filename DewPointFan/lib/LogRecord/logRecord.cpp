@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logRecord.h"
+
+// texts which can't be stored as tenths, index i is stored as LOGRECORD_TENTHS_SPECIAL + i
+static const char *specialTexts[LOGRECORD_TENTHS_SPECIAL_CNT] = {"-0.0", "nan", "+nan", "-nan",
+                                                                 "inf",  "+inf", "-inf"};
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, v & 0xFFFF);
+  put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+/// @brief days since 1970-01-01 of a date in the gregorian calendar
+static int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int32_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = (uint32_t)(y - era * 400);
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+/// @brief date of the days since 1970-01-01, inverse of daysFromCivil()
+static void civilFromDays(int32_t z, int32_t *y, uint32_t *m, uint32_t *d) {
+  z += 719468;
+  int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  uint32_t doe = (uint32_t)(z - era * 146097);
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = (int32_t)yoe + era * 400 + (*m <= 2);
+}
+
+/// @brief parse one value like "+23.4" of the log and move str behind it
+/// @return false if the text can't be stored
+static bool parseTenths(const char *&str, int16_t *tenths) {
+  size_t len = strcspn(str, ";");
+  for (int i = 0; i < LOGRECORD_TENTHS_SPECIAL_CNT; i++) {
+    if (len == strlen(specialTexts[i]) && strncmp(str, specialTexts[i], len) == 0) {
+      *tenths = LOGRECORD_TENTHS_SPECIAL + i;
+      str += len;
+      return true;
+    }
+  }
+  // only the format "%+3.1f" can be reproduced
+  if (str[0] != '+' && str[0] != '-') {
+    return false;
+  }
+  char *end;
+  long whole = strtol(str + 1, &end, 10);
+  if (end == str + 1 || end[0] != '.' || end[1] < '0' || end[1] > '9' ||
+      (end[2] != ';' && end[2] != 0)) {
+    return false;
+  }
+  long value = whole * 10 + (end[1] - '0');
+  if (value > 32767 - LOGRECORD_TENTHS_SPECIAL_CNT) {
+    return false;
+  }
+  *tenths = (int16_t)(str[0] == '-' ? -value : value);
+  str = end + 2;
+  return true;
+}
+
+/// @brief parse an unsigned number and move str behind it
+static bool parseUnsigned(const char *&str, uint32_t max, uint32_t *value) {
+  if (*str < '0' || *str > '9') {
+    return false;
+  }
+  char *end;
+  unsigned long v = strtoul(str, &end, 10);
+  if (v > max) {
+    return false;
+  }
+  *value = v;
+  str = end;
+  return true;
+}
+
+/// @brief skip the separator ";"
+static bool parseSeparator(const char *&str) {
+  if (*str != ';') {
+    return false;
+  }
+  str++;
+  return true;
+}
+
+/// @brief print a value stored by parseTenths()
+static int printTenths(char *line, size_t len, int16_t tenths) {
+  if (tenths < LOGRECORD_TENTHS_SPECIAL + LOGRECORD_TENTHS_SPECIAL_CNT) {
+    return snprintf(line, len, "%s", specialTexts[tenths - LOGRECORD_TENTHS_SPECIAL]);
+  }
+  int v = abs(tenths);
+  return snprintf(line, len, "%c%d.%d", tenths < 0 ? '-' : '+', v / 10, v % 10);
+}
+
+/// @brief Create a record from the strings of the CSV log. The record is checked to reproduce the
+/// strings byte for byte.
+/// @param dateStr "YYYY-MM-DD hh:mm:ss" of RTCHelper::createTimeStampLogging()
+/// @param tempStr string of ProcessSensorData::createLogChar()
+/// @param controlStr string of ControlFan::createLogChar()
+/// @param record LOGRECORD_SIZE bytes
+/// @return false if the strings can't be stored in the binary format
+bool logRecordEncode(const char *dateStr, const char *tempStr, const char *controlStr,
+                     uint8_t *record) {
+  unsigned int year, month, day, hour, minute, second;
+  if (sscanf(dateStr, "%4u-%2u-%2u %2u:%2u:%2u", &year, &month, &day, &hour, &minute, &second) !=
+      6) {
+    return false;
+  }
+  int32_t days = daysFromCivil(year, month, day);
+  if (days < 0) {
+    return false;
+  }
+  put32(record, (uint32_t)days * 86400 + hour * 3600 + minute * 60 + second);
+
+  const char *p = tempStr;
+  for (int i = 0; i < 6; i++) {
+    int16_t tenths;
+    if (!parseTenths(p, &tenths) || !parseSeparator(p)) {
+      return false;
+    }
+    put16(record + 4 + 2 * i, (uint16_t)tenths);
+  }
+  uint32_t validI, validO;
+  if (!parseUnsigned(p, 255, &validI) || !parseSeparator(p) || !parseUnsigned(p, 255, &validO) ||
+      *p != 0) {
+    return false;
+  }
+  record[16] = validI;
+  record[17] = validO;
+
+  uint32_t fan, mode, onSec, offSec;
+  p = controlStr;
+  if (*p++ != 'f' || !parseUnsigned(p, 1, &fan) || !parseSeparator(p) || *p++ != 'm' ||
+      !parseUnsigned(p, 255, &mode) || !parseSeparator(p) || !parseUnsigned(p, 65535, &onSec) ||
+      !parseSeparator(p) || !parseUnsigned(p, 65535, &offSec) || *p != 0) {
+    return false;
+  }
+  record[18] = fan ? LOGRECORD_FLAG_FAN : 0;
+  record[19] = mode;
+  put16(record + 20, onSec);
+  put16(record + 22, offSec);
+
+  // leading zeros or similar can't be reproduced, so compare the result
+  char line[LOGRECORD_CSVLINE_LENGTH];
+  char original[LOGRECORD_CSVLINE_LENGTH];
+  snprintf(original, sizeof(original), "%s;%s;%s", dateStr, tempStr, controlStr);
+  logRecordDecode(record, line, sizeof(line));
+  return strcmp(line, original) == 0;
+}
+
+/// @brief Create a record, which stands for the CSV header line
+/// @param record LOGRECORD_SIZE bytes
+void logRecordEncodeHeader(uint8_t *record) {
+  memset(record, 0, LOGRECORD_SIZE);
+  record[18] = LOGRECORD_FLAG_HEADER;
+}
+
+/// @brief Print the CSV line of a record without line end
+/// @param record LOGRECORD_SIZE bytes
+/// @param line destination
+/// @param len size of line, LOGRECORD_CSVLINE_LENGTH fits every record
+/// @return length of the line
+int logRecordDecode(const uint8_t *record, char *line, size_t len) {
+  if (record[18] & LOGRECORD_FLAG_HEADER) {
+    return snprintf(line, len, "%s", LOGRECORD_CSV_HEADER);
+  }
+  uint32_t time = get32(record);
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays(time / 86400, &year, &month, &day);
+  uint32_t secOfDay = time % 86400;
+  int pos = snprintf(line, len, "%04d-%02u-%02u %02u:%02u:%02u;", (int)year, (unsigned int)month,
+                     (unsigned int)day, (unsigned int)(secOfDay / 3600),
+                     (unsigned int)(secOfDay / 60 % 60), (unsigned int)(secOfDay % 60));
+  for (int i = 0; i < 6 && pos < (int)len; i++) {
+    pos += printTenths(line + pos, len - pos, (int16_t)get16(record + 4 + 2 * i));
+    pos += snprintf(line + pos, len - pos, ";");
+  }
+  if (pos < (int)len) {
+    pos += snprintf(line + pos, len - pos, "%u;%u;f%u;m%u;%u;%u", record[16], record[17],
+                    (record[18] & LOGRECORD_FLAG_FAN) ? 1 : 0, record[19], get16(record + 20),
+                    get16(record + 22));
+  }
+  return pos;
+}
+
+/// @brief Create the header of a binary log file
+/// @param fileHeader LOGRECORD_FILEHEADER_SIZE bytes
+void logRecordFileHeader(uint8_t *fileHeader) {
+  memcpy(fileHeader, LOGRECORD_MAGIC, 4);
+  fileHeader[4] = LOGRECORD_VERSION;
+  fileHeader[5] = LOGRECORD_SIZE;
+  fileHeader[6] = 0;
+  fileHeader[7] = 0;
+}
+
+/// @brief Check the header of a binary log file
+/// @param fileHeader LOGRECORD_FILEHEADER_SIZE bytes
+/// @return true if the file can be read by this version
+bool logRecordCheckFileHeader(const uint8_t *fileHeader) {
+  return memcmp(fileHeader, LOGRECORD_MAGIC, 4) == 0 && fileHeader[4] == LOGRECORD_VERSION &&
+         fileHeader[5] == LOGRECORD_SIZE;
+}
+
+/// @brief CRC32 (IEEE 802.3, like zip) with a table of 16 entries to save memory
+/// @param data data
+/// @param len length of data
+/// @param crc result of the previous part to continue the calculation, 0 to start
+/// @return crc
+uint32_t logCrc32(const void *data, size_t len, uint32_t crc) {
+  static const uint32_t table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+                                     0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                     0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                     0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+/// @brief Add ";<seq>;<crc>" and the line end to a CSV line
+/// @param line CSV line without line end
+/// @param size size of line
+/// @param len length of line
+/// @param seq sequence number
+/// @return new length of line
+int logRecordCsvAddCrc(char *line, size_t size, int len, uint32_t seq) {
+  len += snprintf(line + len, size - len, ";%lu", (unsigned long)seq);
+  uint32_t crc = logCrc32(line, len);
+  len += snprintf(line + len, size - len, ";%08lX\r\n", (unsigned long)crc);
+  return len;
+}
+
+/// @brief Check a CSV line of the data log
+/// @param line line without line end
+/// @param len length of the line
+/// @param seq sequence number of the line, unchanged for lines without one
+/// @return true for header lines, lines without CRC and lines with a correct CRC
+bool logRecordCsvCheckLine(const char *line, size_t len, uint32_t *seq) {
+  int separators = 0;
+  size_t lastSep = 0, seqSep = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (line[i] < 32 || line[i] > 126) {
+      return false; // garbage, e.g. zeros of a torn write
+    }
+    if (line[i] == ';') {
+      separators++;
+      seqSep = lastSep;
+      lastSep = i;
+    }
+  }
+  if (len >= 4 && strncmp(line, "Date", 4) == 0) {
+    return true;
+  }
+  if (separators == 12) {
+    return true; // line without sequence number and CRC
+  }
+  if (separators != 14 || len - lastSep != 9) {
+    return false;
+  }
+  char crcStr[9];
+  memcpy(crcStr, line + lastSep + 1, 8);
+  crcStr[8] = 0;
+  char *end;
+  uint32_t crc = strtoul(crcStr, &end, 16);
+  if (*end != 0 || crc != logCrc32(line, lastSep)) {
+    return false;
+  }
+  *seq = strtoul(line + seqSep + 1, NULL, 10);
+  return true;
+}
+
+/// @brief Find the end of the last valid line in the tail of a CSV log. Lines at the end without
+/// line end or with a wrong CRC are torn by a power loss and should be cut off.
+/// @param tail last bytes of the file
+/// @param len length of tail
+/// @param isFileStart true if tail starts at the beginning of the file
+/// @param lastSeq sequence number of the last valid line, unchanged if there is none
+/// @return length of the valid part of tail
+size_t logRecordCsvValidEnd(const char *tail, size_t len, bool isFileStart, uint32_t *lastSeq) {
+  size_t end = len;
+  while (end > 0) {
+    size_t start = end - 1;
+    while (start > 0 && tail[start - 1] != '\n') {
+      start--;
+    }
+    if (start == 0 && !isFileStart) {
+      return end; // the line may start before the tail, keep it
+    }
+    size_t lineLen = end - start;
+    if (tail[end - 1] == '\n') {
+      lineLen--;
+      if (lineLen > 0 && tail[start + lineLen - 1] == '\r') {
+        lineLen--;
+      }
+      if (logRecordCsvCheckLine(tail + start, lineLen, lastSeq)) {
+        return end;
+      }
+    }
+    end = start;
+  }
+  return 0;
+}
@@ -0,0 +1,62 @@
+// logRecord.h
+
+#pragma once
+
+// Compact binary format of the data log. Each record has LOGRECORD_SIZE bytes, little-endian:
+//   0  uint32 local time in seconds since 1970-01-01 00:00
+//   4  int16  temperature, humidity and dew point inside and outside in 1/10 (T_i T_o H_i H_o
+//             DP_i DP_o), special texts like "nan" or "-0.0" as LOGRECORD_TENTHS_* values
+//  16  uint8  validCnt_i, validCnt_o
+//  18  uint8  flags: LOGRECORD_FLAG_FAN, LOGRECORD_FLAG_HEADER
+//  19  uint8  mode
+//  20  uint16 on seconds, off seconds
+// A file starts with a header of LOGRECORD_FILEHEADER_SIZE bytes: "DPFL", version, record size,
+// two reserved bytes.
+// The CSV line of a record is reproduced byte for byte, so the binary log can be converted to the
+// CSV format, which the visualization reads.
+// This code does not depend on Arduino, so it is used by the host converter as well.
+//
+// CSV lines can end with a sequence number and the CRC32 of the line up to the sequence number:
+//   ...;Off_s;Seq;CRC32  e.g. "...;m2;0;0;1234;9A3F01BC"
+// so a line torn by a brown out is detected by logRecordCsvValidEnd().
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOGRECORD_VERSION 1
+#define LOGRECORD_SIZE 24
+#define LOGRECORD_FILEHEADER_SIZE 8
+#define LOGRECORD_MAGIC "DPFL"
+
+// longest CSV line (the header) without line end + null
+#define LOGRECORD_CSVLINE_LENGTH 144
+
+// header of the CSV file, printed for every header record
+#define LOGRECORD_CSV_HEADER                                                                       \
+  "Date;Temperature T_i;Temperature T_o;Humidity H_i;Humidity H_o;Dew point DP_i;Dew point "       \
+  "DP_o;validCnt_i;validCnt_o;Fan;Mode;On_s;Off_s"
+
+// columns added to the CSV header with sequence number and CRC
+#define LOGRECORD_CSV_HEADER_CRC ";Seq;CRC32"
+// length of ";<seq>;<crc>\r\n"
+#define LOGRECORD_CRC_SUFFIX_LENGTH 23
+
+// record flags
+#define LOGRECORD_FLAG_FAN 0x01
+#define LOGRECORD_FLAG_HEADER 0x80 // the record stands for the CSV header line
+
+// values of the int16 fields, which stand for texts instead of numbers
+#define LOGRECORD_TENTHS_SPECIAL -32768
+#define LOGRECORD_TENTHS_SPECIAL_CNT 7
+
+bool logRecordEncode(const char *dateStr, const char *tempStr, const char *controlStr,
+                     uint8_t *record);
+void logRecordEncodeHeader(uint8_t *record);
+int logRecordDecode(const uint8_t *record, char *line, size_t len);
+void logRecordFileHeader(uint8_t *fileHeader);
+bool logRecordCheckFileHeader(const uint8_t *fileHeader);
+
+uint32_t logCrc32(const void *data, size_t len, uint32_t crc = 0);
+int logRecordCsvAddCrc(char *line, size_t size, int len, uint32_t seq);
+bool logRecordCsvCheckLine(const char *line, size_t len, uint32_t *seq);
+size_t logRecordCsvValidEnd(const char *tail, size_t len, bool isFileStart, uint32_t *lastSeq);
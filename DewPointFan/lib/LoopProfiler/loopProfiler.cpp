@@ -0,0 +1,59 @@
+#include <Arduino.h>
+
+#include "loopProfiler.h"
+
+#if LOOPPROF_ENABLED == 1
+
+LoopProfiler loopProfiler;
+
+static const char *sectionNames[PROF_SECTIONS] = {"sensor", "fan",    "rtc",   "sd",
+                                                  "disp",   "zigbee", "serial"};
+
+/// @brief Print and reset the statistics of all sections. Can be called from any task: the header
+/// is printed at once, each section by its own task at its next call.
+void LoopProfiler::requestStats() {
+  Serial.println("Loop profiler (us): section cnt min mean max | histogram <us:cnt>");
+  requested.store((1UL << PROF_SECTIONS) - 1);
+}
+
+/// @brief Print the statistics of a section and the non empty buckets of its histogram in
+/// microseconds and reset it. The cycles are converted with the current CPU clock.
+/// @param section subsystem of the calling task
+void LoopProfiler::printSection(LoopProfSection section) {
+  float cyclesPerUs = getCpuFrequencyMhz();
+  Stats &s = stats[section];
+  Serial.print(sectionNames[section]);
+  Serial.print(" ");
+  Serial.print(s.cnt);
+  if (s.cnt > 0) {
+    Serial.print(" ");
+    Serial.print(s.minCycles / cyclesPerUs, 1);
+    Serial.print(" ");
+    Serial.print(s.sumCycles / s.cnt / cyclesPerUs, 1);
+    Serial.print(" ");
+    Serial.print(s.maxCycles / cyclesPerUs, 1);
+    Serial.print(" |");
+    for (uint8_t b = 0; b <= LOOPPROF_BUCKETS; b++) {
+      if (s.buckets[b] == 0) {
+        continue;
+      }
+      // upper limit of the bucket
+      Serial.print(" <");
+      Serial.print((float)((1ULL << b)) / cyclesPerUs, 1);
+      Serial.print(":");
+      Serial.print(s.buckets[b]);
+    }
+  }
+  Serial.println();
+  resetSection(section);
+  requested.fetch_and(~(1UL << section));
+}
+
+/// @brief Clear the statistics of a section
+/// @param section subsystem
+void LoopProfiler::resetSection(LoopProfSection section) {
+  memset(&stats[section], 0, sizeof(Stats));
+  stats[section].minCycles = UINT32_MAX;
+}
+
+#endif
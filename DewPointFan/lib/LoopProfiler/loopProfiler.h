@@ -0,0 +1,94 @@
+// loopProfiler.h
+
+#pragma once
+
+// Latency profiler for the subsystems of the FreeRTOS tasks (acquisition, control and io): the
+// cycle counter of the CPU is read before and after each call, the cycles are collected per
+// subsystem as min/max/mean and in a histogram with logarithmic buckets (bucket i: 2^(i-1) to
+// 2^i - 1 cycles). All memory is static. The overhead is two reads of the cycle counter and a few
+// additions per call.
+// Each section is only written by the task, which runs the subsystem. So requestStats() may be
+// called from any task, each section is printed and reset by its own task the next time it runs.
+// With LOOPPROF_ENABLED 0 the profiler is compiled out, LOOPPROF_SCOPE() does nothing.
+#define LOOPPROF_ENABLED 1
+#define LOOPPROF_BUCKETS 32
+
+#include <Arduino.h>
+#include <atomic>
+
+/// @brief profiled subsystems of the tasks
+enum LoopProfSection {
+  PROF_SENSOR,
+  PROF_FAN,
+  PROF_RTC,
+  PROF_SD,
+  PROF_DISP,
+  PROF_ZIGBEE,
+  PROF_SERIAL,
+  PROF_SECTIONS // number of sections
+};
+
+#if LOOPPROF_ENABLED == 1
+#include <esp_cpu.h>
+
+/// @brief LoopProfiler class: latency statistics of the subsystems of the tasks
+class LoopProfiler {
+public:
+  /// @brief Add the duration of one call, only call from the task of the subsystem
+  /// @param section subsystem
+  /// @param cycles duration in CPU cycles
+  inline void add(LoopProfSection section, uint32_t cycles) {
+    if (requested.load(std::memory_order_relaxed) & (1UL << section)) {
+      printSection(section);
+    }
+    Stats &s = stats[section];
+    s.cnt++;
+    s.sumCycles += cycles;
+    s.minCycles = min(s.minCycles, cycles);
+    s.maxCycles = max(s.maxCycles, cycles);
+    s.buckets[cycles == 0 ? 0 : 32 - __builtin_clz(cycles)]++;
+  }
+  void requestStats();
+
+  LoopProfiler() : requested(0) {
+    for (uint8_t i = 0; i < PROF_SECTIONS; i++) {
+      resetSection((LoopProfSection)i);
+    }
+  }
+
+private:
+  void printSection(LoopProfSection section);
+  void resetSection(LoopProfSection section);
+
+  std::atomic<uint32_t> requested; // bit i: print and reset section i at its next add()
+  struct Stats {
+    uint32_t cnt;
+    uint64_t sumCycles;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t buckets[LOOPPROF_BUCKETS + 1];
+  } stats[PROF_SECTIONS];
+};
+
+/// @brief LoopProfScope class: measures its own lifetime, see LOOPPROF_SCOPE()
+class LoopProfScope {
+public:
+  inline LoopProfScope(LoopProfiler &profiler, LoopProfSection section)
+      : profiler(profiler), section(section), startCycles(esp_cpu_get_cycle_count()) {}
+  inline ~LoopProfScope() {
+    profiler.add(section, (uint32_t)(esp_cpu_get_cycle_count() - startCycles));
+  }
+
+private:
+  LoopProfiler &profiler;
+  LoopProfSection section;
+  uint32_t startCycles;
+};
+
+extern LoopProfiler loopProfiler;
+
+// profile the rest of the block as section
+#define LOOPPROF_SCOPE(section) LoopProfScope loopProfScope(loopProfiler, section)
+#else
+#define LOOPPROF_SCOPE(section)
+#endif
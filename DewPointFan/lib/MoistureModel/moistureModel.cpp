@@ -0,0 +1,147 @@
+#include <Arduino.h>
+
+#include "moistureModel.h"
+#include "timeService.h"
+
+/// @brief reset the model to know nothing
+void MoistureModel::init() {
+  theta[0] = 0.0f;
+  theta[1] = 0.0f;
+  P[0][0] = MODEL_P_INIT;
+  P[0][1] = 0.0f;
+  P[1][0] = 0.0f;
+  P[1][1] = MODEL_P_INIT;
+  hasLastSample = false;
+  fanSamples = 0;
+}
+
+/// @brief Feed the model with the actual averages. Call it after each new average (CALC). Every
+/// MODEL_SAMPLE_MS the change of the indoor dew point is used to update the estimation.
+/// @param inner averaged indoor measurement
+/// @param outer averaged outdoor measurement
+/// @param fanOn true if the fan is running
+void MoistureModel::update(AvgMeasurement inner, AvgMeasurement outer, boolean fanOn) {
+  uint64_t now = timeService.nowMs();
+  if (inner.validCnt < 1 || outer.validCnt < 1 || isnan(inner.dewPoint) ||
+      isnan(outer.dewPoint)) {
+    hasLastSample = false; // no valid data -> start again
+    return;
+  }
+  if (!hasLastSample) {
+    hasLastSample = true;
+    lastDewPointI = inner.dewPoint;
+    sumDiff = 0;
+    cntSamples = 0;
+    cntFanOn = 0;
+    lastSampleTime = now;
+    return;
+  }
+
+  sumDiff += outer.dewPoint - inner.dewPoint;
+  cntSamples++;
+  cntFanOn += fanOn ? 1 : 0;
+
+  if (now - lastSampleTime >= MODEL_SAMPLE_MS) {
+    float minutes = (now - lastSampleTime) / 60000.0f;
+    float y = (inner.dewPoint - lastDewPointI) / minutes;
+    float fanShare = (float)cntFanOn / cntSamples;
+    estimate(fanShare * sumDiff / cntSamples, y);
+    if (fanShare > 0.5f) {
+      fanSamples++;
+    }
+#ifdef DEBUGMODELHANDLING
+    printStatus();
+#endif
+    lastDewPointI = inner.dewPoint;
+    sumDiff = 0;
+    cntSamples = 0;
+    cntFanOn = 0;
+    lastSampleTime = now;
+  }
+}
+
+/// @brief One step of the recursive least squares estimator with forgetting factor for
+/// y = a * phi0 + b. Error, covariance and parameters are bounded.
+/// @param phi0 fan share times dew point difference outside - inside
+/// @param y measured change of the indoor dew point in K/min
+void MoistureModel::estimate(float phi0, float y) {
+  const float phi[2] = {phi0, 1.0f};
+  // P * phi
+  float pPhi[2] = {P[0][0] * phi[0] + P[0][1] * phi[1], P[1][0] * phi[0] + P[1][1] * phi[1]};
+  float denom = MODEL_FORGETTING + phi[0] * pPhi[0] + phi[1] * pPhi[1];
+  float k[2] = {pPhi[0] / denom, pPhi[1] / denom};
+
+  float error = y - (theta[0] * phi[0] + theta[1] * phi[1]);
+  error = constrain(error, -MODEL_MAX_ERROR, MODEL_MAX_ERROR);
+  theta[0] = constrain(theta[0] + k[0] * error, 0.0f, MODEL_A_MAX);
+  theta[1] = constrain(theta[1] + k[1] * error, -MODEL_B_MAX, MODEL_B_MAX);
+
+  // P = (P - k * phi^T * P) / lambda, phi^T * P = (P * phi)^T because P is symmetric
+  for (uint8_t i = 0; i < 2; i++) {
+    for (uint8_t j = 0; j < 2; j++) {
+      P[i][j] = (P[i][j] - k[i] * pPhi[j]) / MODEL_FORGETTING;
+    }
+  }
+  // keep P symmetric and bounded
+  P[0][1] = P[1][0] = (P[0][1] + P[1][0]) / 2.0f;
+  float trace = P[0][0] + P[1][1];
+  if (trace > MODEL_P_MAX) {
+    float scale = MODEL_P_MAX / trace;
+    P[0][0] *= scale;
+    P[0][1] *= scale;
+    P[1][0] *= scale;
+    P[1][1] *= scale;
+  }
+}
+
+/// @brief Predict how fast the fan lowers the indoor dew point in this situation
+/// @param inner averaged indoor measurement
+/// @param outer averaged outdoor measurement
+/// @return drop of the indoor dew point caused by the fan in K/min, positive = drier
+float MoistureModel::predictFanDropRate(AvgMeasurement inner, AvgMeasurement outer) {
+  return theta[0] * (inner.dewPoint - outer.dewPoint);
+}
+
+/// @brief Is it still worth to keep the fan running? As long as the model is not trained, yes.
+/// @param inner averaged indoor measurement
+/// @param outer averaged outdoor measurement
+/// @return false if the fan lowers the indoor dew point less than MODEL_MIN_DROP_K_PER_MIN
+boolean MoistureModel::isRunPayingOff(AvgMeasurement inner, AvgMeasurement outer) {
+#if MODEL_ENDS_RUNS == 1
+  if (!isTrained() || inner.validCnt < 1 || outer.validCnt < 1) {
+    return true;
+  }
+  return predictFanDropRate(inner, outer) >= MODEL_MIN_DROP_K_PER_MIN;
+#else
+  return true;
+#endif
+}
+
+/// @brief Has the model seen enough samples with running fan?
+/// @return true if trained
+boolean MoistureModel::isTrained() {
+  return fanSamples >= MODEL_MIN_FAN_SAMPLES;
+}
+
+/// @brief get the learned effect of the fan a
+/// @return change of the indoor dew point in K/min per K dew point difference while the fan runs
+float MoistureModel::getFanEffect() {
+  return theta[0];
+}
+
+/// @brief get the learned drift b
+/// @return change of the indoor dew point in K/min without fan
+float MoistureModel::getDrift() {
+  return theta[1];
+}
+
+/// @brief Print the learned model
+void MoistureModel::printStatus() {
+  Serial.print("Model: a=");
+  Serial.print(theta[0], 4);
+  Serial.print("/min b=");
+  Serial.print(theta[1], 4);
+  Serial.print("K/min fanSamples=");
+  Serial.print(fanSamples);
+  Serial.println(isTrained() ? " trained" : " learning");
+}
@@ -0,0 +1,71 @@
+// moistureModel.h
+
+#pragma once
+
+// The model learns how fast the indoor dew point changes per minute:
+//   dDP_i/dt = a * fanOn * (DP_o - DP_i) + b
+// a: effect of the fan per Kelvin dew point difference, b: drift without fan (e.g. wet walls)
+
+// how often shall the model be updated? Dew point changes are too small to be seen every 2s.
+#define MODEL_SAMPLE_MS 60000
+
+// forgetting factor of the recursive least squares estimator. 0.999 -> memory of ~1000 samples
+#define MODEL_FORGETTING 0.999f
+// initial and maximum covariance, bounds the gain so the estimator can't wind up
+#define MODEL_P_INIT 10.0f
+#define MODEL_P_MAX 100.0f
+// limit of the prediction error in K/min, larger errors are treated as sensor glitches
+#define MODEL_MAX_ERROR 0.2f
+// limits of the parameters
+#define MODEL_A_MAX 0.5f  // 1/min
+#define MODEL_B_MAX 0.05f // K/min
+
+// samples with running fan, before the model is trusted
+#define MODEL_MIN_FAN_SAMPLES 30
+
+// End a run in mode AUTO, if the learned fan effect is smaller than this (K/min)?
+// Set MODEL_ENDS_RUNS to 0 to only learn and log the model.
+#define MODEL_ENDS_RUNS 1
+#define MODEL_MIN_DROP_K_PER_MIN 0.005f
+
+// print debug?
+// define DEBUGMODELHANDLING
+
+#include "processSensorData.h"
+
+/// @brief MoistureModel class to learn online, how effective ventilation is. A recursive least
+/// squares estimator with two parameters runs in constant memory. Feed it with update() after each
+/// new average of the sensors.
+class MoistureModel {
+public:
+  void init();
+
+  void update(AvgMeasurement inner, AvgMeasurement outer, boolean fanOn);
+
+  float predictFanDropRate(AvgMeasurement inner, AvgMeasurement outer);
+  boolean isRunPayingOff(AvgMeasurement inner, AvgMeasurement outer);
+  boolean isTrained();
+
+  float getFanEffect();
+  float getDrift();
+  void printStatus();
+
+  MoistureModel()
+      : theta{0.0f, 0.0f}, P{{MODEL_P_INIT, 0.0f}, {0.0f, MODEL_P_INIT}}, hasLastSample(false),
+        lastDewPointI(0), sumDiff(0), cntSamples(0), cntFanOn(0), lastSampleTime(0),
+        fanSamples(0) {}
+
+private:
+  void estimate(float phi0, float y);
+
+  float theta[2]; // estimated parameters a, b
+  float P[2][2];  // covariance of the estimation
+
+  boolean hasLastSample;
+  float lastDewPointI;          // indoor dew point at the start of the sample
+  float sumDiff;                // sum of DP_o - DP_i during the sample
+  uint16_t cntSamples;          // number of averages during the sample
+  uint16_t cntFanOn;            // number of averages with fan on during the sample
+  uint64_t lastSampleTime;      // start of the sample
+  uint32_t fanSamples;          // number of samples with fan on so far
+};
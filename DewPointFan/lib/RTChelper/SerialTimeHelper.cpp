@@ -23,6 +23,38 @@ bool SerialTimeHelper::parseDateTimeLine(const String &line, uint16_t &year, uin
   return false;
 }
 
+/// @brief Kommando registrieren
+/// @param cmd Kommandobuchstabe, Gross-/Kleinschreibung egal
+/// @param help Hilfetext fuer die Liste der Kommandos
+/// @param handler Funktion, die mit dem Rest der Zeile aufgerufen wird
+/// @return false, wenn kein Platz mehr ist
+bool SerialTimeHelper::addCommand(char cmd, const char *help, SerialCommandHandler handler) {
+  if (commandCnt >= SERIAL_MAX_COMMANDS) {
+    return false;
+  }
+  commands[commandCnt].cmd = toupper(cmd);
+  commands[commandCnt].help = help;
+  commands[commandCnt].handler = handler;
+  commandCnt++;
+  return true;
+}
+
+/// @brief Registriertes Kommando ausfuehren, z.B. "H 30"
+/// @return true, wenn das Kommando gefunden wurde
+bool SerialTimeHelper::runCommand(const String &line) {
+  char cmd = toupper(line.charAt(0));
+  for (uint8_t i = 0; i < commandCnt; i++) {
+    // nur der Buchstabe oder Buchstabe + Leerzeichen + Argumente
+    if (commands[i].cmd == cmd && (line.length() == 1 || line.charAt(1) == ' ')) {
+      String args = line.substring(1);
+      args.trim();
+      commands[i].handler(args);
+      return true;
+    }
+  }
+  return false;
+}
+
 void SerialTimeHelper::handleSerial() {
   while (Serial.available() > 0) {
     char c = Serial.read();
@@ -62,11 +94,17 @@ void SerialTimeHelper::handleSerial() {
             Serial.println("Zum Abbrechen: X eingeben und Enter druecken.");
             Serial.println("Hinweis: Bitte immer die lokale Uhrzeit eingeben - Sommer-/Winterzeit "
                            "wird automatisch erkannt.");
-          } else {
+            Serial.println("Enter genau beim Minutenwechsel druecken, die Abweichung der RTC wird "
+                           "fuer die Drift-Korrektur genutzt.");
+          } else if (!runCommand(line)) {
             Serial.print("Unbekanntes Kommando: ");
             Serial.println(line);
             Serial.println("Verfuegbare Kommandos:");
             Serial.println("  Z  -> Zeit setzen (Test Sommer/Winterzeit)");
+            for (uint8_t i = 0; i < commandCnt; i++) {
+              Serial.print("  ");
+              Serial.println(commands[i].help);
+            }
           }
 
           // =======================
@@ -94,7 +132,8 @@ void SerialTimeHelper::handleSerial() {
             local.minute = mi;
             local.second = 0;
 
-            rtcHelper.setFromLocalDate(local);
+            // the entered time is a reference for the drift of the RTC
+            rtcHelper.setFromReference(local);
 
             // Show current time briefly after setting
             rtcHelper.printCurrentLocalShortWithDST();
@@ -5,12 +5,24 @@
 #include <Arduino.h>
 #include "rtchelper.h"
 
+// Anzahl weiterer Kommandos, die mit addCommand() registriert werden koennen
+#define SERIAL_MAX_COMMANDS 6
+
+/// @brief Funktion fuer ein registriertes Kommando, args: Text nach dem Kommandobuchstaben
+typedef void (*SerialCommandHandler)(const String &args);
+
 /// @brief Hilfsklasse für serielle Kommandos zur Zeiteinstellung.
 /// Kommando:
 ///   Z  -> Zeit setzen (dd.mm.yyyy hh:mm), inkl. Sommer-/Winterzeit-Test
+/// Weitere Kommandos anderer Module werden mit addCommand() registriert.
 class SerialTimeHelper {
 public:
-  SerialTimeHelper(RTCHelper &rtc) : rtcHelper(rtc), waitForTimeInput(false), buffer("") {}
+  SerialTimeHelper(RTCHelper &rtc)
+      : rtcHelper(rtc), waitForTimeInput(false), buffer(""), commandCnt(0) {}
+
+  /// @brief Kommando registrieren, z.B. addCommand('H', "H [min] -> ...", handler)
+  /// @return false, wenn kein Platz mehr ist
+  bool addCommand(char cmd, const char *help, SerialCommandHandler handler);
 
   /// @brief In loop() aufrufen, um serielle Kommandos zu verarbeiten.
   void handleSerial();
@@ -25,6 +37,15 @@ private:
   bool waitForTimeInput;
   String buffer;
 
+  struct SerialCommand {
+    char cmd;
+    const char *help;
+    SerialCommandHandler handler;
+  } commands[SERIAL_MAX_COMMANDS];
+  uint8_t commandCnt;
+
+  bool runCommand(const String &line);
+
   bool parseDateTimeLine(const String &line, uint16_t &year, uint8_t &month, uint8_t &day,
                          uint8_t &hour, uint8_t &minute);
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "rtcDrift.h"
+
+/// @brief Load the estimate from the flash
+void RtcDrift::init() {
+  load();
+}
+
+/// @brief Call it whenever the RTC is set
+/// @param baseEpoch base time, which was written to the RTC
+/// @param isReference true if the time is from a reference, false for e.g. the compiler date
+void RtcDrift::clockSet(uint32_t baseEpoch, boolean isReference) {
+  data.setEpoch = baseEpoch;
+  data.setByRef = isReference;
+  save();
+}
+
+/// @brief Add a pair of RTC time and true time, before the RTC is set to the true time. Call
+/// clockSet() afterwards.
+/// @param rtcEpoch base time read from the RTC
+/// @param trueEpoch true base time
+/// @return true if the pair was used for the estimate
+boolean RtcDrift::addReference(uint32_t rtcEpoch, uint32_t trueEpoch) {
+  if (!data.setByRef || data.setEpoch == 0 || trueEpoch < data.setEpoch + RTC_DRIFT_MIN_S) {
+    return false; // no reference to measure from or too short
+  }
+  uint32_t elapsed = trueEpoch - data.setEpoch;
+  int32_t err = (int32_t)(rtcEpoch - trueEpoch);
+  if (abs(err) > (double)elapsed * RTC_DRIFT_MAX_PPM / 1e6) {
+    Serial.print("RTC drift: pair ignored, error ");
+    Serial.print(err);
+    Serial.println(" s");
+    return false;
+  }
+  data.sumErrElapsed = data.sumErrElapsed * RTC_DRIFT_DECAY + (double)err * elapsed;
+  data.sumElapsedSqr = data.sumElapsedSqr * RTC_DRIFT_DECAY + (double)elapsed * elapsed;
+  data.pairCnt++;
+  data.lastErr = err;
+  data.lastElapsed = elapsed;
+  ppm = data.sumErrElapsed / data.sumElapsedSqr * 1e6;
+  Serial.print("RTC drift: ");
+  Serial.print(ppm);
+  Serial.println(" ppm");
+  return true;
+}
+
+/// @brief Correct the time read from the RTC by the drift since the last set
+/// @param rtcEpoch base time read from the RTC
+/// @return corrected base time
+uint32_t RtcDrift::correct(uint32_t rtcEpoch) {
+#if RTC_DRIFT_ENABLED == 1
+  if (ppm != 0 && data.setEpoch != 0 && rtcEpoch > data.setEpoch) {
+    // the RTC counted (1 + rate) * elapsed since the set
+    return data.setEpoch + (uint32_t)((rtcEpoch - data.setEpoch) / (1 + ppm / 1e6) + 0.5);
+  }
+#endif
+  return rtcEpoch;
+}
+
+/// @brief get the estimated drift rate
+/// @return ppm, positive: the RTC is too fast
+float RtcDrift::getPpm() {
+  return ppm;
+}
+
+/// @brief Forget all pairs, e.g. after the RTC or its crystal was replaced
+void RtcDrift::reset() {
+  uint32_t setEpoch = data.setEpoch;
+  memset(&data, 0, sizeof(data));
+  data.setEpoch = setEpoch;
+  ppm = 0;
+  save();
+}
+
+/// @brief Print the estimate
+void RtcDrift::printStatus() {
+  Serial.print("RTC drift: ");
+  Serial.print(ppm);
+  Serial.print(" ppm (");
+  Serial.print(ppm * 86400 * 7 / 1e6);
+  Serial.print(" s/week), pairs ");
+  Serial.print(data.pairCnt);
+  Serial.print(", last error ");
+  Serial.print(data.lastErr);
+  Serial.print(" s in ");
+  Serial.print(data.lastElapsed / 86400);
+  Serial.print(" d, ");
+  Serial.println(data.setByRef ? "last set by reference" : "last set without reference");
+}
+
+/// @brief Load the estimate from the flash. Without valid data, the RTC is not corrected.
+void RtcDrift::load() {
+  Preferences prefs;
+  prefs.begin("rtcdrift", true);
+  boolean valid = (prefs.getUChar("version", 0) == RTC_DRIFT_DATA_VERSION) &&
+                  (prefs.getBytes("data", &data, sizeof(data)) == sizeof(data));
+  prefs.end();
+  if (!valid) {
+    memset(&data, 0, sizeof(data));
+  }
+  ppm = data.sumElapsedSqr > 0 ? data.sumErrElapsed / data.sumElapsedSqr * 1e6 : 0;
+}
+
+/// @brief Store the estimate in the flash
+void RtcDrift::save() {
+  Preferences prefs;
+  prefs.begin("rtcdrift", false);
+  prefs.putUChar("version", RTC_DRIFT_DATA_VERSION);
+  prefs.putBytes("data", &data, sizeof(data));
+  prefs.end();
+}
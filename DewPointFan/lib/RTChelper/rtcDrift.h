@@ -0,0 +1,53 @@
+// rtcDrift.h
+
+#pragma once
+
+// The PCF8563 has no offset register, so its drift is estimated and corrected in the cached clock.
+// Every time the clock is set from a reference (the serial command Z or an external time source),
+// the RTC time before the set and the true time are a pair. The error of the RTC grows from the
+// last set: error = rate * elapsed. The rate is fitted through all pairs (least squares through
+// the origin), old pairs are weighted less and less. A manual set is only accurate to the minute,
+// so pairs closer than RTC_DRIFT_MIN_S to the last set are not used.
+#define RTC_DRIFT_ENABLED 1
+#define RTC_DRIFT_MIN_S 7 * 24 * 60 * 60
+// a larger rate is not a drift, but a wrong time (typo, empty battery) and is ignored
+#define RTC_DRIFT_MAX_PPM 200
+// weight of the previous pairs, when a new pair is added
+#define RTC_DRIFT_DECAY 0.8
+
+#define RTC_DRIFT_DATA_VERSION 1
+
+#include <Arduino.h>
+
+/// @brief RtcDrift class to estimate the drift rate of the RTC and to correct the time read from
+/// it. The estimate is stored in the flash (Preferences).
+class RtcDrift {
+public:
+  void init();
+
+  void clockSet(uint32_t baseEpoch, boolean isReference);
+  boolean addReference(uint32_t rtcEpoch, uint32_t trueEpoch);
+  uint32_t correct(uint32_t rtcEpoch);
+  float getPpm();
+  void reset();
+  void printStatus();
+
+  RtcDrift() : ppm(0), data{} {}
+
+private:
+  void load();
+  void save();
+
+  float ppm; // estimated rate in ppm, positive: the RTC is too fast
+
+  // stored in the flash
+  struct {
+    uint32_t setEpoch;     // base time of the last set of the RTC
+    boolean setByRef;      // the last set was a reference, so the next pair can be fitted
+    uint32_t pairCnt;      // fitted pairs
+    double sumErrElapsed;  // sum of error * elapsed time
+    double sumElapsedSqr;  // sum of elapsed time^2
+    int32_t lastErr;       // error of the last pair in s
+    uint32_t lastElapsed;  // elapsed time of the last pair in s
+  } data;
+};
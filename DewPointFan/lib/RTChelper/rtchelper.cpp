@@ -1,22 +1,12 @@
 #include <Arduino.h>
 
 #include "rtchelper.h"
+#include "timeZone.h"
+#include "timeService.h"
 #include <Wire.h>
+#include <sys/time.h>
 #include "buildTime.h"
 
-// ===== Helper functions for daylight saving time (EU, Europe/Berlin) =====
-
-static bool isLeapYear(uint16_t year) {
-  return ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0));
-}
-
-static uint8_t daysInMonth(uint16_t year, uint8_t month) {
-  static const uint8_t dim[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-  if (month == 2 && isLeapYear(year))
-    return 29;
-  return dim[month - 1];
-}
-
 // 0 = Sunday, 1 = Monday, ... 6 = Saturday
 static uint8_t dayOfWeek(uint16_t year, uint8_t month, uint8_t day) {
   int y = year;
@@ -32,95 +22,42 @@ static uint8_t dayOfWeek(uint16_t year, uint8_t month, uint8_t day) {
   return dow;
 }
 
-// last Sunday in the given month (3=March, 10=October)
-static uint8_t lastSunday(uint16_t year, uint8_t month) {
-  uint8_t d = daysInMonth(year, month);
-  uint8_t dow = dayOfWeek(year, month, d); // 0=Sun ... 6=Sat
-  return d - dow;                          // last Sunday
-}
-
-// Is daylight saving time (CEST) in effect for this local *standard time* (base time CET)?
-// The full DST logic is only compiled in if DAYLIGHTSAVING == 1.
-// Otherwise, isDST_Europe_CET() always returns false.
-#if defined(DAYLIGHTSAVING) && (DAYLIGHTSAVING == 1)
-static bool isDST_Europe_CET(uint16_t year, uint8_t month, uint8_t day, uint8_t hour) {
-  // Jan, Feb, Nov, Dec -> always standard time
-  if (month < 3 || month > 10)
-    return false;
-
-  // Apr–Sep -> always daylight saving time
-  if (month > 3 && month < 10)
-    return true;
-
-  // March / October -> check around the switch day
-  uint8_t ls = lastSunday(year, month);
-
-  if (month == 3) {
-    // Switch: last Sunday in March, 2:00 (from 2:00 to 3:00)
-    if (day > ls)
-      return true;
-    if (day < ls)
-      return false;
-    // On the switch day:
-    return (hour >= 2);
-  } else { // month == 10
-    // Switch: last Sunday in October, 3:00 (from 3:00 back to 2:00)
-    if (day < ls)
-      return true;
-    if (day > ls)
-      return false;
-    // On the switch day:
-    return (hour < 3);
-  }
-}
-#else
-static bool isDST_Europe_CET(uint16_t /*year*/, uint8_t /*month*/, uint8_t /*day*/,
-                             uint8_t /*hour*/) {
-  // Daylight saving disabled at compile time
-  return false;
-}
-#endif
+// ===== Helper functions for the conversion between RTC_Date and seconds since 1970 =====
 
-// Helper functions: add or subtract one hour to/from an RTC_Date
-static void addOneHour(RTC_Date &dt) {
-  dt.hour++;
-  if (dt.hour >= 24) {
-    dt.hour = 0;
-    dt.day++;
-    if (dt.day > daysInMonth(dt.year, dt.month)) {
-      dt.day = 1;
-      dt.month++;
-      if (dt.month > 12) {
-        dt.month = 1;
-        dt.year++;
-      }
-    }
-  }
+static uint32_t dateToEpoch(const RTC_Date &dt) {
+  return tzDaysFromCivil(dt.year, dt.month, dt.day) * 86400UL + dt.hour * 3600UL +
+         dt.minute * 60 + dt.second;
 }
 
-static void subOneHour(RTC_Date &dt) {
-  if (dt.hour > 0) {
-    dt.hour--;
-  } else {
-    dt.hour = 23;
-    if (dt.day > 1) {
-      dt.day--;
-    } else {
-      if (dt.month > 1) {
-        dt.month--;
-      } else {
-        dt.month = 12;
-        dt.year--;
-      }
-      dt.day = daysInMonth(dt.year, dt.month);
-    }
-  }
+static RTC_Date epochToDate(uint32_t epoch) {
+  RTC_Date dt;
+  uint32_t days = epoch / 86400;
+  uint32_t secs = epoch % 86400;
+  dt.hour = secs / 3600;
+  dt.minute = (secs / 60) % 60;
+  dt.second = secs % 60;
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;                                     // [0, 146096]
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);              // [0, 365]
+  uint32_t mp = (5 * doy + 2) / 153;                                   // [0, 11], March = 0
+  dt.day = doy - (153 * mp + 2) / 5 + 1;
+  dt.month = mp < 10 ? mp + 3 : mp - 9;
+  dt.year = yoe + era * 400 + (dt.month <= 2);
+  return dt;
 }
 
 /// @brief Init the RTCHelper. Checks RTC and compiler date and uses the newest, valid time and
 /// syncs the local esp time to it.
 /// @return true if local esp time has been successfully synced
 boolean RTCHelper::init() {
+  if (!tzParse(RTC_TZ, &tz)) {
+    Serial.println("RTC_TZ invalid, using UTC");
+    tz = TzInfo{};
+  }
+  yearStartEpoch = nextYearEpoch = 0; // compute the DST table again
+  drift.init();
   Wire.begin();
   rtc.begin();
 
@@ -179,18 +116,29 @@ boolean RTCHelper::init() {
     someValidTime = false;
   }
   if (someValidTime) {
-    // try to set the local esp32 time to this value
-    if (rtc.syncToSystem()) {
+    // set the esp32 system time to this value, it drives the cached clock
+    RTC_Date base = readRTC();
+    if (base.year >= 2000) {
+      setSystemTime(drift.correct(dateToEpoch(base)));
       return true;
     }
   }
   return false;
 }
 
-/// @brief If debugging is enabled (DEBUGRTCHANDLING) rtc time and valid infos are printed
+/// @brief Corrects the system time from the RTC every RTC_RESYNC_MS. If debugging is enabled
+/// (DEBUGRTCHANDLING) rtc time and valid infos are printed
 /// @return always true
 boolean RTCHelper::loop() {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
+  if (systemTimeValid && now - lastResyncTime >= RTC_RESYNC_MS) {
+    resync();
+    lastResyncTime = now;
+  }
+  if (now - lastStatsTime >= RTC_STATS_MS) {
+    printStats();
+    lastStatsTime = now;
+  }
   if (now - lastRTCTime >= RTCwaitMS) {
 #ifdef DEBUGRTCHANDLING
     Serial.print("RTC: ");
@@ -263,7 +211,7 @@ boolean RTCHelper::getCompilerDate() {
 /// before!
 /// @return true, if compilation date is newer than rtc date
 boolean RTCHelper::isCompilerDateNewer() {
-  RTC_Date now = rtc.getDateTime();
+  RTC_Date now = readRTC();
   if (compilerDate.year > now.year) {
     return true; // compiler year is the newer!
   } else if (compilerDate.year < now.year) {
@@ -299,11 +247,19 @@ boolean RTCHelper::isCompilerDateNewer() {
   }
 }
 
-/// @brief Create filename
+/// @brief Create filename. The month and the hour of the week change only with the hour, so the
+/// date is only converted at the next full hour.
 /// @return Returns true if filename has changed
 boolean RTCHelper::createFileName() {
-  RTC_Date now = getLocalDate(); // use local time
-  sprintf(fileName, "/%04d-%02d.csv", now.year, now.month);
+  uint32_t base = getBaseEpoch();
+  if (systemTimeValid && base < nextHourEpoch && base + 3600 >= nextHourEpoch) {
+    return false; // still the same hour
+  }
+  nextHourEpoch = base - base % 3600 + 3600;
+  RTC_Date now = toLocalDate(base); // use local time
+  snprintf(fileName, RTC_FILENAMELENGTH, "/%04u/%02u.csv", now.year % 10000u, now.month % 100u);
+  // remember the hour of the week for the schedule, see getLocalWeekHour()
+  localWeekHour = dayOfWeek(now.year, now.month, now.day) * 24 + now.hour;
   if (now.month != oldMonth) {
     oldMonth = now.month;
     return true; // new fileName created
@@ -349,35 +305,189 @@ void RTCHelper::getFileName(char *str) {
   memcpy(str, fileName, sizeof(fileName));
 }
 
+/// @brief get the local hour of the week, which was determined in the last createFileName()
+/// @return 0 = Sunday 0:00 ... 167 = Saturday 23:00, 168 if no time was read yet
+uint8_t RTCHelper::getLocalWeekHour() {
+  return localWeekHour;
+}
+
+/// @brief get the local month, which was determined in the last createFileName()
+/// @return 1..12, 0 if no time was read yet
+uint8_t RTCHelper::getLocalMonth() {
+  return oldMonth;
+}
+
 /// Set RTC from local time (including DST):
-/// local time -> subtract 1h if needed -> base time (CET) into RTC
+/// local time -> subtract the DST if needed -> base time (standard time) into RTC
 void RTCHelper::setFromLocalDate(const RTC_Date &local) {
-  RTC_Date base = local; // copy
+  writeRTC(localToBase(local), false);
+}
+
+/// @brief Set the RTC from a local time, which is known to be right (e.g. entered by the user).
+/// The deviation of the RTC is used to estimate its drift.
+/// @param local local time (including DST)
+void RTCHelper::setFromReference(const RTC_Date &local) {
+  setFromBaseReference(localToBase(local));
+}
+
+/// @brief Set the RTC from an external time source, e.g. the Zigbee time cluster. The deviation of
+/// the RTC is used to estimate its drift.
+/// @param utcEpoch UTC in seconds since 1970
+void RTCHelper::setFromUtcReference(uint32_t utcEpoch) {
+  setFromBaseReference(utcEpoch + tz.stdOffset);
+}
 
-  if (isDST_Europe_CET(base.year, base.month, base.day, base.hour)) {
-    subOneHour(base);
+/// @brief Record the pair of RTC and true time for the drift and set the RTC
+/// @param trueEpoch true base time (standard time) in seconds since 1970
+void RTCHelper::setFromBaseReference(uint32_t trueEpoch) {
+  RTC_Date base = readRTC();
+  if (base.year >= 2000) {
+    drift.addReference(dateToEpoch(base), trueEpoch);
   }
+  writeRTC(trueEpoch, true);
+}
+
+/// @brief print the estimated drift of the RTC
+void RTCHelper::printDrift() {
+  drift.printStatus();
+}
 
-  rtc.setDateTime(base);
+/// @brief forget the estimated drift of the RTC, e.g. after changing the RTC
+void RTCHelper::resetDrift() {
+  drift.reset();
 }
 
-/// Get local time (with DST) from RTC
+/// @brief Convert the local time to the base time
+/// @param local local time (including DST)
+/// @return base time (standard time) in seconds since 1970
+uint32_t RTCHelper::localToBase(const RTC_Date &local) {
+  uint32_t localEpoch = dateToEpoch(local);
+  uint32_t baseEpoch = localEpoch - (tz.dstOffset - tz.stdOffset);
+  if (!isDst(baseEpoch)) {
+    baseEpoch = localEpoch; // standard time
+  }
+  return baseEpoch;
+}
+
+/// @brief Write the base time to the RTC and the system time
+/// @param baseEpoch base time (standard time) in seconds since 1970
+/// @param isReference true if the time is known to be right, see RtcDrift::clockSet()
+void RTCHelper::writeRTC(uint32_t baseEpoch, boolean isReference) {
+  i2cCnt++;
+  rtc.setDateTime(epochToDate(baseEpoch));
+  setSystemTime(baseEpoch);
+  drift.clockSet(baseEpoch, isReference);
+}
+
+/// Get local time (with DST) from the cached clock
 RTC_Date RTCHelper::getLocalDate() {
-  RTC_Date base = rtc.getDateTime(); // base time
-  if (isDST_Europe_CET(base.year, base.month, base.day, base.hour)) {
-    addOneHour(base);
+  return toLocalDate(getBaseEpoch());
+}
+
+/// @brief Convert the base time to the local time (with DST)
+/// @param baseEpoch base time (standard time) in seconds since 1970
+/// @return local time
+RTC_Date RTCHelper::toLocalDate(uint32_t baseEpoch) {
+  if (isDst(baseEpoch)) {
+    baseEpoch += tz.dstOffset - tz.stdOffset;
+  }
+  return epochToDate(baseEpoch);
+}
+
+/// @brief Is daylight saving time in effect?
+/// @param baseEpoch base time (standard time of RTC_TZ) in seconds since 1970
+/// @return true if DST
+boolean RTCHelper::isDst(uint32_t baseEpoch) {
+  if (baseEpoch < yearStartEpoch || baseEpoch >= nextYearEpoch) {
+    updateDstTable(baseEpoch);
+  }
+  if (dstStartEpoch <= dstEndEpoch) {
+    return baseEpoch >= dstStartEpoch && baseEpoch < dstEndEpoch;
   }
-  return base;
+  // southern hemisphere: DST at the start and at the end of the year
+  return baseEpoch >= dstStartEpoch || baseEpoch < dstEndEpoch;
+}
+
+/// @brief Compute the DST transitions of the year of baseEpoch once, so isDst() only compares the
+/// time with them.
+/// @param baseEpoch base time (standard time of RTC_TZ) in seconds since 1970
+void RTCHelper::updateDstTable(uint32_t baseEpoch) {
+  uint16_t year = epochToDate(baseEpoch).year;
+  yearStartEpoch = tzDaysFromCivil(year, 1, 1) * 86400UL;
+  nextYearEpoch = tzDaysFromCivil(year + 1, 1, 1) * 86400UL;
+#if defined(DAYLIGHTSAVING) && (DAYLIGHTSAVING == 1)
+  tzTransitions(tz, year, &dstStartEpoch, &dstEndEpoch);
+#else
+  dstStartEpoch = 0;
+  dstEndEpoch = 0;
+#endif
+}
+
+/// @brief get the base time (standard time) of the cached clock. Before the system time is set, the
+/// RTC is read.
+/// @return seconds since 1970
+uint32_t RTCHelper::getBaseEpoch() {
+  if (!systemTimeValid) {
+    return dateToEpoch(readRTC());
+  }
+  return (uint32_t)time(NULL);
+}
+
+/// @brief Set the ESP system time, which drives the cached clock
+/// @param baseEpoch base time (standard time) in seconds since 1970
+void RTCHelper::setSystemTime(uint32_t baseEpoch) {
+  struct timeval tv = {(time_t)baseEpoch, 0};
+  settimeofday(&tv, NULL);
+  systemTimeValid = true;
+  nextHourEpoch = 0; // the hour may have changed
+}
+
+/// @brief Read the base time from the RTC, one I2C transaction
+/// @return base time (standard time)
+RTC_Date RTCHelper::readRTC() {
+  i2cCnt++;
+  return rtc.getDateTime();
+}
+
+/// @brief Compare the system time with the RTC and correct it, if it has drifted
+void RTCHelper::resync() {
+  RTC_Date base = readRTC();
+  if (base.year < 2000) {
+    return; // not a valid time
+  }
+  uint32_t baseEpoch = drift.correct(dateToEpoch(base));
+  lastResyncDiff = (int32_t)(baseEpoch - getBaseEpoch());
+  if (abs(lastResyncDiff) >= RTC_RESYNC_MIN_S) {
+    setSystemTime(baseEpoch);
+    resyncCnt++;
+  }
+}
+
+/// @brief Print and reset the statistics: I2C transactions with the RTC since the last call and
+/// the corrections of the system time
+void RTCHelper::printStats() {
+  Serial.print("RTC stats: i2c ");
+  Serial.print(i2cCnt);
+  Serial.print(" in ");
+  Serial.print((unsigned long)((timeService.nowMs() - lastStatsTime) / 1000));
+  Serial.print(" s, resyncs ");
+  Serial.print(resyncCnt);
+  Serial.print(", last diff ");
+  Serial.print(lastResyncDiff);
+  Serial.print(" s, drift ");
+  Serial.print(drift.getPpm());
+  Serial.println(" ppm");
+  i2cCnt = 0;
 }
 
 /// Debug output: base time vs. local time
 void RTCHelper::debugPrintTimes() {
-  RTC_Date base = rtc.getDateTime();
-  RTC_Date local = getLocalDate();
-  bool dst = isDST_Europe_CET(base.year, base.month, base.day, base.hour);
+  RTC_Date base = readRTC();
+  RTC_Date local = toLocalDate(dateToEpoch(base));
+  bool dst = isDst(dateToEpoch(base));
 
   Serial.println("==== RTC Debug ====");
-  Serial.print("RAW (Base/CET): ");
+  Serial.print("RAW (Base/Std): ");
   char buf[32];
   snprintf(buf, sizeof(buf), "%02d.%02d.%04d %02d:%02d:%02d", base.day, base.month, base.year,
            base.hour, base.minute, base.second);
@@ -394,12 +504,12 @@ void RTCHelper::debugPrintTimes() {
 }
 
 void RTCHelper::printCurrentLocalShortWithDST() {
-  // Get base time (CET) from RTC
-  RTC_Date base = rtc.getDateTime();
+  // Get base time (standard time) from the cached clock
+  uint32_t baseEpoch = getBaseEpoch();
   // Calculate local time (with DST)
-  RTC_Date local = getLocalDate();
+  RTC_Date local = toLocalDate(baseEpoch);
   // Determine DST flag from base time
-  bool dst = isDST_Europe_CET(base.year, base.month, base.day, base.hour);
+  bool dst = isDst(baseEpoch);
 
   char buf[48];
   snprintf(buf, sizeof(buf), "Current time: %02d.%02d.%04d %02d:%02d (%s)", local.day, local.month,
@@ -2,14 +2,26 @@
 
 #pragma once
 
+// Time zone as POSIX TZ string (see timeZone.h): name and offset of the standard time, name of
+// the daylight saving time and the rules of the change, e.g. "GMT0BST,M3.5.0/1,M10.5.0" for London
+// or "EST5EDT,M3.2.0,M11.1.0" for New York. The RTC keeps the standard time of this zone.
+#define RTC_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
 // Enable or disable daylight saving time handling.
-// Set to 1 to apply CEST/CET adjustments, 0 to disable DST handling.
+// Set to 1 to apply the daylight saving time of RTC_TZ, 0 to disable DST handling.
 #define DAYLIGHTSAVING 1
 
 // how often shall rtc loop be handled
 #define RTCwaitMS 1100
 
-// "/2024-12.csv" + null
+// The time is taken from the ESP system time, which init() sets from the RTC. The RTC is only read
+// every RTC_RESYNC_MS to correct the drift of the system time, if it differs by RTC_RESYNC_MIN_S.
+#define RTC_RESYNC_MS 60 * 60 * 1000
+#define RTC_RESYNC_MIN_S 2
+// how often shall the rtc statistics (I2C transactions) be printed?
+#define RTC_STATS_MS 60 * 60 * 1000
+
+// "/2024/12.csv" + null, one directory per year
 #define RTC_FILENAMELENGTH 13
 
 #define TIMESTAMP_LENGTH 20
@@ -21,11 +33,17 @@
 #define DEBUGRTCHANDLINGINIT
 
 #include "pcf8563.h"
+#include "timeZone.h"
+#include "rtcDrift.h"
 
 /// @brief RTCHelper class to handle the rtc.
 class RTCHelper {
 public:
-  RTCHelper() : oldMonth(0), fileName("/YYYY-MM.csv") {};
+  RTCHelper()
+      : oldMonth(0), fileName("/YYYY/MM.csv"), localWeekHour(7 * 24), systemTimeValid(false),
+        lastResyncTime(0), lastStatsTime(0), nextHourEpoch(0), i2cCnt(0), resyncCnt(0),
+        lastResyncDiff(0), yearStartEpoch(0), nextYearEpoch(0), dstStartEpoch(0),
+        dstEndEpoch(0), tz{} {};
 
   boolean init();
 
@@ -38,10 +56,18 @@ public:
   void createTimeStampDispShort(char *dateDispStr, char *timeDispStr);
   void createTimeStampLogging(char *logTimeStr);
   void getFileName(char *str);
+  uint8_t getLocalWeekHour();
+  uint8_t getLocalMonth();
 
   // lokale Zeit (inkl. Sommerzeit) in die RTC schreiben
   void setFromLocalDate(const RTC_Date &local);
 
+  // Referenzzeit in die RTC schreiben und die Abweichung fuer die Drift merken
+  void setFromReference(const RTC_Date &local);
+  void setFromUtcReference(uint32_t utcEpoch);
+  void printDrift();
+  void resetDrift();
+
   // Debug-Ausgabe von Basiszeit (RTC) + lokaler Zeit
   void debugPrintTimes();
 
@@ -53,10 +79,39 @@ private:
 
   RTC_Date compilerDate; // time of compilation
   boolean isCompilerDateNewer();
-  unsigned long lastRTCTime;         // used for loop()
+  uint64_t lastRTCTime;              // used for loop()
   char fileName[RTC_FILENAMELENGTH]; // file name for the datalogger
   uint8_t oldMonth = 0; // used to remember which month is in filename, see createFileName()
+  uint8_t localWeekHour; // local hour of the week, updated in createFileName()
 
   // lokale Zeit (mit Sommer-/Winterzeit) aus RTC holen
   RTC_Date getLocalDate();
+
+  // cached clock: base time (standard time of RTC_TZ) from the ESP system time
+  uint32_t getBaseEpoch();
+  RTC_Date toLocalDate(uint32_t baseEpoch);
+  void setSystemTime(uint32_t baseEpoch);
+  RTC_Date readRTC();
+  uint32_t localToBase(const RTC_Date &local);
+  void writeRTC(uint32_t baseEpoch, boolean isReference);
+  void setFromBaseReference(uint32_t trueEpoch);
+  void resync();
+  void printStats();
+
+  boolean systemTimeValid;      // system time was set from the RTC
+  uint64_t lastResyncTime;      // last resync()
+  uint64_t lastStatsTime;       // last printStats()
+  uint32_t nextHourEpoch;       // base time of the next full hour, see createFileName()
+  uint32_t i2cCnt;              // I2C transactions with the RTC since the last printStats()
+  uint32_t resyncCnt;           // corrections of the system time since the start
+  int32_t lastResyncDiff;       // RTC - system time at the last resync() in s
+
+  // DST transitions of the actual year as base time, computed again when the year changes
+  boolean isDst(uint32_t baseEpoch);
+  void updateDstTable(uint32_t baseEpoch);
+  uint32_t yearStartEpoch, nextYearEpoch; // the year of the table
+  uint32_t dstStartEpoch, dstEndEpoch;    // daylight saving time from start to end
+  TzInfo tz;                              // parsed RTC_TZ
+
+  RtcDrift drift; // drift of the RTC, corrects the time read from it
 };
\ No newline at end of file
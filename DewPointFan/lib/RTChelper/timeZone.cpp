@@ -0,0 +1,187 @@
+#include <ctype.h>
+#include <stddef.h>
+
+#include "timeZone.h"
+
+/// @brief Skip the name of standard or daylight saving time
+/// @param p name: at least 3 letters or any text quoted in <>
+/// @return char behind the name, NULL if there is no valid name
+static const char *parseName(const char *p) {
+  if (*p == '<') {
+    while (*p != 0 && *p != '>') {
+      p++;
+    }
+    return *p == '>' ? p + 1 : NULL;
+  }
+  const char *start = p;
+  while (isalpha((unsigned char)*p)) {
+    p++;
+  }
+  return p - start >= 3 ? p : NULL;
+}
+
+/// @brief Parse a decimal number
+/// @param p digits
+/// @param value set to the number
+/// @return char behind the number, NULL if there is no digit
+static const char *parseNumber(const char *p, int32_t *value) {
+  if (!isdigit((unsigned char)*p)) {
+    return NULL;
+  }
+  *value = 0;
+  while (isdigit((unsigned char)*p)) {
+    *value = *value * 10 + (*p - '0');
+    p++;
+  }
+  return p;
+}
+
+/// @brief Parse an offset or a time of change
+/// @param p [+|-]hh[:mm[:ss]]
+/// @param seconds set to the time in seconds
+/// @return char behind the time, NULL if it is not valid
+static const char *parseTime(const char *p, int32_t *seconds) {
+  int32_t sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = *p == '-' ? -1 : 1;
+    p++;
+  }
+  int32_t fields[3] = {0, 0, 0}; // hours, minutes, seconds
+  for (uint8_t i = 0; i < 3; i++) {
+    p = parseNumber(p, &fields[i]);
+    if (p == NULL) {
+      return NULL;
+    }
+    if (*p != ':') {
+      break;
+    }
+    p++;
+  }
+  *seconds = sign * (fields[0] * 3600 + fields[1] * 60 + fields[2]);
+  return p;
+}
+
+/// @brief Parse the day and time of a change
+/// @param p Mm.w.d, Jn or n, followed by an optional /time
+/// @param rule set to the parsed rule
+/// @return char behind the rule, NULL if it is not valid
+static const char *parseRule(const char *p, TzRule *rule) {
+  int32_t month = 0, week = 0, day;
+  if (*p == 'M') {
+    rule->type = 'M';
+    p = parseNumber(p + 1, &month);
+    if (p == NULL || *p != '.' || (p = parseNumber(p + 1, &week)) == NULL || *p != '.' ||
+        (p = parseNumber(p + 1, &day)) == NULL) {
+      return NULL;
+    }
+    if (month < 1 || month > 12 || week < 1 || week > 5 || day > 6) {
+      return NULL;
+    }
+  } else if (*p == 'J') {
+    rule->type = 'J';
+    p = parseNumber(p + 1, &day);
+    if (p == NULL || day < 1 || day > 365) {
+      return NULL;
+    }
+  } else {
+    rule->type = 'D';
+    p = parseNumber(p, &day);
+    if (p == NULL || day > 365) {
+      return NULL;
+    }
+  }
+  rule->month = month;
+  rule->week = week;
+  rule->day = day;
+  rule->time = 2 * 3600;
+  if (*p == '/') {
+    p = parseTime(p + 1, &rule->time);
+  }
+  return p;
+}
+
+/// @brief Parse a POSIX TZ string, see timeZone.h
+/// @param tz e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+/// @param info set to the parsed time zone
+/// @return true if tz is valid
+bool tzParse(const char *tz, TzInfo *info) {
+  int32_t offset;
+  const char *p = parseName(tz);
+  if (p == NULL || (p = parseTime(p, &offset)) == NULL) {
+    return false;
+  }
+  info->stdOffset = -offset; // POSIX counts west of UTC positive
+  info->dstOffset = info->stdOffset;
+  info->hasDst = false;
+  if (*p == 0) {
+    return true; // no daylight saving time
+  }
+  if ((p = parseName(p)) == NULL) {
+    return false;
+  }
+  info->dstOffset = info->stdOffset + 3600;
+  if (*p != ',' && *p != 0) {
+    if ((p = parseTime(p, &offset)) == NULL) {
+      return false;
+    }
+    info->dstOffset = -offset;
+  }
+  if (*p != ',' || (p = parseRule(p + 1, &info->start)) == NULL || *p != ',' ||
+      (p = parseRule(p + 1, &info->end)) == NULL || *p != 0) {
+    return false;
+  }
+  info->hasDst = true;
+  return true;
+}
+
+/// @brief days since 1970-01-01
+uint32_t tzDaysFromCivil(uint16_t year, uint8_t month, uint8_t day) {
+  int32_t y = year - (month <= 2);
+  int32_t era = y / 400;
+  uint32_t yoe = y - era * 400;                                            // [0, 399]
+  uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                    // [0, 146096]
+  return era * 146097 + doe - 719468;
+}
+
+/// @brief day of a change in a year
+/// @param rule day of the change
+/// @param year year
+/// @return days since 1970-01-01
+uint32_t tzRuleDay(const TzRule &rule, uint16_t year) {
+  uint32_t jan1 = tzDaysFromCivil(year, 1, 1);
+  if (rule.type == 'J') {
+    bool isLeap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return jan1 + rule.day - 1 + (isLeap && rule.day >= 60 ? 1 : 0);
+  }
+  if (rule.type == 'D') {
+    return jan1 + rule.day;
+  }
+  uint32_t first = tzDaysFromCivil(year, rule.month, 1);
+  uint32_t next = rule.month == 12 ? tzDaysFromCivil(year + 1, 1, 1)
+                                   : tzDaysFromCivil(year, rule.month + 1, 1);
+  uint8_t firstDow = (first + 4) % 7; // 1970-01-01 was a Thursday
+  uint32_t day = first + (rule.day + 7 - firstDow) % 7 + (rule.week - 1) * 7;
+  while (day >= next) {
+    day -= 7; // week 5 is the last week
+  }
+  return day;
+}
+
+/// @brief Start and end of the daylight saving time in a year, counted in the standard time of
+/// the zone. In the southern hemisphere the end is before the start.
+/// @param info time zone
+/// @param year year
+/// @param dstStart set to the start, standard time in seconds since 1970
+/// @param dstEnd set to the end, standard time in seconds since 1970
+void tzTransitions(const TzInfo &info, uint16_t year, uint32_t *dstStart, uint32_t *dstEnd) {
+  if (!info.hasDst) {
+    *dstStart = 0;
+    *dstEnd = 0;
+    return;
+  }
+  // the start is given in standard time, the end in daylight saving time
+  *dstStart = tzRuleDay(info.start, year) * 86400UL + info.start.time;
+  *dstEnd = tzRuleDay(info.end, year) * 86400UL + info.end.time -
+            (info.dstOffset - info.stdOffset);
+}
@@ -0,0 +1,40 @@
+// timeZone.h
+
+#pragma once
+
+// Time zone rules in the POSIX TZ format, e.g. "CET-1CEST,M3.5.0,M10.5.0/3":
+//   std offset [dst [offset] [,start[/time],end[/time]]]
+// - std, dst: names of standard and daylight saving time, 3 or more letters or quoted in <>
+// - offset:   [+|-]hh[:mm[:ss]] to add to the local time to get UTC, so west of UTC is positive.
+//             Without offset, dst is one hour ahead of std.
+// - start, end: day of the change of the time
+//     Mm.w.d  day d (0 = Sunday) of week w (1..5, 5 = last) of month m
+//     Jn      day n of the year (1..365), February 29th is never counted
+//     n       day n of the year (0..365), counting February 29th
+// - time:     local time of the change [+|-]hh[:mm[:ss]], default 02:00:00
+// A DST without rules is not supported.
+// This code does not depend on Arduino, so it can be checked on the host.
+
+#include <stdint.h>
+
+/// @brief day and time of a change between standard and daylight saving time
+typedef struct {
+  char type;     // 'M', 'J' or 'D' (zero based day of the year)
+  uint8_t month; // 1..12 for 'M'
+  uint8_t week;  // 1..5 for 'M'
+  uint16_t day;  // day of the week for 'M', day of the year for 'J' and 'D'
+  int32_t time;  // local time of the change in seconds after midnight
+} TzRule;
+
+/// @brief parsed time zone
+typedef struct {
+  int32_t stdOffset; // standard time - UTC in seconds
+  int32_t dstOffset; // daylight saving time - UTC in seconds
+  bool hasDst;
+  TzRule start, end;
+} TzInfo;
+
+bool tzParse(const char *tz, TzInfo *info);
+uint32_t tzDaysFromCivil(uint16_t year, uint8_t month, uint8_t day);
+uint32_t tzRuleDay(const TzRule &rule, uint16_t year);
+void tzTransitions(const TzInfo &info, uint16_t year, uint32_t *dstStart, uint32_t *dstEnd);
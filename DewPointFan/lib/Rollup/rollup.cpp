@@ -0,0 +1,144 @@
+#include <Arduino.h>
+
+#include "rollup.h"
+#include "timeService.h"
+
+// length of the period key in the timestamp "YYYY-MM-DD hh:mm:ss"
+static const uint8_t keyLength[ROLLUP_PERIODS] = {13, 10};
+
+/// @brief Call it after each new average. The values are added to the running hour and day. When
+/// the hour or the day of the timestamp changes, the period is finished and reported by hasRow().
+/// @param timestamp local time "YYYY-MM-DD hh:mm:ss" of RTCHelper::createTimeStampLogging()
+/// @param inner averaged indoor measurement
+/// @param outer averaged outdoor measurement
+/// @param reason actual rating of the ventilation
+/// @param fanOn true if the fan is running
+void Rollup::update(const char *timestamp, AvgMeasurement inner, AvgMeasurement outer,
+                    VentilationUseFull reason, boolean fanOn) {
+  uint64_t now = timeService.nowMs();
+  // the fan state is known since the last update, this time is added to the running periods
+  uint32_t fanOnMs = (lastFanOn && lastUpdateTime != 0) ? now - lastUpdateTime : 0;
+  lastUpdateTime = now;
+  lastFanOn = fanOn;
+
+  float values[ROLLUP_VALUES] = {inner.temperature, outer.temperature, inner.humidity,
+                                 outer.humidity,    inner.dewPoint,    outer.dewPoint};
+  if (inner.validCnt == 0) {
+    values[0] = values[2] = values[4] = NAN;
+  }
+  if (outer.validCnt == 0) {
+    values[1] = values[3] = values[5] = NAN;
+  }
+
+  for (uint8_t period = 0; period < ROLLUP_PERIODS; period++) {
+    RollupPeriod &p = running[period];
+    if (strncmp(p.key, timestamp, keyLength[period]) != 0) {
+      if (p.key[0] != 0) {
+        // the time until now belongs to the finished period
+        p.fanOnMs += fanOnMs;
+        if (pending[period]) {
+          droppedCnt++;
+        }
+        finished[period] = p;
+        pending[period] = true;
+        fanOnMs = 0;
+#ifdef DEBUGROLLUP
+        Serial.print("Rollup: finished ");
+        Serial.println(p.key);
+#endif
+      }
+      char key[ROLLUP_DATE_LENGTH];
+      memcpy(key, timestamp, keyLength[period]);
+      key[keyLength[period]] = 0;
+      clear(p, key);
+    }
+    add(p, values, reason, fanOnMs);
+  }
+}
+
+/// @brief Start a new period
+/// @param p period
+/// @param key start of the timestamps of the period
+void Rollup::clear(RollupPeriod &p, const char *key) {
+  memset(&p, 0, sizeof(p));
+  strncpy(p.key, key, sizeof(p.key) - 1);
+}
+
+/// @brief Add one sample to a period. Invalid values (nan) are not counted.
+/// @param p period
+/// @param values ROLLUP_VALUES values
+/// @param reason rating of the ventilation
+/// @param fanOnMs time the fan was on
+void Rollup::add(RollupPeriod &p, const float *values, VentilationUseFull reason,
+                 uint32_t fanOnMs) {
+  p.samples++;
+  p.fanOnMs += fanOnMs;
+  if (reason < ROLLUP_REASONS) {
+    p.reasonCnt[reason]++;
+  }
+  for (uint8_t i = 0; i < ROLLUP_VALUES; i++) {
+    if (isnan(values[i])) {
+      continue;
+    }
+    RollupStat &s = p.stat[i];
+    if (s.cnt == 0 || values[i] < s.min) {
+      s.min = values[i];
+    }
+    if (s.cnt == 0 || values[i] > s.max) {
+      s.max = values[i];
+    }
+    s.sum += values[i];
+    s.cnt++;
+  }
+}
+
+/// @brief Is a finished period waiting to be written?
+/// @param period ROLLUP_HOUR or ROLLUP_DAY
+/// @return true if createLogChar() has a line
+boolean Rollup::hasRow(RollupPeriods period) {
+  return pending[period];
+}
+
+/// @brief get the name of the summary file of the finished period
+/// @param period ROLLUP_HOUR or ROLLUP_DAY
+/// @param fn char array length ROLLUP_FILENAMELENGTH
+void Rollup::getFileName(RollupPeriods period, char *fn) {
+  unsigned int year = atoi(finished[period].key);
+  snprintf(fn, ROLLUP_FILENAMELENGTH,
+           period == ROLLUP_HOUR ? ROLLUP_HOURFILENAME : ROLLUP_DAYFILENAME, year);
+}
+
+/// @brief Fill the strings with the finished period, see ROLLUP_CSV_HEADER
+/// @param period ROLLUP_HOUR or ROLLUP_DAY
+/// @param dateStr char array length ROLLUP_DATE_LENGTH, "YYYY-MM-DD hh:00" or "YYYY-MM-DD"
+/// @param rollupLogStr char array length ROLLUP_LOGSTR_LENGTH
+void Rollup::createLogChar(RollupPeriods period, char *dateStr, char *rollupLogStr) {
+  const RollupPeriod &p = finished[period];
+  snprintf(dateStr, ROLLUP_DATE_LENGTH, period == ROLLUP_HOUR ? "%s:00" : "%s", p.key);
+  int len = snprintf(rollupLogStr, ROLLUP_LOGSTR_LENGTH, "%lu", (unsigned long)p.samples);
+  for (uint8_t i = 0; i < ROLLUP_VALUES && len < ROLLUP_LOGSTR_LENGTH; i++) {
+    const RollupStat &s = p.stat[i];
+    float mean = s.cnt > 0 ? s.sum / s.cnt : NAN;
+    len += snprintf(rollupLogStr + len, ROLLUP_LOGSTR_LENGTH - len, ";%.1f;%.1f;%.1f",
+                    s.cnt > 0 ? s.min : NAN, mean, s.cnt > 0 ? s.max : NAN);
+  }
+  if (len < ROLLUP_LOGSTR_LENGTH) {
+    len += snprintf(rollupLogStr + len, ROLLUP_LOGSTR_LENGTH - len, ";%lu",
+                    (unsigned long)(p.fanOnMs / 1000));
+  }
+  for (uint8_t i = 0; i < ROLLUP_REASONS && len < ROLLUP_LOGSTR_LENGTH; i++) {
+    len += snprintf(rollupLogStr + len, ROLLUP_LOGSTR_LENGTH - len, ";%lu",
+                    (unsigned long)p.reasonCnt[i]);
+  }
+}
+
+/// @brief The line of the finished period is on the card
+/// @param period ROLLUP_HOUR or ROLLUP_DAY
+void Rollup::rowWritten(RollupPeriods period) {
+  pending[period] = false;
+}
+
+/// @brief get the number of finished periods, which were lost, as the card was missing
+uint32_t Rollup::getDroppedCount() {
+  return droppedCnt;
+}
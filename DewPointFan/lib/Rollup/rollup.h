@@ -0,0 +1,77 @@
+// rollup.h
+
+#pragma once
+
+// Summary files on the sd card, one per year, with a line per day and a line per hour:
+// "/summary-2025.csv" and "/summary-2025-h.csv". So a whole year can be looked at without reading
+// every record of the monthly data log.
+#define ROLLUP_DAYFILENAME "/summary-%04u.csv"
+#define ROLLUP_HOURFILENAME "/summary-%04u-h.csv"
+#define ROLLUP_FILENAMELENGTH 20
+// "YYYY-MM-DD hh:00" + null
+#define ROLLUP_DATE_LENGTH 17
+#define ROLLUP_LOGSTR_LENGTH 192
+// min, mean and max of T_i T_o H_i H_o DP_i DP_o, the time the fan was on and how often the
+// ventilation was rated as useful or why not (VentilationUseFull)
+#define ROLLUP_CSV_HEADER                                                                          \
+  F("Date;Samples;T_i_min;T_i_mean;T_i_max;T_o_min;T_o_mean;T_o_max;H_i_min;H_i_mean;H_i_max;"     \
+    "H_o_min;H_o_mean;H_o_max;DP_i_min;DP_i_mean;DP_i_max;DP_o_min;DP_o_mean;DP_o_max;Fan_on_s;"   \
+    "Useful;NoData;NoDataIn;NoDataOut;TooColdIn;TooColdOut;InDryEnough;OutNotDryEnough")
+
+// number of summarized values and of VentilationUseFull values
+#define ROLLUP_VALUES 6
+#define ROLLUP_REASONS (OUTSIDENOTDRYENOUGH + 1)
+
+// print debug?
+// define DEBUGROLLUP
+
+#include "processSensorData.h"
+
+enum RollupPeriods { ROLLUP_HOUR, ROLLUP_DAY, ROLLUP_PERIODS };
+
+/// @brief running min, max and sum of one value
+typedef struct {
+  float min;
+  float max;
+  float sum;
+  uint32_t cnt;
+} RollupStat;
+
+/// @brief summary of one hour or day
+typedef struct {
+  char key[ROLLUP_DATE_LENGTH]; // "YYYY-MM-DD hh" or "YYYY-MM-DD"
+  uint32_t samples;
+  RollupStat stat[ROLLUP_VALUES];
+  uint32_t fanOnMs;
+  uint32_t reasonCnt[ROLLUP_REASONS];
+} RollupPeriod;
+
+/// @brief Rollup class to summarize the averages per hour and per day. Only the running period and
+/// the finished period, which is not written yet, are kept, so the memory does not grow. A finished
+/// period is reported by hasRow() until rowWritten() is called. If the next period finishes before,
+/// the older one is lost.
+class Rollup {
+public:
+  void update(const char *timestamp, AvgMeasurement inner, AvgMeasurement outer,
+              VentilationUseFull reason, boolean fanOn);
+
+  boolean hasRow(RollupPeriods period);
+  void getFileName(RollupPeriods period, char *fn);
+  void createLogChar(RollupPeriods period, char *dateStr, char *rollupLogStr);
+  void rowWritten(RollupPeriods period);
+  uint32_t getDroppedCount();
+
+  Rollup()
+      : running{}, finished{}, pending{}, lastUpdateTime(0), lastFanOn(false), droppedCnt(0) {}
+
+private:
+  void clear(RollupPeriod &p, const char *key);
+  void add(RollupPeriod &p, const float *values, VentilationUseFull reason, uint32_t fanOnMs);
+
+  RollupPeriod running[ROLLUP_PERIODS];  // period, which is summarized at the moment
+  RollupPeriod finished[ROLLUP_PERIODS]; // last finished period
+  boolean pending[ROLLUP_PERIODS];       // finished period not written yet
+  uint64_t lastUpdateTime;               // time of the last update()
+  boolean lastFanOn;                     // fan state since the last update()
+  uint32_t droppedCnt;                   // finished periods, which couldn't be written
+};
@@ -0,0 +1,202 @@
+#include <Arduino.h>
+
+#include "flashLog.h"
+#include "logRecord.h"
+
+// layout of a slot:
+//   0 uint32 sequence number, 0: empty
+//   4 uint8 type, len, csvLen, reserved
+//   8 file name
+//  24 data
+// 124 uint32 CRC32 of byte 0..123
+#define SLOT_NAME_POS 8
+#define SLOT_DATA_POS 24
+#define SLOT_CRC_POS (FLASHLOG_SLOT_SIZE - 4)
+
+#if SLOT_DATA_POS + FLASHLOG_DATA_SIZE > SLOT_CRC_POS
+#error "FLASHLOG_DATA_SIZE doesn't fit into a slot"
+#endif
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/// @brief Mount SPIFFS, open the ring file and find the oldest and newest record. The file is
+/// created, if it doesn't exist or has another layout.
+/// @return true if the flash log can be used
+boolean FlashLog::init() {
+  if (!SPIFFS.begin(true)) {
+    Serial.println("FlashLog: SPIFFS not available");
+    return false;
+  }
+  ringFile = SPIFFS.open(FLASHLOG_FILENAME, "r+");
+  uint8_t header[FLASHLOG_HEADER_SIZE];
+  if (!ringFile || ringFile.size() != FLASHLOG_HEADER_SIZE + FLASHLOG_SLOTS * FLASHLOG_SLOT_SIZE ||
+      ringFile.read(header, sizeof(header)) != sizeof(header) ||
+      memcmp(header, FLASHLOG_MAGIC, 4) != 0 || header[4] != FLASHLOG_VERSION) {
+    if (ringFile) {
+      ringFile.close();
+    }
+    ready = createFile();
+    return ready;
+  }
+
+  // find the newest record
+  uint32_t storedTail = get32(header + 8);
+  uint32_t maxSeq = 0;
+  uint32_t minSeq = UINT32_MAX;
+  static uint8_t slot[FLASHLOG_SLOT_SIZE];
+  LogQueueRecord record;
+  for (uint32_t i = 0; i < FLASHLOG_SLOTS; i++) {
+    uint32_t seq;
+    if (ringFile.read(slot, FLASHLOG_SLOT_SIZE) != FLASHLOG_SLOT_SIZE) {
+      break;
+    }
+    if (decodeSlot(slot, &seq, record)) {
+      maxSeq = max(maxSeq, seq);
+      minSeq = min(minSeq, seq);
+    }
+  }
+  headSeq = maxSeq + 1;
+  tailSeq = max(storedTail, minSeq == UINT32_MAX ? headSeq : minSeq);
+  tailSeq = min(tailSeq, headSeq);
+  ready = true;
+  Serial.print("FlashLog: records to replay: ");
+  Serial.println(size());
+  return true;
+}
+
+/// @brief Create the ring file with empty slots
+boolean FlashLog::createFile() {
+  Serial.println("FlashLog: creating " FLASHLOG_FILENAME);
+  ringFile = SPIFFS.open(FLASHLOG_FILENAME, "w+");
+  if (!ringFile) {
+    return false;
+  }
+  headSeq = 1;
+  tailSeq = 1;
+  writeHeader();
+  static uint8_t empty[FLASHLOG_SLOT_SIZE];
+  memset(empty, 0, sizeof(empty));
+  for (uint32_t i = 0; i < FLASHLOG_SLOTS; i++) {
+    if (ringFile.write(empty, FLASHLOG_SLOT_SIZE) != FLASHLOG_SLOT_SIZE) {
+      Serial.println("FlashLog: SPIFFS full");
+      ringFile.close();
+      SPIFFS.remove(FLASHLOG_FILENAME);
+      return false;
+    }
+  }
+  ringFile.flush();
+  return true;
+}
+
+/// @brief Write the file header with the actual tailSeq
+void FlashLog::writeHeader() {
+  uint8_t header[FLASHLOG_HEADER_SIZE];
+  memset(header, 0, sizeof(header));
+  memcpy(header, FLASHLOG_MAGIC, 4);
+  header[4] = FLASHLOG_VERSION;
+  put32(header + 8, tailSeq);
+  ringFile.seek(0);
+  ringFile.write(header, sizeof(header));
+}
+
+/// @brief is the flash log usable?
+boolean FlashLog::isReady() {
+  return ready;
+}
+
+/// @brief Store a record. If all slots are used, the oldest record is overwritten.
+/// @return false if the record couldn't be stored
+boolean FlashLog::push(const LogQueueRecord &record) {
+  if (!ready || record.len > FLASHLOG_DATA_SIZE) {
+    droppedCnt++;
+    return false;
+  }
+  static uint8_t slot[FLASHLOG_SLOT_SIZE];
+  encodeSlot(headSeq, record, slot);
+  ringFile.seek(FLASHLOG_HEADER_SIZE + (headSeq % FLASHLOG_SLOTS) * FLASHLOG_SLOT_SIZE);
+  if (ringFile.write(slot, FLASHLOG_SLOT_SIZE) != FLASHLOG_SLOT_SIZE) {
+    droppedCnt++;
+    return false;
+  }
+  ringFile.flush();
+  headSeq++;
+  if (headSeq - tailSeq > FLASHLOG_SLOTS) {
+    droppedCnt += headSeq - FLASHLOG_SLOTS - tailSeq;
+    tailSeq = headSeq - FLASHLOG_SLOTS;
+  }
+#ifdef DEBUGFLASHLOG
+  Serial.print("FlashLog: stored ");
+  Serial.println(size());
+#endif
+  return true;
+}
+
+/// @brief Read a record without removing it
+/// @param index 0: oldest record
+/// @param record result
+/// @return false if there is no such record or the slot is damaged
+boolean FlashLog::peek(uint32_t index, LogQueueRecord &record) {
+  if (!ready || index >= size()) {
+    return false;
+  }
+  static uint8_t slot[FLASHLOG_SLOT_SIZE];
+  uint32_t seq = tailSeq + index;
+  ringFile.seek(FLASHLOG_HEADER_SIZE + (seq % FLASHLOG_SLOTS) * FLASHLOG_SLOT_SIZE);
+  uint32_t slotSeq;
+  return ringFile.read(slot, FLASHLOG_SLOT_SIZE) == FLASHLOG_SLOT_SIZE &&
+         decodeSlot(slot, &slotSeq, record) && slotSeq == seq;
+}
+
+/// @brief Remove the oldest records, after they were written to the card
+/// @param count number of records
+void FlashLog::consume(uint32_t count) {
+  tailSeq += min(count, size());
+  writeHeader();
+  ringFile.flush();
+}
+
+/// @brief number of records not replayed yet
+uint32_t FlashLog::size() {
+  return headSeq - tailSeq;
+}
+
+/// @brief number of records lost, because the flash log was full or they were too long
+uint32_t FlashLog::getDroppedCount() {
+  return droppedCnt;
+}
+
+void FlashLog::encodeSlot(uint32_t seq, const LogQueueRecord &record, uint8_t *slot) {
+  memset(slot, 0, FLASHLOG_SLOT_SIZE);
+  put32(slot, seq);
+  slot[4] = record.type;
+  slot[5] = record.len;
+  slot[6] = record.csvLen;
+  memcpy(slot + SLOT_NAME_POS, record.fileName, LOGBUFFER_FILENAMELENGTH);
+  memcpy(slot + SLOT_DATA_POS, record.data, record.len);
+  put32(slot + SLOT_CRC_POS, logCrc32(slot, SLOT_CRC_POS));
+}
+
+/// @return false if the slot is empty or damaged
+boolean FlashLog::decodeSlot(const uint8_t *slot, uint32_t *seq, LogQueueRecord &record) {
+  *seq = get32(slot);
+  if (*seq == 0 || slot[5] > FLASHLOG_DATA_SIZE ||
+      get32(slot + SLOT_CRC_POS) != logCrc32(slot, SLOT_CRC_POS)) {
+    return false;
+  }
+  record.type = (LogQueueRecordType)slot[4];
+  record.len = slot[5];
+  record.csvLen = slot[6];
+  memcpy(record.fileName, slot + SLOT_NAME_POS, LOGBUFFER_FILENAMELENGTH);
+  record.fileName[LOGBUFFER_FILENAMELENGTH - 1] = 0;
+  memcpy(record.data, slot + SLOT_DATA_POS, record.len);
+  return true;
+}
@@ -0,0 +1,51 @@
+// flashLog.h
+
+#pragma once
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "logBuffer.h"
+
+// Records of the data log are kept in the internal flash (SPIFFS), while there is no sd card.
+// They are stored in a file of fixed size with FLASHLOG_SLOTS slots, which are used one after
+// another, so the writes are spread over the whole file. If all slots are used, the oldest record
+// is overwritten.
+#define FLASHLOG_FILENAME "/ring.bin"
+#define FLASHLOG_SLOTS 4096 // records, 17 days with one record every 6 minutes
+#define FLASHLOG_SLOT_SIZE 128
+#define FLASHLOG_DATA_SIZE 100 // longest record, which can be stored
+
+// file header: "DPFR", version, 3 reserved bytes, sequence number of the oldest record not replayed
+#define FLASHLOG_MAGIC "DPFR"
+#define FLASHLOG_VERSION 1
+#define FLASHLOG_HEADER_SIZE 12
+
+// print debug?
+// define DEBUGFLASHLOG
+
+/// @brief FlashLog class: ring log of records in the internal flash. Each slot holds a sequence
+/// number and a CRC, so the oldest and the newest record are found again after a restart.
+class FlashLog {
+public:
+  FlashLog() : ready(false), headSeq(1), tailSeq(1), droppedCnt(0) {}
+
+  boolean init();
+  boolean isReady();
+  boolean push(const LogQueueRecord &record);
+  boolean peek(uint32_t index, LogQueueRecord &record);
+  void consume(uint32_t count);
+  uint32_t size();
+  uint32_t getDroppedCount();
+
+private:
+  boolean createFile();
+  void writeHeader();
+  void encodeSlot(uint32_t seq, const LogQueueRecord &record, uint8_t *slot);
+  boolean decodeSlot(const uint8_t *slot, uint32_t *seq, LogQueueRecord &record);
+
+  boolean ready;
+  File ringFile;
+  uint32_t headSeq;    // sequence number of the next record
+  uint32_t tailSeq;    // sequence number of the oldest record, which is not replayed yet
+  uint32_t droppedCnt; // records overwritten or too long
+};
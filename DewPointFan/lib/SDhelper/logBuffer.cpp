@@ -0,0 +1,55 @@
+#include <Arduino.h>
+
+#include "logBuffer.h"
+
+/// @brief Add a record. If the buffer is full, the oldest record is dropped.
+/// @param record data of the record
+/// @param len length, longer records are cut to LOGBUFFER_SLOT_SIZE
+void LogBuffer::push(const char *record, uint8_t len) {
+  if (count == LOGBUFFER_SLOTS) {
+    head = (head + 1) % LOGBUFFER_SLOTS;
+    count--;
+    droppedCnt++;
+  }
+  uint8_t idx = (head + count) % LOGBUFFER_SLOTS;
+  length[idx] = min(len, (uint8_t)LOGBUFFER_SLOT_SIZE);
+  memcpy(data[idx], record, length[idx]);
+  count++;
+}
+
+/// @brief remove all records
+void LogBuffer::clear() {
+  head = 0;
+  count = 0;
+}
+
+/// @brief Copy all records in order into one continuous block, e.g. for one sequential write
+/// @param dest destination
+/// @param destSize size of dest, LOGBUFFER_SLOTS * LOGBUFFER_SLOT_SIZE fits all
+/// @return number of bytes copied
+size_t LogBuffer::copyAll(uint8_t *dest, size_t destSize) {
+  size_t pos = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t idx = (head + i) % LOGBUFFER_SLOTS;
+    if (pos + length[idx] > destSize) {
+      break;
+    }
+    memcpy(dest + pos, data[idx], length[idx]);
+    pos += length[idx];
+  }
+  return pos;
+}
+
+/// @brief get the number of buffered records
+uint8_t LogBuffer::size() {
+  return count;
+}
+
+boolean LogBuffer::isEmpty() {
+  return count == 0;
+}
+
+/// @brief get the number of records dropped since start, because the buffer was full
+uint32_t LogBuffer::getDroppedCount() {
+  return droppedCnt;
+}
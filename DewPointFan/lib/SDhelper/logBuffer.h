@@ -0,0 +1,46 @@
+// logBuffer.h
+
+#pragma once
+
+#include <Arduino.h>
+
+// number of records, which can be buffered in RAM
+#define LOGBUFFER_SLOTS 16
+// maximum length of one record incl. line end, the CSV header fits as well
+#define LOGBUFFER_SLOT_SIZE 160
+
+// "/2024-12.csv" + null
+#define LOGBUFFER_FILENAMELENGTH 13
+
+enum LogQueueRecordType : uint8_t { LOGQUEUE_DATA, LOGQUEUE_HEADER };
+
+/// @brief one record of the data log on its way from loop() to the card
+typedef struct {
+  char fileName[LOGBUFFER_FILENAMELENGTH]; // log file of the record
+  LogQueueRecordType type;
+  uint8_t len;    // length of data
+  uint8_t csvLen; // length of the record in the CSV format, for the statistics
+  char data[LOGBUFFER_SLOT_SIZE];
+} LogQueueRecord;
+
+/// @brief LogBuffer class: a statically allocated ring buffer of records with a fixed maximum
+/// length. If the buffer is full, the oldest record is dropped and counted.
+class LogBuffer {
+public:
+  void push(const char *data, uint8_t len);
+  void clear();
+  size_t copyAll(uint8_t *dest, size_t destSize);
+
+  uint8_t size();
+  boolean isEmpty();
+  uint32_t getDroppedCount();
+
+  LogBuffer() : head(0), count(0), droppedCnt(0) {}
+
+private:
+  uint8_t data[LOGBUFFER_SLOTS][LOGBUFFER_SLOT_SIZE];
+  uint8_t length[LOGBUFFER_SLOTS];
+  uint8_t head;        // index of the oldest record
+  uint8_t count;       // number of records in the buffer
+  uint32_t droppedCnt; // number of records dropped because the buffer was full
+};
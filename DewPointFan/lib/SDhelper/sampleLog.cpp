@@ -0,0 +1,92 @@
+#include <Arduino.h>
+
+#include "sampleLog.h"
+#include "timeService.h"
+
+char SampleLog::batch[SAMPLELOG_BATCH_SIZE];
+
+/// @brief Start recording every sample. A running recording is extended.
+/// @param minutes recording time, limited to SAMPLELOG_MAX_MIN
+void SampleLog::start(uint16_t minutes) {
+  minutes = constrain(minutes, (uint16_t)1, (uint16_t)SAMPLELOG_MAX_MIN);
+  if (!active) {
+    sampleCnt = 0;
+    droppedCnt = 0;
+  }
+  active = true;
+  startTime = timeService.nowMs();
+  durationMs = (unsigned long)minutes * 60 * 1000;
+  Serial.print("Sample log started for ");
+  Serial.print(minutes);
+  Serial.println(" min to " SAMPLELOG_FILENAME);
+}
+
+/// @brief Stop recording and write the remaining samples.
+void SampleLog::stop() {
+  if (!active) {
+    return;
+  }
+  if (!writeBatch()) {
+    droppedCnt += batchSamples;
+    batchLen = 0;
+    batchSamples = 0;
+  }
+  active = false;
+  Serial.print("Sample log stopped, samples: ");
+  Serial.print(sampleCnt);
+  Serial.print(", dropped: ");
+  Serial.println(droppedCnt);
+}
+
+/// @brief is a recording running?
+boolean SampleLog::isActive() {
+  return active;
+}
+
+/// @brief Add one sample of both sensors to the batch. The batch is written, if it is full.
+/// @param dateStr date info
+/// @param tempI temperature inside
+/// @param humI humidity inside
+/// @param tempO temperature outside
+/// @param humO humidity outside
+/// @param controlStr string of ControlFan::createLogChar()
+void SampleLog::addSample(const char *dateStr, float tempI, float humI, float tempO, float humO,
+                          const char *controlStr) {
+  if (!active) {
+    return;
+  }
+  if (batchLen + SAMPLELOG_LINE_LENGTH > SAMPLELOG_BATCH_SIZE && !writeBatch()) {
+    // card not writeable, make room for the new samples
+    droppedCnt += batchSamples;
+    batchLen = 0;
+    batchSamples = 0;
+  }
+  int len = snprintf(batch + batchLen, SAMPLELOG_LINE_LENGTH,
+                     "%s;%lu;%+3.1f;%+3.1f;%+3.1f;%+3.1f;%s\r\n", dateStr, millis(), tempI, humI,
+                     tempO, humO, controlStr);
+  batchLen += min(len, SAMPLELOG_LINE_LENGTH - 1);
+  batchSamples++;
+  sampleCnt++;
+}
+
+/// @brief Call regularly to stop the recording, when its time is over
+void SampleLog::loop() {
+  if (active && timeService.nowMs() - startTime >= durationMs) {
+    stop();
+  }
+}
+
+/// @brief write the batch as one chunk to the card
+/// @return true if written
+boolean SampleLog::writeBatch() {
+  if (batchLen == 0) {
+    return true;
+  }
+  if (!sdHelper.writeChunk(SAMPLELOG_FILENAME, SAMPLELOG_CSV_HEADER, (const uint8_t *)batch,
+                           batchLen)) {
+    return false;
+  }
+  batchLen = 0;
+  batchSamples = 0;
+  return true;
+}
@@ -0,0 +1,50 @@
+// sampleLog.h
+
+#pragma once
+
+#include <Arduino.h>
+#include "sdhelper.h"
+
+// file for the samples, appended by every recording
+#define SAMPLELOG_FILENAME "/samples.csv"
+#define SAMPLELOG_CSV_HEADER                                                                       \
+  F("Date;ms;Temperature T_i;Humidity H_i;Temperature T_o;Humidity H_o;Fan;Mode;On_s;Off_s")
+
+// The samples are collected in RAM and written in chunks of this size. One sample takes ~65 bytes,
+// so with one sample every 2 s a chunk is written every two minutes.
+#define SAMPLELOG_BATCH_SIZE 4096
+// longest line of one sample
+#define SAMPLELOG_LINE_LENGTH 96
+
+// recording time, if none is given, and the longest recording time in minutes
+#define SAMPLELOG_DEFAULT_MIN 60
+#define SAMPLELOG_MAX_MIN (24 * 60)
+
+/// @brief SampleLog class to record every single sample of both sensors with the control state for
+/// debugging. The recording is started at runtime and stops itself after the given time.
+class SampleLog {
+public:
+  SampleLog(SDHelper &sd)
+      : sdHelper(sd), active(false), batchLen(0), batchSamples(0), startTime(0), durationMs(0), sampleCnt(0),
+        droppedCnt(0) {}
+
+  void start(uint16_t minutes);
+  void stop();
+  boolean isActive();
+  void addSample(const char *dateStr, float tempI, float humI, float tempO, float humO,
+                 const char *controlStr);
+  void loop();
+
+private:
+  boolean writeBatch();
+
+  SDHelper &sdHelper;
+  boolean active;
+  static char batch[SAMPLELOG_BATCH_SIZE]; // samples not yet written
+  size_t batchLen;
+  uint16_t batchSamples; // samples in the batch
+  uint64_t startTime;
+  unsigned long durationMs;
+  uint32_t sampleCnt;  // samples of the actual recording
+  uint32_t droppedCnt; // samples lost, because the card couldn't be written
+};
@@ -0,0 +1,344 @@
+#include <Arduino.h>
+#include <SD.h>
+
+#include "logRecord.h"
+#include "sdArchive.h"
+
+/// @brief name of a directory entry without the path
+/// @param name name of File::name(), which has the path in older versions of the SD library
+/// @return name behind the last "/"
+static const char *baseName(const char *name) {
+  const char *slash = strrchr(name, '/');
+  return slash ? slash + 1 : name;
+}
+
+/// @brief are the first cnt chars digits?
+static boolean isDigits(const char *str, uint8_t cnt) {
+  for (uint8_t i = 0; i < cnt; i++) {
+    if (!isdigit((unsigned char)str[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @brief is ext the extension of a log file?
+static boolean isLogExtension(const char *ext) {
+  return strcmp(ext, "csv") == 0 || strcmp(ext, "bin") == 0;
+}
+
+/// @brief year of a year directory
+/// @param name "YYYY"
+/// @return year or -1, if it is not a year directory
+static int yearOfName(const char *name) {
+  if (strlen(name) != 4 || !isDigits(name, 4)) {
+    return -1;
+  }
+  return atoi(name);
+}
+
+/// @brief month of a log file in a year directory
+/// @param name "MM.csv" or the thinned "MM-t.csv"
+/// @param thinned set to true for a thinned file
+/// @return month 1..12 or -1, if it is not a log file
+static int monthOfName(const char *name, boolean *thinned) {
+  size_t len = strlen(name);
+  *thinned = len == 8 && name[2] == '-' && name[3] == 't';
+  if (!isDigits(name, 2) || !(len == 6 || *thinned) || name[len - 4] != '.' ||
+      !isLogExtension(name + len - 3)) {
+    return -1;
+  }
+  int month = atoi(name);
+  return month >= 1 && month <= 12 ? month : -1;
+}
+
+/// @brief is it a log file of the old layout in the root directory?
+/// @param name "YYYY-MM.csv"
+static boolean isOldLayoutName(const char *name) {
+  return strlen(name) == 11 && isDigits(name, 4) && name[4] == '-' && isDigits(name + 5, 2) &&
+         name[7] == '.' && isLogExtension(name + 8);
+}
+
+/// @brief Make sure the year directory of the log file exists. The directory is remembered, so it
+/// is only checked again after a new mount or at the change of the year. Before the first log
+/// file of a mount, the files of the old layout are moved.
+/// @param fn log file "/YYYY/MM.csv"
+/// @return true if the directory exists
+boolean SdArchive::prepareDir(const char *fn) {
+  if (!migrated) {
+    migrated = true;
+    migrate();
+  }
+  if (strlen(fn) < SDARCHIVE_DIRLENGTH || fn[SDARCHIVE_DIRLENGTH - 1] != '/') {
+    return true; // file in the root directory
+  }
+  if (strncmp(fn, dirName, SDARCHIVE_DIRLENGTH - 1) == 0) {
+    return true; // already checked
+  }
+  char dir[SDARCHIVE_DIRLENGTH];
+  memcpy(dir, fn, SDARCHIVE_DIRLENGTH - 1);
+  dir[SDARCHIVE_DIRLENGTH - 1] = 0;
+  if (!SD.exists(dir) && !SD.mkdir(dir)) {
+    Serial.print("SD archive: can't create ");
+    Serial.println(dir);
+    return false;
+  }
+  memcpy(dirName, dir, SDARCHIVE_DIRLENGTH);
+  return true;
+}
+
+/// @brief Forget everything known about the card, called when it is unmounted
+void SdArchive::reset() {
+  dirName[0] = 0;
+  migrated = false;
+  checked = false;
+  lowSpace = false;
+}
+
+/// @brief Is it time to check the free space or to free space?
+/// @return true if service() should be called
+boolean SdArchive::isDue() {
+  return !checked || lowSpace || millis() - lastCheckTime >= SDARCHIVE_CHECK_MS;
+}
+
+/// @brief Check the free space every SDARCHIVE_CHECK_MS. If it is low, one month is deleted or
+/// thinned per call, so the sd card is not blocked for long, until there is enough space again.
+/// @param currentFn log file, which is written at the moment
+void SdArchive::service(const char *currentFn) {
+  if (lowSpace) {
+    if (SDARCHIVE_RETENTION == 0 || !retentionStep(currentFn)) {
+      lowSpace = false; // nothing left to remove, wait for the next check
+      return;
+    }
+    checkSpace();
+  } else if (isDue()) {
+    checkSpace();
+  }
+}
+
+/// @brief Read the size and the used bytes of the card. On a large card, the first call after the
+/// mount can take a while, as the FAT is counted.
+void SdArchive::checkSpace() {
+  lastCheckTime = millis();
+  checked = true;
+  totalBytes = SD.totalBytes();
+  usedBytes = SD.usedBytes();
+  lowSpace = getFreePercent() < SDARCHIVE_MIN_FREE_PERCENT;
+  if (lowSpace) {
+    Serial.print("SD archive: low space, free ");
+    Serial.print(getFreePercent());
+    Serial.println(" %");
+  }
+}
+
+/// @brief free space of the card at the last check
+/// @return 0..100 %
+uint8_t SdArchive::getFreePercent() {
+  if (totalBytes == 0) {
+    return 100; // not checked yet
+  }
+  return (uint8_t)((totalBytes - min(usedBytes, totalBytes)) * 100 / totalBytes);
+}
+
+/// @brief Free space at the oldest month according to SDARCHIVE_RETENTION
+/// @param currentFn log file, which is written at the moment
+/// @return true if a month was deleted or thinned
+boolean SdArchive::retentionStep(const char *currentFn) {
+  char path[SDARCHIVE_PATHLENGTH];
+  if (SDARCHIVE_RETENTION == 2 && findOldest(currentFn, true, path)) {
+    if (!thin(path)) {
+      return false;
+    }
+    thinnedCnt++;
+    return true;
+  }
+  if (!findOldest(currentFn, false, path)) {
+    return false;
+  }
+  removeFile(path);
+  removedCnt++;
+  return true;
+}
+
+/// @brief Find the log file of the oldest month, the year directories are searched in order
+/// @param currentFn log file, which is written at the moment and must not be found
+/// @param unthinnedOnly skip the thinned files
+/// @param path set to the log file, length SDARCHIVE_PATHLENGTH
+/// @return true if a file was found
+boolean SdArchive::findOldest(const char *currentFn, boolean unthinnedOnly, char *path) {
+  int lastYear = -1;
+  while (true) {
+    // the next year directory
+    int year = 10000;
+    File root = SD.open("/");
+    if (!root) {
+      return false;
+    }
+    for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+      int y = yearOfName(baseName(entry.name()));
+      if (entry.isDirectory() && y > lastYear && y < year) {
+        year = y;
+      }
+    }
+    root.close();
+    if (year == 10000) {
+      return false;
+    }
+    // the oldest month in it
+    char dir[SDARCHIVE_DIRLENGTH];
+    snprintf(dir, sizeof(dir), "/%04u", (unsigned)year % 10000); // 4 digits, see yearOfName()
+    File yearDir = SD.open(dir);
+    int month = 13;
+    for (File entry = yearDir.openNextFile(); entry; entry = yearDir.openNextFile()) {
+      const char *name = baseName(entry.name());
+      boolean thinned;
+      int m = monthOfName(name, &thinned);
+      if (m < 0 || m >= month || entry.isDirectory() || (unthinnedOnly && thinned)) {
+        continue;
+      }
+      char candidate[SDARCHIVE_PATHLENGTH];
+      snprintf(candidate, sizeof(candidate), "%s/%.8s", dir, name);
+      if (strcmp(candidate, currentFn) != 0) {
+        month = m;
+        memcpy(path, candidate, SDARCHIVE_PATHLENGTH);
+      }
+    }
+    yearDir.close();
+    if (month < 13) {
+      return true;
+    }
+    lastYear = year;
+  }
+}
+
+/// @brief Replace a log file by a thinned copy, which has only every SDARCHIVE_THIN_KEEP th record
+/// and the header lines. The CSV lines are copied unchanged, so their CRCs stay valid.
+/// @param path log file "/YYYY/MM.csv", which becomes "/YYYY/MM-t.csv"
+/// @return true if successfull
+boolean SdArchive::thin(const char *path) {
+  static char line[SDARCHIVE_LINELENGTH];
+  char to[SDARCHIVE_PATHLENGTH];
+  snprintf(to, sizeof(to), "%.8s-t%s", path, path + 8);
+  File src = SD.open(path, FILE_READ);
+  File dst = SD.open(to, FILE_WRITE);
+  if (!src || !dst) {
+    Serial.print("SD archive: can't thin ");
+    Serial.println(path);
+    return false;
+  }
+  boolean ok = true;
+  uint32_t recordCnt = 0;
+  if (strcmp(path + 9, "bin") == 0) {
+    uint8_t *record = (uint8_t *)line;
+    if (src.read(record, LOGRECORD_FILEHEADER_SIZE) == LOGRECORD_FILEHEADER_SIZE) {
+      ok = dst.write(record, LOGRECORD_FILEHEADER_SIZE) == LOGRECORD_FILEHEADER_SIZE;
+    }
+    while (ok && src.read(record, LOGRECORD_SIZE) == LOGRECORD_SIZE) {
+      if ((record[18] & LOGRECORD_FLAG_HEADER) || recordCnt++ % SDARCHIVE_THIN_KEEP == 0) {
+        ok = dst.write(record, LOGRECORD_SIZE) == LOGRECORD_SIZE;
+      }
+    }
+  } else {
+    while (ok && src.available()) {
+      size_t len = src.readBytesUntil('\n', line, sizeof(line) - 1);
+      if (len == 0 || line[0] == 0) {
+        continue; // empty line or zeros of a preallocated file
+      }
+      if (strncmp(line, "Date", 4) == 0 || recordCnt++ % SDARCHIVE_THIN_KEEP == 0) {
+        line[len++] = '\n';
+        ok = dst.write((uint8_t *)line, len) == len;
+      }
+    }
+  }
+  src.close();
+  dst.close();
+  if (!ok) {
+    Serial.print("SD archive: error thinning ");
+    Serial.println(path);
+    SD.remove(to);
+    return false;
+  }
+  removeFile(path);
+#ifdef DEBUGSDARCHIVE
+  Serial.print("SD archive: thinned ");
+  Serial.println(path);
+#endif
+  return true;
+}
+
+/// @brief Delete a log file and its year directory, if it is empty then
+/// @param path log file "/YYYY/MM.csv"
+void SdArchive::removeFile(const char *path) {
+  SD.remove(path);
+  Serial.print("SD archive: removed ");
+  Serial.println(path);
+  char dir[SDARCHIVE_DIRLENGTH];
+  memcpy(dir, path, SDARCHIVE_DIRLENGTH - 1);
+  dir[SDARCHIVE_DIRLENGTH - 1] = 0;
+  File yearDir = SD.open(dir);
+  if (!yearDir) {
+    return;
+  }
+  File entry = yearDir.openNextFile();
+  boolean empty = !entry;
+  entry.close();
+  yearDir.close();
+  if (empty) {
+    SD.rmdir(dir);
+    if (strcmp(dir, dirName) == 0) {
+      dirName[0] = 0;
+    }
+  }
+}
+
+/// @brief Move the log files of the old layout "/YYYY-MM.csv" to "/YYYY/MM.csv". A file is kept,
+/// if the new one exists already.
+void SdArchive::migrate() {
+  uint16_t keptCnt = 0; // files, which stay in the root directory
+  for (uint16_t i = 0; i < SDARCHIVE_MIGRATE_MAX; i++) {
+    // the directory is read again after every move
+    char from[SDARCHIVE_PATHLENGTH] = "";
+    uint16_t skip = keptCnt;
+    File root = SD.open("/");
+    if (!root) {
+      return;
+    }
+    for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+      const char *name = baseName(entry.name());
+      if (!entry.isDirectory() && isOldLayoutName(name) && skip-- == 0) {
+        snprintf(from, sizeof(from), "/%s", name);
+        break;
+      }
+    }
+    root.close();
+    if (from[0] == 0) {
+      return; // nothing left
+    }
+    char to[SDARCHIVE_PATHLENGTH];
+    snprintf(to, sizeof(to), "/%.4s/%s", from + 1, from + 6);
+    if (!prepareDir(to) || SD.exists(to) || !SD.rename(from, to)) {
+      Serial.print("SD archive: kept ");
+      Serial.println(from);
+      keptCnt++;
+      continue;
+    }
+#ifdef DEBUGSDARCHIVE
+    Serial.print("SD archive: moved ");
+    Serial.print(from);
+    Serial.print(" to ");
+    Serial.println(to);
+#endif
+  }
+}
+
+/// @brief Print the free space and what the retention did since the start
+void SdArchive::printStats() {
+  Serial.print("SD archive: ");
+  Serial.print((uint32_t)(totalBytes / (1024 * 1024)));
+  Serial.print(" MB, free ");
+  Serial.print(getFreePercent());
+  Serial.print(" %, removed ");
+  Serial.print(removedCnt);
+  Serial.print(", thinned ");
+  Serial.println(thinnedCnt);
+}
@@ -0,0 +1,67 @@
+// sdArchive.h
+
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+
+// The data log is kept in one directory per year: "/YYYY/MM.csv" (or "MM.bin"), so the root
+// directory doesn't grow with every month. Log files of the old layout "/YYYY-MM.csv" are moved
+// into it, when the card is mounted.
+//
+// The free space of the card is checked every SDARCHIVE_CHECK_MS. If less than
+// SDARCHIVE_MIN_FREE_PERCENT is free, the retention frees space at the oldest month:
+//   SDARCHIVE_RETENTION 0: nothing is removed
+//   SDARCHIVE_RETENTION 1: the oldest month is deleted
+//   SDARCHIVE_RETENTION 2: the oldest month is thinned to every SDARCHIVE_THIN_KEEP th record
+//                          ("MM-t.csv"). If all months are thinned, the oldest is deleted.
+// The month, which is written at the moment, is never touched.
+#define SDARCHIVE_CHECK_MS 6 * 60 * 60 * 1000
+#define SDARCHIVE_MIN_FREE_PERCENT 10
+#define SDARCHIVE_RETENTION 1
+#define SDARCHIVE_THIN_KEEP 10 // one record per hour with a record every 6 minutes
+
+// "/YYYY" + null
+#define SDARCHIVE_DIRLENGTH 6
+// "/YYYY/MM-t.csv" + null
+#define SDARCHIVE_PATHLENGTH 16
+// longest line of a log file + null
+#define SDARCHIVE_LINELENGTH 192
+// root files of the old layout moved per mount
+#define SDARCHIVE_MIGRATE_MAX 240
+
+// print debug?
+// define DEBUGSDARCHIVE
+
+/// @brief SdArchive class: directory layout, free space monitor and retention of the data log on
+/// the sd card. All functions need the mounted card and are called under the lock of SDHelper.
+class SdArchive {
+public:
+  SdArchive()
+      : dirName(""), migrated(false), lastCheckTime(0), checked(false), lowSpace(false),
+        totalBytes(0), usedBytes(0), removedCnt(0), thinnedCnt(0) {}
+
+  boolean prepareDir(const char *fn);
+  void reset();
+  boolean isDue();
+  void service(const char *currentFn);
+  uint8_t getFreePercent();
+  void printStats();
+
+private:
+  void migrate();
+  void checkSpace();
+  boolean retentionStep(const char *currentFn);
+  boolean findOldest(const char *currentFn, boolean thinnedOnly, char *path);
+  boolean thin(const char *path);
+  void removeFile(const char *path);
+
+  char dirName[SDARCHIVE_DIRLENGTH]; // year directory known to exist on the mounted card
+  boolean migrated;                  // old layout checked since the mount
+
+  unsigned long lastCheckTime; // last check of the free space
+  boolean checked;             // free space checked since the mount
+  boolean lowSpace;            // less than SDARCHIVE_MIN_FREE_PERCENT free at the last check
+  uint64_t totalBytes, usedBytes;
+  uint32_t removedCnt, thinnedCnt; // months deleted and thinned since the start
+};
@@ -3,8 +3,25 @@
 #include <SPI.h>
 #include <SD.h>
 #include "FS.h"
+#include <unistd.h>
 
 #include "sdhelper.h"
+#include "timeService.h"
+
+uint8_t SDHelper::flushBuffer[LOGBUFFER_SLOTS * LOGBUFFER_SLOT_SIZE];
+
+#if SD_WRITER_TASK
+/// @brief Writer task: writes the data log, when woken up by the SDHelper or every
+/// SD_WRITER_POLL_MS
+/// @param param SDHelper
+static void writerTask(void *param) {
+  SDHelper *sdHelper = (SDHelper *)param;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SD_WRITER_POLL_MS));
+    sdHelper->writerService();
+  }
+}
+#endif
 
 /// @brief return wifi credentials if found.
 /// @param ssid pointer to array for ssid
@@ -27,7 +44,11 @@ boolean SDHelper::getWifiCredentials(char *ssid, char *pw) {
 boolean SDHelper::getWifiCredentialsFromSD() {
   boolean returnVal = false;
   File myFile;
-  if (SD.begin(csPin)) {
+  if (!lockSD(SD_LOCK_WAIT_MS)) {
+    return false;
+  }
+  if (mount()) {
+    unsigned long startUs = micros();
     myFile = SD.open(WIFIFILENAME);
     if (myFile) {
       Serial.println("opened wifi file");
@@ -52,15 +73,17 @@ boolean SDHelper::getWifiCredentialsFromSD() {
       }
       // close the file:
       myFile.close();
-      SD.end();
     } else {
       // if the file didn't open, print an error:
       Serial.println("error opening wifi.txt");
       credentialsValid = false;
     }
+    sdBusyUs += micros() - startUs;
+    unmount();
   } else {
     // SD begin failed ... go to no sd?
   }
+  unlockSD();
 
   return returnVal;
 }
@@ -72,6 +95,20 @@ boolean SDHelper::init() {
   Serial.print("Initializing SD card...");
 #endif
   pinMode(csPin, OUTPUT); // Modify the pins here to fit the CS pins of the SD card you are using.
+  if (!started) {
+    started = true;
+#if SD_FLASH_FALLBACK
+    flashLog.init();
+#endif
+#if SD_WRITER_TASK
+    sdMutex = xSemaphoreCreateRecursiveMutex();
+    xTaskCreate(writerTask, "sdWriter", SD_WRITER_STACK, this, SD_WRITER_PRIORITY,
+                &writerTaskHandle);
+#endif
+  }
+#if SD_CD_PIN >= 0
+  pinMode(SD_CD_PIN, INPUT_PULLUP);
+#endif
   if (checkSDPresence())  // checkSDPresence sets sdState to NOSD
   {
     sdState = GETCREDENTIALS;
@@ -83,8 +120,11 @@ boolean SDHelper::init() {
 /// @brief SDhelper function that is called regularly in loop()
 /// @return true if data shall be written to SD card with writeData()
 boolean SDHelper::loop() {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
   boolean writeDataNow = false;
+  if (writeFailed.exchange(false)) {
+    sdState = NOSD; // reported by writeBuffer(), maybe from the writer task
+  }
   switch (sdState) {
   case SDINIT:
 #ifdef DEBUGSDHANDLING
@@ -118,21 +158,27 @@ boolean SDHelper::loop() {
       Serial.println(fileName);
 #endif
       // check lastSDSaveTime for 10 min to save
-      if (now - lastSDSaveTime >= SD_SAVE_INTERVALL_MS) {
+      if (saveRequested || now - lastSDSaveTime >= SD_SAVE_INTERVALL_MS) {
 #ifdef DEBUGSDHANDLING
         Serial.println("save data!");
         // Serial.print("last: "); Serial.println(lastSDSaveTime);
 #endif
         writeDataNow = true;
+        saveRequested = false;
         lastSDSaveTime = now;
       }
 
       lastSDTime = now;
-      sdState = SDREADY;
     }
     break;
 
   case NOSD:
+    // the records are kept in the flash log meanwhile
+    if (saveRequested || now - lastSDSaveTime >= SD_SAVE_INTERVALL_MS) {
+      writeDataNow = true;
+      saveRequested = false;
+      lastSDSaveTime = now;
+    }
     // wait for NOSDwaitMS and go to init again
     if (now - lastSDTime >= NOSDwaitMS) {
 #ifdef DEBUGSDHANDLING
@@ -149,95 +195,895 @@ boolean SDHelper::loop() {
     sdState = SDINIT;
     break;
   }
+
+  // without writer task: write the buffered records, if the oldest is old enough
+  if (writerTaskHandle == NULL) {
+    writerService();
+  }
+
+  if (now - lastStatsTime >= SD_STATS_MS) {
+    printStats();
+    lastStatsTime = now;
+  }
   return writeDataNow;
 } // end loop()
 
-/// @brief resets the save data counter, so the next loop() will save data
+/// @brief request a save, so the next loop() will save data
 void SDHelper::saveDataNow() {
-  lastSDSaveTime = (millis() - SD_SAVE_INTERVALL_MS) - 1;
+  saveRequested = true;
 }
 
-/// @brief set the fileName, which is used by the data logger
-/// @param fn "YYYY-MM.csv"
+/// @brief set the fileName, which is used by the data logger. The following records go to this
+/// file, the records before are written to the old file.
+/// @param fn "/YYYY/MM.csv"
 void SDHelper::setFileName(char *fn) {
   memcpy(fileName, fn, 12);
 }
 
-/// @brief Open fileName and write the header into it
+/// @brief Add the header to fileName. Buffered records are written before.
 /// @return
 boolean SDHelper::writeCSVHeader() {
-  if (SD.begin(csPin)) {
-    File logFile = SD.open(fileName, FILE_APPEND);
-    logFile.println(CSV_HEADER);
-    logFile.close();
-#ifdef DEBUGSDHANDLING
-    Serial.println("Wrote header sd.");
-#endif
-    SD.end();
-    return true;
-  } else {
-    return false;
-  }
+  LogQueueRecord record;
+  createHeaderRecord(record);
+  enqueueRecord(record);
   return true;
 }
 
-/// @brief This functions writes the three strings to the sd card, seperated by ";".
+/// @brief Fill record with the header of the data log
+void SDHelper::createHeaderRecord(LogQueueRecord &record) {
+  record.type = LOGQUEUE_HEADER;
+#if SD_LOG_BINARY
+  logRecordEncodeHeader((uint8_t *)record.data);
+  record.len = LOGRECORD_SIZE;
+#else
+  record.len = snprintf(record.data, sizeof(record.data), "%s\r\n", (const char *)CSV_HEADER);
+#endif
+  record.csvLen = strlen((const char *)CSV_HEADER) + 2;
+}
+
+/// @brief This functions adds the three strings, seperated by ";", as one record to the data log.
+/// The records are written to the card, if SD_FLUSH_RECORDS are collected.
 /// @param dateStr date info
 /// @param tempStr temperature infos
 /// @param controlStr control infors
-/// @return true if written successfull
+/// @return false if the record can't be stored
 boolean SDHelper::writeData(char *dateStr, char *tempStr, char *controlStr) {
+  LogQueueRecord record;
+  record.type = LOGQUEUE_DATA;
+  // the line end (and the CRC) are added by processRecord()
+  int len = snprintf(record.data, sizeof(record.data) - LOGRECORD_CRC_SUFFIX_LENGTH, "%s;%s;%s",
+                     dateStr, tempStr, controlStr);
+  len = min(len, (int)sizeof(record.data) - LOGRECORD_CRC_SUFFIX_LENGTH - 1);
+  record.csvLen = len + 2;
+#if SD_LOG_BINARY
+  if (!logRecordEncode(dateStr, tempStr, controlStr, (uint8_t *)record.data)) {
+    Serial.print("record can't be stored binary: ");
+    Serial.println(record.data);
+    encodeErrCnt++;
+    return false;
+  }
+  len = LOGRECORD_SIZE;
+#endif
+  record.len = len;
+  enqueueRecord(record);
+  return true;
+}
+
+/// @brief Request to write all buffered records to the card. With the writer task, this is done by
+/// the task, otherwise immediately.
+/// @return false if the records couldn't be written immediately
+boolean SDHelper::flush() {
+  flushRequested = true;
+#if SD_WRITER_TASK
+  if (writerTaskHandle != NULL) {
+    xTaskNotifyGive(writerTaskHandle);
+    return true;
+  }
+#endif
+  writerService();
+  return logBuffer.isEmpty();
+}
+
+/// @brief Hand a record over to the writer task or process it immediately
+/// @param record fileName is set here
+void SDHelper::enqueueRecord(LogQueueRecord &record) {
+  memcpy(record.fileName, fileName, SD_FILENAMELENGTH);
+#if SD_WRITER_TASK
+  if (writerTaskHandle != NULL) {
+    logQueue.push(record);
+    if (logQueue.size() + logBuffer.size() >= SD_FLUSH_RECORDS) {
+      xTaskNotifyGive(writerTaskHandle);
+    }
+    return;
+  }
+#endif
+  processRecord(record);
+}
+
+/// @brief Route a record to the card or, while there is no card or the records of the flash log are
+/// not replayed yet, to the flash log. Headers are not kept in the flash log, a new file gets its
+/// header by bufferRecord().
+/// @param record from enqueueRecord()
+void SDHelper::processRecord(LogQueueRecord &record) {
+#if SD_FLASH_FALLBACK
+  if (flashLog.isReady() && (!sdPresent || flashLog.size() > 0)) {
+    if (record.type == LOGQUEUE_DATA) {
+      flashLog.push(record);
+    }
+    return;
+  }
+#endif
+  bufferRecord(record);
+}
+
+/// @brief Put a record into the buffer and write the buffer, if SD_FLUSH_RECORDS are collected. If
+/// the record belongs to another file, the buffered records are written first.
+/// @param record from processRecord() or the flash log
+void SDHelper::bufferRecord(LogQueueRecord &record) {
+  if (strcmp(record.fileName, bufferFileName) != 0) {
+    writeBuffer();
+    trimLogFile();
+    if (monthBytes > 0) {
+      printMonthStats();
+    }
+    monthBytes = 0;
+    monthCsvBytes = 0;
+    monthWriteUs = 0;
+    memcpy(bufferFileName, record.fileName, SD_FILENAMELENGTH);
+    // open the new file now, so a torn record is cut off and the sequence numbers continue
+    if (sdPresent && lockSD(portMAX_DELAY)) {
+      boolean needsHeader = false;
+      if (openLogFile()) {
+        needsHeader = logicalEnd == (SD_LOG_BINARY ? LOGRECORD_FILEHEADER_SIZE : 0) ||
+                      formatChanged;
+      }
+      formatChanged = false;
+      unmount();
+      unlockSD();
+      if (needsHeader && record.type == LOGQUEUE_DATA) {
+        // e.g. records of the flash log for a month without card, or the file was written with
+        // another format (SD_LOG_CRC) before the update
+        LogQueueRecord header;
+        memcpy(header.fileName, bufferFileName, SD_FILENAMELENGTH);
+        createHeaderRecord(header);
+        bufferRecord(header);
+      }
+    }
+  }
+
+  uint8_t len = record.len;
+#if !SD_LOG_BINARY
+  if (record.type == LOGQUEUE_DATA) {
+#if SD_LOG_CRC
+    len = logRecordCsvAddCrc(record.data, sizeof(record.data), len, seq++);
+#else
+    len += snprintf(record.data + len, sizeof(record.data) - len, "\r\n");
+#endif
+  }
+#endif
+  monthCsvBytes += record.csvLen;
+
+  if (logBuffer.isEmpty()) {
+    firstBufferedTime = millis();
+  }
+  logBuffer.push(record.data, len);
 #ifdef DEBUGSDHANDLING
-  Serial.println("writing data!");
+  Serial.print("buffered: ");
+  Serial.println(len);
 #endif
-  if (SD.begin(csPin)) {
-    File logFile = SD.open(fileName, FILE_APPEND);
-    if (logFile) {
-      logFile.print(dateStr);
-      logFile.print(";");
-      logFile.print(tempStr);
-      logFile.print(";");
-      logFile.println(controlStr);
-      logFile.close();
+  if (logBuffer.size() >= SD_FLUSH_RECORDS) {
+    writeBuffer();
+  }
+}
+
+/// @brief Process the queued records and write the buffer, if it was requested or the oldest
+/// record is older than SD_FLUSH_MAX_AGE_MS. Called by the writer task or by loop().
+void SDHelper::writerService() {
+  LogQueueRecord record;
+#if SD_WRITER_TASK
+  while (logQueue.pop(record)) {
+    processRecord(record);
+  }
+#endif
+#if SD_FLASH_FALLBACK
+  replayFlashLog();
+#endif
+  serviceArchive();
+  if (logBuffer.isEmpty()) {
+    flushRequested = false;
+    return;
+  }
+  // 32 bit difference like millis() on the device, so it is right across the roll over
+  if (flushRequested ||
+      (sdPresent && (uint32_t)(millis() - firstBufferedTime) >= SD_FLUSH_MAX_AGE_MS)) {
+    flushRequested = false;
+    writeBuffer();
+  }
+}
+
+/// @brief Check the free space of the card and run the retention, if it is time for it
+void SDHelper::serviceArchive() {
+  if (!sdPresent || !archive.isDue() || !lockSD(portMAX_DELAY)) {
+    return;
+  }
+  if (mount()) {
+    unsigned long startUs = micros();
+    char fn[SD_FILENAMELENGTH];
+    getLogFileName(fn);
+    archive.service(fn);
+    sdBusyUs += micros() - startUs;
+    unmount();
+  }
+  unlockSD();
+}
 
+/// @brief Write at most SD_REPLAY_SLICE records of the flash log to the card, if it is back. They
+/// are removed from the flash log, when they are on the card.
+void SDHelper::replayFlashLog() {
+  if (!sdPresent || flashLog.size() == 0) {
+    return;
+  }
+  // the older records in the buffer first
+  if (!writeBuffer()) {
+    return;
+  }
+  uint32_t count = min(flashLog.size(), (uint32_t)SD_REPLAY_SLICE);
+  LogQueueRecord record;
+  char sliceFileName[SD_FILENAMELENGTH] = "";
+  uint32_t buffered = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!flashLog.peek(i, record)) {
+      continue;
+    }
+    if (sliceFileName[0] == 0) {
+      memcpy(sliceFileName, record.fileName, SD_FILENAMELENGTH);
+    } else if (strcmp(sliceFileName, record.fileName) != 0) {
+      // the next month in the next slice: the buffer must not be written before consume()
+      count = i;
+      break;
+    }
+    bufferRecord(record);
+    buffered++;
+  }
+  if (writeBuffer()) {
+    flashLog.consume(count);
+#ifdef DEBUGSDHANDLING
+    Serial.print("replayed from flash: ");
+    Serial.println(count);
+#endif
+  } else {
+    // still in the flash log: the next try uses the same sequence numbers and opens the file
+    // again, so a new file gets its header
+    logBuffer.clear();
+    seq -= buffered;
+    bufferFileName[0] = 0;
+  }
+}
+
+/// @brief Write all buffered records to the card with one sequential write. If the write fails,
+/// the card is mounted again and the write is repeated once. If it fails again, the records stay
+/// in the buffer.
+/// @return true if the buffer is empty afterwards
+boolean SDHelper::writeBuffer() {
+  if (logBuffer.isEmpty()) {
+    return true;
+  }
+  if (!lockSD(portMAX_DELAY)) {
+    return false;
+  }
 #ifdef DEBUGSDHANDLING
-      Serial.println("wrote:: ");
-      Serial.print(dateStr);
-      Serial.print(";");
-      Serial.print(tempStr);
-      Serial.print(";");
-      Serial.println(controlStr);
+  Serial.print("flushing records: ");
+  Serial.println(logBuffer.size());
 #endif
+  size_t len = logBuffer.copyAll(flushBuffer, sizeof(flushBuffer));
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    if (!openLogFile()) {
+      break;
+    }
+    unsigned long startUs = micros();
+    size_t written = logFile.write(flushBuffer, len);
+    logFile.flush();
+    lastFlushUs = micros() - startUs;
+    maxFlushUs = max(maxFlushUs, lastFlushUs);
+    sdBusyUs += lastFlushUs;
+    monthBytes += written;
+    monthWriteUs += lastFlushUs;
+    if (written == len) {
+      logicalEnd += written;
+      logBuffer.clear();
+      unmount();
+      unlockSD();
       return true;
     }
-  } else {
-    // if the file didn't open, print an error:
+    // I/O error: mount the card again and retry. The part written is cut off before, otherwise
+    // the records would be in the file twice.
+    if (written > 0) {
+      memcpy(tornFileName, openFileName, SD_FILENAMELENGTH);
+      tornEnd = logicalEnd;
+    }
     Serial.println("error writing to file");
-    sdState = NOSD;
-    return false;
+    unmount(true);
   }
   Serial.println("error connecting to sd");
-  sdState = NOSD;
+  sdPresent = false;
+  writeFailed = true;
+  unlockSD();
   return false;
 }
 
-/// @brief Try to open init the sd card and check wether an sd card is present. Sets sdState to NOSD
-/// if not successfull.
+/// @brief Lock the sd card against the access of the other task. Without SD_WRITER_TASK, there is
+/// no other task.
+/// @param waitMs how long to wait for the other task, portMAX_DELAY: no limit
+/// @return true if locked, call unlockSD() afterwards
+boolean SDHelper::lockSD(uint32_t waitMs) {
+#if SD_WRITER_TASK
+  if (sdMutex == NULL) {
+    return true;
+  }
+  TickType_t ticks = waitMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(waitMs);
+  return xSemaphoreTakeRecursive(sdMutex, ticks) == pdTRUE;
+#else
+  return true;
+#endif
+}
+
+/// @brief Unlock the sd card after lockSD()
+void SDHelper::unlockSD() {
+#if SD_WRITER_TASK
+  if (sdMutex != NULL) {
+    xSemaphoreGiveRecursive(sdMutex);
+  }
+#endif
+}
+
+/// @brief get the number of records waiting in RAM to be written
+uint8_t SDHelper::getBufferedCount() {
+  return logBuffer.size() + logQueue.size();
+}
+
+/// @brief get the number of records lost because the buffer or the queue was full
+uint32_t SDHelper::getDroppedCount() {
+  return logBuffer.getDroppedCount() + logQueue.getDroppedCount();
+}
+
+/// @brief Append one line to another file than the data log, e.g. the tuner log. If the file is
+/// new, the header is written first.
+/// @param fn file name starting with "/"
+/// @param header header line for a new file
+/// @param dateStr date info
+/// @param lineStr data of the line
+/// @return true if written successfull
+boolean SDHelper::writeLine(const char *fn, const __FlashStringHelper *header, const char *dateStr,
+                            const char *lineStr) {
+  if (!sdPresent || !lockSD(SD_LOCK_WAIT_MS)) {
+    return false;
+  }
+  if (!mount()) {
+    unlockSD();
+    return false;
+  }
+  unsigned long startUs = micros();
+  boolean isNew = !SD.exists(fn);
+  File file = SD.open(fn, FILE_APPEND);
+  if (!file) {
+    sdBusyUs += micros() - startUs;
+    unmount();
+    unlockSD();
+    return false;
+  }
+  if (isNew) {
+    file.println(header);
+  }
+  file.print(dateStr);
+  file.print(";");
+  file.println(lineStr);
+  file.close();
+  sdBusyUs += micros() - startUs;
+  unmount();
+  unlockSD();
+#ifdef DEBUGSDHANDLING
+  Serial.print("wrote to ");
+  Serial.println(fn);
+#endif
+  return true;
+}
+
+/// @brief Check wether an sd card is present. If the card is mounted persistently, this is only
+/// the card detect pin or one sector read. Otherwise the card is mounted. Sets sdState to NOSD if
+/// not successfull.
 /// @return sdPresent indicates wether the sd card is present
 boolean SDHelper::checkSDPresence() {
-  if (!SD.begin(csPin)) {
+  if (!lockSD(0)) {
+    return sdPresent; // the writer task uses the card right now
+  }
+  if (mounted) {
+    if (probeCard()) {
+      sdPresent = true;
+      unlockSD();
+      return true;
+    }
+    // card removed or dead: mount it again
+    unmount(true);
+  }
+  if (!mount()) {
 #ifdef DEBUGSDHANDLING
     Serial.println("no sd found");
 #endif
+    archive.reset();
     sdPresent = false;
     sdState = NOSD;
+    unlockSD();
     return false;
   }
-  SD.end();
+  unmount();
   sdPresent = true;
+  unlockSD();
   return sdPresent;
 }
 
+/// @brief Mount the sd card, if it is not mounted yet
+/// @return true if mounted
+boolean SDHelper::mount() {
+  if (mounted) {
+    return true;
+  }
+#if SD_CD_PIN >= 0
+  if (digitalRead(SD_CD_PIN) != SD_CD_INSERTED) {
+    return false; // no need to try
+  }
+#endif
+  unsigned long startUs = micros();
+  mounted = SD.begin(csPin);
+  mountCnt++;
+  sdBusyUs += micros() - startUs;
+  return mounted;
+}
+
+/// @brief Unmount the sd card and close the log file. With SD_PERSISTENT_MOUNT, the card stays
+/// mounted, unless force is set, e.g. after an I/O error.
+/// @param force unmount also with SD_PERSISTENT_MOUNT
+void SDHelper::unmount(boolean force) {
+  if (SD_PERSISTENT_MOUNT == 1 && !force) {
+    return;
+  }
+  if (mounted) {
+    unsigned long startUs = micros();
+    if (logFile) {
+      logFile.close();
+    }
+    openFileName[0] = 0;
+    if (force) {
+      archive.reset(); // maybe another card, when it is mounted again
+    }
+    SD.end();
+    mounted = false;
+    sdBusyUs += micros() - startUs;
+  }
+}
+
+/// @brief Cheap check of a mounted card: the card detect pin or a read of the first sector
+/// @return true if the card is still there
+boolean SDHelper::probeCard() {
+#if SD_CD_PIN >= 0
+  return digitalRead(SD_CD_PIN) == SD_CD_INSERTED;
+#else
+  static uint8_t sector[512];
+  unsigned long startUs = micros();
+  boolean ok = SD.readRAW(sector, 0);
+  sdBusyUs += micros() - startUs;
+  return ok;
+#endif
+}
+
+/// @brief Append a block of data to another file than the data log with one write, e.g. the
+/// sample log. If the file is new, the header is written first.
+/// @param fn file name starting with "/"
+/// @param header header line for a new file
+/// @param data data to append
+/// @param len length of data
+/// @return true if written successfull
+boolean SDHelper::writeChunk(const char *fn, const __FlashStringHelper *header,
+                             const uint8_t *data, size_t len) {
+  if (!sdPresent || !lockSD(SD_LOCK_WAIT_MS)) {
+    return false;
+  }
+  if (!mount()) {
+    unlockSD();
+    return false;
+  }
+  unsigned long startUs = micros();
+  boolean isNew = !SD.exists(fn);
+  File file = SD.open(fn, FILE_APPEND);
+  if (!file) {
+    sdBusyUs += micros() - startUs;
+    unmount();
+    unlockSD();
+    return false;
+  }
+  if (isNew) {
+    file.println(header);
+  }
+  size_t written = file.write(data, len);
+  file.close();
+  sdBusyUs += micros() - startUs;
+  unmount();
+  unlockSD();
+#ifdef DEBUGSDHANDLING
+  Serial.print("wrote chunk to ");
+  Serial.print(fn);
+  Serial.print(": ");
+  Serial.println(written);
+#endif
+  return written == len;
+}
+
+/// @brief Mount the card and open bufferFileName for appending, if it is not open yet
+/// @return true if logFile is ready to write
+boolean SDHelper::openLogFile() {
+  if (!mount()) {
+    return false;
+  }
+  char fn[SD_FILENAMELENGTH];
+  getLogFileName(fn);
+  if (logFile && strcmp(openFileName, fn) == 0) {
+    return true; // already open
+  }
+  unsigned long startUs = micros();
+  if (logFile) {
+    logFile.close();
+  }
+  if (!archive.prepareDir(fn)) {
+    sdBusyUs += micros() - startUs;
+    openFileName[0] = 0;
+    return false;
+  }
+  if (strcmp(recoveredFileName, fn) != 0) {
+    recoverLogFile(fn);
+  } else if (strcmp(tornFileName, fn) == 0) {
+    // the buffer is written again
+    if (!cutLogFile(fn, tornEnd)) {
+      sdBusyUs += micros() - startUs;
+      openFileName[0] = 0;
+      return false;
+    }
+    tornFileName[0] = 0;
+  }
+#if SD_PREALLOCATE
+  // write into the preallocated zeros, not behind them
+  logFile = SD.open(fn, SD.exists(fn) ? "r+" : "w+");
+#else
+  logFile = SD.open(fn, FILE_APPEND);
+#endif
+  if (!logFile) {
+    sdBusyUs += micros() - startUs;
+    openFileName[0] = 0;
+    return false;
+  }
+#if SD_PREALLOCATE
+  if (logFile.size() == 0) {
+    trimOldLogFiles(fn);
+    preallocate();
+  }
+  logicalEnd = findLogicalEnd(logFile);
+  logFile.seek(logicalEnd);
+#else
+  logicalEnd = logFile.size();
+#endif
+#if SD_LOG_BINARY
+  if (logicalEnd == 0) {
+    // a new file starts with the file header
+    uint8_t fileHeader[LOGRECORD_FILEHEADER_SIZE];
+    logRecordFileHeader(fileHeader);
+    logicalEnd += logFile.write(fileHeader, LOGRECORD_FILEHEADER_SIZE);
+    monthBytes += logicalEnd;
+  }
+#endif
+  sdBusyUs += micros() - startUs;
+  memcpy(openFileName, fn, SD_FILENAMELENGTH);
+  return true;
+}
+
+/// @brief Print and reset the statistics: how often was the card mounted and how much time was
+/// spent in sd access since the last call
+void SDHelper::printStats() {
+  Serial.print("SD stats: mounts ");
+  Serial.print(mountCnt);
+  Serial.print(", busy ");
+  Serial.print(sdBusyUs / 1000);
+  Serial.print(" ms in ");
+  Serial.print((unsigned long)((timeService.nowMs() - lastStatsTime) / 1000));
+  Serial.print(" s, buffered ");
+  Serial.print(logBuffer.size());
+  Serial.print(", dropped ");
+  Serial.print(logBuffer.getDroppedCount());
+  Serial.print(", flush last/max ");
+  Serial.print(lastFlushUs);
+  Serial.print("/");
+  Serial.print(maxFlushUs);
+  Serial.print(" us, queue max ");
+  Serial.print(logQueue.getHighWaterMark());
+  Serial.print(", dropped ");
+  Serial.print(logQueue.getDroppedCount());
+  Serial.print(", flash log ");
+  Serial.print(flashLog.size());
+  Serial.print(", dropped ");
+  Serial.println(flashLog.getDroppedCount());
+  printMonthStats();
+  archive.printStats();
+  mountCnt = 0;
+  sdBusyUs = 0;
+  maxFlushUs = 0;
+  logQueue.resetHighWaterMark();
+}
+
+/// @brief Check the end of the log file before appending to it. A record torn by a power loss
+/// during the last write is cut off. The sequence numbers continue after the last valid line.
+/// @param fn log file name, the sd card must be mounted
+void SDHelper::recoverLogFile(const char *fn) {
+  memcpy(recoveredFileName, fn, SD_FILENAMELENGTH);
+  File file = SD.open(fn, FILE_READ);
+  if (!file) {
+    return; // new file
+  }
+#if SD_PREALLOCATE
+  size_t size = findLogicalEnd(file);
+#else
+  size_t size = file.size();
+#endif
+  size_t validSize = size;
+#if SD_LOG_BINARY
+  // only complete records after the file header are valid
+  if (size < LOGRECORD_FILEHEADER_SIZE) {
+    validSize = 0;
+  } else {
+    validSize -= (size - LOGRECORD_FILEHEADER_SIZE) % LOGRECORD_SIZE;
+  }
+#else
+  static char tail[SD_RECOVERY_TAIL];
+  size_t tailLen = min(size, (size_t)SD_RECOVERY_TAIL);
+  file.seek(size - tailLen);
+  tailLen = file.read((uint8_t *)tail, tailLen);
+  uint32_t lastSeq = UINT32_MAX;
+  size_t validEnd = logRecordCsvValidEnd(tail, tailLen, tailLen == size, &lastSeq);
+  validSize = size - tailLen + validEnd;
+  seq = lastSeq + 1; // 0 if no sequence number was found
+  formatChanged = !isActualFormat(tail, validEnd);
+#endif
+  file.close();
+  if (validSize == size) {
+    return;
+  }
+
+  // cut off the torn record, the caller holds sdMutex
+  memcpy(cutFileName, fn, SD_FILENAMELENGTH);
+  recoveryCutBytes = size - validSize;
+  recoveryPending = true;
+  Serial.print("SD recovery: cut ");
+  Serial.print(recoveryCutBytes);
+  Serial.print(" bytes from ");
+  Serial.print(fn);
+  if (!cutLogFile(fn, validSize)) {
+    Serial.print(" failed");
+  }
+  Serial.println();
+}
+
+/// @brief Cut the log file back to validSize, e.g. a torn record. With SD_PREALLOCATE, the data
+/// behind validSize is filled with zeros again, so the logical end is validSize.
+/// @param fn log file name, the sd card must be mounted and the file closed
+/// @return true if successfull
+boolean SDHelper::cutLogFile(const char *fn, size_t validSize) {
+#if SD_PREALLOCATE
+  static const uint8_t zeros[64] = {0};
+  File file = SD.open(fn, "r+");
+  if (!file) {
+    return false;
+  }
+  size_t size = findLogicalEnd(file);
+  file.seek(validSize);
+  for (size_t pos = validSize; pos < size; pos += sizeof(zeros)) {
+    file.write(zeros, min(sizeof(zeros), size - pos));
+  }
+  file.close();
+  return true;
+#else
+  char path[sizeof(SD_MOUNTPOINT) + SD_FILENAMELENGTH];
+  snprintf(path, sizeof(path), SD_MOUNTPOINT "%s", fn);
+  return truncate(path, validSize) == 0;
+#endif
+}
+
+/// @brief Is the last line of the log file written in the actual format? A header must be the
+/// actual CSV_HEADER, a data line must have the sequence number and the CRC, if SD_LOG_CRC is set.
+/// Otherwise the following lines need a new header, e.g. after an update with another SD_LOG_CRC.
+/// @param tail last bytes of the log file
+/// @param end end of the last valid line in tail
+/// @return true if the next lines fit to the last one, also if there is no line
+boolean SDHelper::isActualFormat(const char *tail, size_t end) {
+  while (end > 0 && (tail[end - 1] == '\n' || tail[end - 1] == '\r')) {
+    end--;
+  }
+  size_t start = end;
+  while (start > 0 && tail[start - 1] != '\n') {
+    start--;
+  }
+  if (start == end) {
+    return true; // no line
+  }
+  if (strncmp(tail + start, "Date", 4) == 0) {
+    const char *header = (const char *)CSV_HEADER;
+    return end - start == strlen(header) && strncmp(tail + start, header, end - start) == 0;
+  }
+  uint8_t separators = 0;
+  for (size_t i = start; i < end; i++) {
+    separators += tail[i] == ';';
+  }
+  return separators == (SD_LOG_CRC ? 14 : 12);
+}
+
+/// @brief Find the end of the data in a preallocated file: the data is followed by zeros only. The
+/// first block with only zeros is searched binary.
+/// @param file open log file
+/// @return logical end of the file
+size_t SDHelper::findLogicalEnd(File &file) {
+  static uint8_t block[512];
+  size_t size = file.size();
+  size_t lo = 0;                                          // blocks before lo contain data
+  size_t hi = (size + sizeof(block) - 1) / sizeof(block); // blocks from hi contain only zeros
+  size_t len = 0;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    file.seek(mid * sizeof(block));
+    len = file.read(block, sizeof(block));
+    boolean zeros = true;
+    for (size_t i = 0; i < len && zeros; i++) {
+      zeros = block[i] == 0;
+    }
+    if (zeros) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  if (lo == 0) {
+    return 0;
+  }
+  // last byte of data in the last block with data
+  file.seek((lo - 1) * sizeof(block));
+  len = file.read(block, sizeof(block));
+  while (len > 0 && block[len - 1] == 0) {
+    len--;
+  }
+  return (lo - 1) * sizeof(block) + len;
+}
+
+/// @brief Fill the new, empty logFile with SD_PREALLOC_BYTES zeros. The clusters are allocated
+/// once and not by every write.
+/// @return true if successfull
+boolean SDHelper::preallocate() {
+  unsigned long startMs = millis();
+  memset(flushBuffer, 0, sizeof(flushBuffer));
+  size_t pos = 0;
+  while (pos < SD_PREALLOC_BYTES) {
+    size_t written = logFile.write(flushBuffer, min(sizeof(flushBuffer), SD_PREALLOC_BYTES - pos));
+    if (written == 0) {
+      break;
+    }
+    pos += written;
+  }
+  logFile.flush();
+  logFile.seek(0);
+  Serial.print("SD preallocated ");
+  Serial.print(pos);
+  Serial.print(" bytes in ");
+  Serial.print(millis() - startMs);
+  Serial.println(" ms");
+  return pos == SD_PREALLOC_BYTES;
+}
+
+/// @brief Cut the open preallocated log file to its logical end, e.g. at the end of the month
+void SDHelper::trimLogFile() {
+#if SD_PREALLOCATE
+  if (!logFile || !lockSD(portMAX_DELAY)) {
+    return;
+  }
+  logFile.close();
+  char path[sizeof(SD_MOUNTPOINT) + SD_FILENAMELENGTH];
+  snprintf(path, sizeof(path), SD_MOUNTPOINT "%s", openFileName);
+  openFileName[0] = 0;
+  if (truncate(path, logicalEnd) != 0) {
+    Serial.print("SD trim failed: ");
+    Serial.println(path);
+  }
+  unmount();
+  unlockSD();
+#endif
+}
+
+/// @brief Cut the earlier log files in the year directory of a new log file and of the year before,
+/// which still end in zeros. trimLogFile() only cuts the file open at the change of the month, not
+/// the file of a month, which ended while the device was off or without card.
+/// @param fn new log file, the sd card must be mounted
+void SDHelper::trimOldLogFiles(const char *fn) {
+#if SD_PREALLOCATE
+  int year = atoi(fn + 1);
+  for (int y = year; y >= year - 1; y--) {
+    char dir[SDARCHIVE_DIRLENGTH];
+    snprintf(dir, sizeof(dir), "/%04u", (unsigned)y % 10000);
+    File yearDir = SD.open(dir);
+    if (!yearDir || !yearDir.isDirectory()) {
+      continue;
+    }
+    for (File entry = yearDir.openNextFile(); entry; entry = yearDir.openNextFile()) {
+      size_t size = entry.size();
+      if (entry.isDirectory() || size == 0 || strcmp(entry.path(), fn) == 0) {
+        continue;
+      }
+      entry.seek(size - 1);
+      if (entry.read() != 0) {
+        continue; // trimmed or never preallocated
+      }
+      size_t end = findLogicalEnd(entry);
+      char path[sizeof(SD_MOUNTPOINT) + SDARCHIVE_PATHLENGTH];
+      snprintf(path, sizeof(path), SD_MOUNTPOINT "%s", entry.path());
+      entry.close();
+      Serial.print("SD trim ");
+      Serial.print(path);
+      Serial.print(" to ");
+      Serial.print(end);
+      Serial.println(truncate(path, end) == 0 ? " bytes" : " bytes failed");
+    }
+    yearDir.close();
+  }
+#endif
+}
+
+/// @brief Reports once, if the recovery cut off a torn record, which should be logged with
+/// createRecoveryLogChar()
+boolean SDHelper::hasRecoveryEvent() {
+  return recoveryPending.exchange(false);
+}
+
+/// @brief Fill the string with the infos of the last recovery for EVENTFILENAME
+/// @param eventLogStr char array length EVENTLOGSTR_LENGTH
+void SDHelper::createRecoveryLogChar(char *eventLogStr) {
+  // the writer task may recover the next file meanwhile
+  boolean locked = lockSD(SD_LOCK_WAIT_MS);
+  snprintf(eventLogStr, EVENTLOGSTR_LENGTH, "recovery;%s;%lu", locked ? cutFileName : "?",
+           (unsigned long)(locked ? recoveryCutBytes : 0));
+  if (locked) {
+    unlockSD();
+  }
+}
+
+/// @brief get the name of the log file, "/YYYY/MM.bin" with SD_LOG_BINARY
+/// @param fn char array length SD_FILENAMELENGTH
+void SDHelper::getLogFileName(char *fn) {
+  memcpy(fn, bufferFileName, SD_FILENAMELENGTH);
+#if SD_LOG_BINARY
+  memcpy(fn + 9, "bin", 3);
+#endif
+}
+
+/// @brief print the bytes written to the actual log file, compared to the CSV format, and the
+/// time needed to write them.
+void SDHelper::printMonthStats() {
+  Serial.print("SD log ");
+  Serial.print(bufferFileName);
+  Serial.print(": ");
+  Serial.print(monthBytes);
+  Serial.print(" bytes (csv ");
+  Serial.print(monthCsvBytes);
+  Serial.print(" bytes), write time ");
+  Serial.print(monthWriteUs / 1000);
+  Serial.print(" ms");
+#if SD_LOG_BINARY
+  Serial.print(", not encodable ");
+  Serial.print(encodeErrCnt);
+#endif
+  Serial.println();
+}
+
 /// @brief is SD present?
 /// @return true if sd is present
 boolean SDHelper::isSDinserted() {
@@ -1,10 +1,22 @@
+#pragma once
+
+#include <SD.h>
+#include <atomic>
+#include "logBuffer.h"
+#include "flashLog.h"
+#include "sdArchive.h"
+#include "logRecord.h"
+#include "spscQueue.h"
 
 // name of the file to store wifi credentials
 // The path to read and write files needs to start with "/"
 #define WIFIFILENAME "/wifi.txt"
 
 #define SD_FILENAMELENGTH 13
-#define DEFAULTFILENAME "/2010-01.csv"
+#if LOGBUFFER_FILENAMELENGTH != SD_FILENAMELENGTH
+#error "Filenamelength in SD and LogBuffer don't match"
+#endif
+#define DEFAULTFILENAME "/2010/01.csv"
 
 // length of wifi credentials
 #define WIFICREDENTIALLENGTH 33
@@ -14,6 +26,67 @@
 // how often shall be looked if a sd card is inserted?
 #define NOSDwaitMS 5000
 
+// Keep the sd card mounted and the log file open? 0: mount and unmount the card for every access.
+#define SD_PERSISTENT_MOUNT 1
+// card detect pin of the sd slot, -1 if there is none. Without card detect pin, the presence is
+// checked by reading one sector, which is much cheaper than mounting the card.
+#define SD_CD_PIN -1
+// level of the card detect pin, if a card is inserted
+#define SD_CD_INSERTED LOW
+
+// Records are collected in RAM and written together. Flush, if this many records are buffered
+#define SD_FLUSH_RECORDS 10
+// or if the oldest buffered record is older than this
+#define SD_FLUSH_MAX_AGE_MS 60 * 60 * 1000
+
+// Write the data log in the binary format of logRecord.h to "/YYYY/MM.bin" instead of the CSV
+// file? The files are converted to CSV with the LogConverter.
+#define SD_LOG_BINARY 0
+
+// Add a sequence number and a CRC32 to every CSV line? Then a line torn by a power loss is found
+// and cut off by the recovery, which checks the end of the log file, when it is opened first. If
+// the file was written in the other format before, e.g. before an update, a new header is added
+// before the next line, so the columns always match the header above them.
+#define SD_LOG_CRC 1
+// number of bytes at the end of the log file, which are checked by the recovery
+#define SD_RECOVERY_TAIL 512
+// mount point of the sd card in the VFS, needed to truncate files
+#define SD_MOUNTPOINT "/sd"
+// file for events like a recovery
+#define EVENTFILENAME "/events.csv"
+#define EVENT_CSV_HEADER F("Date;Event;File;Bytes")
+#define EVENTLOGSTR_LENGTH 48
+
+// Write the data log in an own task? Then loop() only puts the records into a queue and never
+// waits for the card. Other sd accesses from loop() wait at most SD_LOCK_WAIT_MS for the task.
+#define SD_WRITER_TASK 1
+#define SD_QUEUE_SIZE 16 // records, if the queue is full, the oldest are dropped
+#define SD_WRITER_STACK 4096
+#define SD_WRITER_PRIORITY 1
+#define SD_WRITER_POLL_MS 1000 // the task checks the queue at least this often
+#define SD_LOCK_WAIT_MS 200
+
+// Keep the records in the internal flash, while there is no sd card (see flashLog.h)? When the card
+// is back, at most SD_REPLAY_SLICE records of one log file are written to the card with one write
+// per call of writerService().
+#define SD_FLASH_FALLBACK 1
+#define SD_REPLAY_SLICE 8
+
+// Preallocate the log file of a month, when it is created? The records are written into the zeros
+// and the file is cut to its logical end at the change of the month, or when the file of the next
+// month is created, if the device was off at the change. So the clusters are not allocated by
+// every write. Compare the flush times of the sd statistics with and without.
+// Not possible with SD_LOG_BINARY, as the logical end is found by the first zeros.
+// Can be set with -D, e.g. by the host test preallocTest, which measures both.
+#ifndef SD_PREALLOCATE
+#define SD_PREALLOCATE 0
+#endif
+// expected size of a month: records of 31 days and 110 bytes per record
+#define SD_PREALLOC_BYTES (31UL * 24 * 3600 * 1000 / (SD_SAVE_INTERVALL_MS) * 110)
+
+// how often shall the sd statistics (mounts and time spent in sd access) be printed?
+#define SD_STATS_MS 60 * 60 * 1000
+
 // how often shall data be saved?
 #define SD_SAVE_INTERVALL_MS 6 * 60 * 1000
 
@@ -21,15 +94,26 @@
 #error "Data is saved to often to SD card"
 #endif
 
-#define CSV_HEADER                                                                                 \
-  F("Date;Temperature T_i;Temperature T_o;Humidity H_i;Humidity H_o;Dew point DP_i;Dew point "     \
-    "DP_o;validCnt_i;validCnt_o;Fan;Mode;On_s;Off_s")
+#if SD_PREALLOCATE && SD_LOG_BINARY
+#error "SD_PREALLOCATE can't be used with SD_LOG_BINARY"
+#endif
+
+#if SD_REPLAY_SLICE + 1 >= SD_FLUSH_RECORDS
+#error "A slice of the flash log and a header must fit into one write of the buffer"
+#endif
+
+#if SD_LOG_CRC && !SD_LOG_BINARY
+#define CSV_HEADER F(LOGRECORD_CSV_HEADER LOGRECORD_CSV_HEADER_CRC)
+#else
+#define CSV_HEADER F(LOGRECORD_CSV_HEADER)
+#endif
 
 // print debug?
 // define DEBUGSDHANDLING
 
 enum SDHelperStates { SDINIT, GETCREDENTIALS, SDREADY, NOSD };
 
+
 /// @brief SDHelper class to handle the sd card. Write sensor data to it and read wifi credentials.
 class SDHelper {
 public:
@@ -40,25 +124,109 @@ public:
   boolean loop();
 
   SDHelper(uint8_t sdCSpin)
-      : csPin(sdCSpin), sdPresent(false), sdState(SDINIT), credentialsValid(false),
-        fileName(DEFAULTFILENAME) {}
+      : csPin(sdCSpin), sdPresent(false), sdState(SDINIT), lastSDTime(0), lastSDSaveTime(0),
+        saveRequested(false), credentialsValid(false),
+        fileName(DEFAULTFILENAME), mounted(false), openFileName(""), logicalEnd(0),
+        tornFileName(""), tornEnd(0), mountCnt(0),
+        sdBusyUs(0), lastStatsTime(0), firstBufferedTime(0), lastFlushUs(0), maxFlushUs(0),
+        bufferFileName(""), flushRequested(false), sdMutex(NULL), writerTaskHandle(NULL),
+        started(false), monthBytes(0), monthCsvBytes(0), monthWriteUs(0), encodeErrCnt(0), seq(0),
+        recoveredFileName(""), cutFileName(""), recoveryCutBytes(0), recoveryPending(false),
+        formatChanged(false), writeFailed(false) {}
   void saveDataNow();
   void setFileName(char fn[SD_FILENAMELENGTH]);
   boolean writeCSVHeader();
   boolean writeData(char *dateStr, char *tempStr, char *controlStr);
+  boolean flush();
+  uint8_t getBufferedCount();
+  uint32_t getDroppedCount();
+  void writerService();
+  boolean writeLine(const char *fn, const __FlashStringHelper *header, const char *dateStr,
+                    const char *lineStr);
+  boolean writeChunk(const char *fn, const __FlashStringHelper *header, const uint8_t *data,
+                     size_t len);
   boolean isSDinserted();
+  boolean hasRecoveryEvent();
+  void createRecoveryLogChar(char *eventLogStr);
+  void printStats();
 
 private:
   boolean getWifiCredentialsFromSD();
+  boolean mount();
+  void unmount(boolean force = false);
+  boolean probeCard();
+  boolean openLogFile();
+  void getLogFileName(char *fn);
+  void recoverLogFile(const char *fn);
+  boolean cutLogFile(const char *fn, size_t validSize);
+  boolean isActualFormat(const char *tail, size_t end);
+  size_t findLogicalEnd(File &file);
+  boolean preallocate();
+  void trimLogFile();
+  void trimOldLogFiles(const char *fn);
+  void printMonthStats();
+  void enqueueRecord(LogQueueRecord &record);
+  void processRecord(LogQueueRecord &record);
+  void bufferRecord(LogQueueRecord &record);
+  void replayFlashLog();
+  void serviceArchive();
+  void createHeaderRecord(LogQueueRecord &record);
+  boolean writeBuffer();
+  boolean lockSD(uint32_t waitMs);
+  void unlockSD();
 
   uint8_t csPin;
-  boolean sdPresent;
-  SDHelperStates sdState;
-  unsigned long lastSDTime;
-  unsigned long lastSDSaveTime;
+  std::atomic<bool> sdPresent; // set by loop() and by the writer task, if a write fails
+  SDHelperStates sdState;      // only changed by loop()
+  uint64_t lastSDTime;
+  uint64_t lastSDSaveTime;
+  boolean saveRequested; // saveDataNow() was called
   char _ssid[WIFICREDENTIALLENGTH];
   char _pw[WIFICREDENTIALLENGTH];
   boolean credentialsValid;
   boolean checkSDPresence();
   char fileName[SD_FILENAMELENGTH]; // file name for the datalogger
+
+  boolean mounted;                      // is the sd card mounted?
+  File logFile;                         // log file kept open with SD_PERSISTENT_MOUNT
+  char openFileName[SD_FILENAMELENGTH]; // name of the open logFile
+  size_t logicalEnd;                    // end of the data in logFile, next write position
+  char tornFileName[SD_FILENAMELENGTH]; // log file with a short write, cut at the next open
+  size_t tornEnd;                       // end of the data before the short write
+
+  // statistics since the last printStats()
+  uint32_t mountCnt;           // number of SD.begin()
+  uint32_t sdBusyUs;           // time spent in sd access in us
+  uint64_t lastStatsTime;      // last printStats()
+
+  LogBuffer logBuffer;              // records not yet written to the card
+  uint32_t firstBufferedTime;       // millis() when the oldest buffered record was added
+  uint32_t lastFlushUs, maxFlushUs; // duration of the flushes
+  static uint8_t flushBuffer[LOGBUFFER_SLOTS * LOGBUFFER_SLOT_SIZE];
+  char bufferFileName[SD_FILENAMELENGTH]; // log file of the records in logBuffer
+  volatile boolean flushRequested;        // flush() was called
+
+  // writer task
+  SpscQueue<LogQueueRecord, SD_QUEUE_SIZE> logQueue; // records from loop() to the writer task
+  SemaphoreHandle_t sdMutex;                         // sd access of loop() and writer task
+  TaskHandle_t writerTaskHandle;
+  boolean started; // mutex, task and flash log are initialized
+
+  FlashLog flashLog; // records kept while there is no sd card
+
+  SdArchive archive; // directory layout, free space and retention of the data log
+
+  // statistics of the actual log file
+  uint32_t monthBytes;    // bytes written
+  uint32_t monthCsvBytes; // bytes the CSV format needs for the same records
+  uint32_t monthWriteUs;  // time spent writing the records
+  uint32_t encodeErrCnt;  // records, which couldn't be stored in the binary format
+
+  uint32_t seq;                              // sequence number of the next CSV line
+  char recoveredFileName[SD_FILENAMELENGTH]; // log file checked by the recovery since boot
+  char cutFileName[SD_FILENAMELENGTH];       // log file of the last cut, guarded by sdMutex
+  uint32_t recoveryCutBytes;                 // bytes cut off by the last cut, guarded by sdMutex
+  std::atomic<bool> recoveryPending;         // cut not yet reported
+  boolean formatChanged; // the recovered file ends with another format, it needs a new header
+  std::atomic<bool> writeFailed; // the writer task lost the card, loop() changes to NOSD
 };
\ No newline at end of file
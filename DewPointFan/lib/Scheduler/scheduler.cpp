@@ -0,0 +1,241 @@
+#include <Arduino.h>
+#if SCHED_PM_ENABLED == 1
+#include <esp_pm.h>
+#endif
+
+#include "scheduler.h"
+#include "timeService.h"
+
+/// @brief Register a periodic task. It runs at the first dispatch() and then every periodMs.
+/// @param name name for the statistics
+/// @param fn work of the task
+/// @param periodMs period, at least SCHED_TICK_MS
+/// @return id of the task for trigger(), -1 if there is no space
+int8_t Scheduler::addTask(const char *name, SchedulerFn fn, uint32_t periodMs) {
+  if (taskCnt >= SCHED_MAX_TASKS) {
+    return -1;
+  }
+  uint64_t nowTick = timeService.nowMs() / SCHED_TICK_MS;
+  if (taskCnt == 0) {
+    cursorTick = nowTick;
+    lastStatsTime = timeService.nowMs();
+  }
+  int8_t id = taskCnt++;
+  Task &t = tasks[id];
+  t.name = name;
+  t.fn = fn;
+  t.periodMs = max(periodMs, (uint32_t)SCHED_TICK_MS);
+  t.dueTick = nowTick;
+  link(id);
+  return id;
+}
+
+/// @brief Run the task at the next dispatch(), e.g. after a button was pressed. Its period is not
+/// changed. Can be called from other tasks or callbacks.
+/// @param id id of addTask()
+void Scheduler::trigger(int8_t id) {
+  if (id < 0 || id >= taskCnt) {
+    return;
+  }
+  triggered.fetch_or(1UL << id);
+  wake();
+}
+
+/// @brief Print the statistics at the next dispatch() in the task of the scheduler. Can be called
+/// from other tasks.
+void Scheduler::requestStats() {
+  statsRequested.store(true);
+  wake();
+}
+
+/// @brief Wake idle(), a notification given while dispatch() runs lets the next idle() return at
+/// once
+void Scheduler::wake() {
+#if SCHED_IDLE_ENABLED == 1
+  if (loopTaskHandle != NULL) {
+    if (xPortInIsrContext()) {
+      BaseType_t woken = pdFALSE;
+      vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+      portYIELD_FROM_ISR(woken);
+    } else {
+      xTaskNotifyGive(loopTaskHandle);
+    }
+  }
+#endif
+}
+
+/// @brief Run the tasks, which are due or triggered. Call it in loop() after timeService.tick().
+/// @return ms until the next task is due
+uint32_t Scheduler::dispatch() {
+  uint64_t now = timeService.nowMs();
+  uint64_t nowTick = now / SCHED_TICK_MS;
+  passCnt++;
+  if (loopTaskHandle == NULL) {
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+  }
+
+  // look at the slots, which passed since the last call, each slot at most once
+  uint64_t tick = cursorTick + SCHED_SLOTS <= nowTick ? nowTick - SCHED_SLOTS + 1 : cursorTick;
+  for (; tick <= nowTick; tick++) {
+    int8_t id = slots[tick % SCHED_SLOTS];
+    while (id >= 0) {
+      int8_t next = tasks[id].next;
+      Task &t = tasks[id];
+      if (t.dueTick <= nowTick) {
+        unlink(id);
+        run(id);
+        // keep the rhythm, but don't catch up missed periods
+        uint32_t periodTicks = t.periodMs / SCHED_TICK_MS;
+        t.dueTick += periodTicks;
+        if (t.dueTick <= nowTick) {
+          t.dueTick = nowTick + periodTicks;
+        }
+        link(id);
+      }
+      id = next;
+    }
+  }
+  cursorTick = nowTick + 1;
+
+  // triggered tasks, they may trigger other tasks. Their notifications are taken first, so a
+  // trigger() handled here doesn't wake the next idle() at once.
+#if SCHED_IDLE_ENABLED == 1
+  ulTaskNotifyTake(pdTRUE, 0);
+#endif
+  for (uint8_t i = 0; i < taskCnt; i++) {
+    uint32_t mask = triggered.exchange(0);
+    if (mask == 0) {
+      break;
+    }
+    for (int8_t id = 0; id < taskCnt; id++) {
+      if (mask & (1UL << id)) {
+        run(id);
+      }
+    }
+  }
+
+  if (now - lastStatsTime >= SCHED_STATS_MS || statsRequested.exchange(false)) {
+    printStats();
+  }
+  return getNextDueMs();
+}
+
+/// @brief get the time until the next task is due. Tasks due later than one turn of the wheel are
+/// not looked at, so at most SCHED_SLOTS * SCHED_TICK_MS is returned.
+/// @return ms, 0 if a task is due or triggered
+uint32_t Scheduler::getNextDueMs() {
+  if (triggered.load() != 0) {
+    return 0;
+  }
+  uint64_t now = timeService.nowMs();
+  // the last slot is the latest wake up, whether a task is due in it or not
+  uint64_t tick = cursorTick;
+  for (; tick < cursorTick + SCHED_SLOTS - 1; tick++) {
+    boolean due = false;
+    for (int8_t id = slots[tick % SCHED_SLOTS]; id >= 0 && !due; id = tasks[id].next) {
+      due = tasks[id].dueTick <= tick;
+    }
+    if (due) {
+      break;
+    }
+  }
+  uint64_t dueMs = tick * SCHED_TICK_MS;
+  return dueMs > now ? (uint32_t)(dueMs - now) : 0;
+}
+
+/// @brief Sleep until the next task is due or trigger() is called. Call it in loop() with the
+/// result of dispatch().
+/// @param ms time until the next task is due
+void Scheduler::idle(uint32_t ms) {
+#if SCHED_IDLE_ENABLED == 1
+  if (ms < SCHED_IDLE_MIN_MS) {
+    return;
+  }
+  unsigned long startUs = micros();
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+  sleepUs += micros() - startUs;
+#endif
+}
+
+/// @brief Lower the CPU clock while all tasks sleep, see SCHED_PM_ENABLED
+void Scheduler::initPower() {
+#if SCHED_PM_ENABLED == 1
+  esp_pm_config_t config = {
+      .max_freq_mhz = SCHED_PM_MAX_MHZ,
+      .min_freq_mhz = SCHED_PM_MIN_MHZ,
+      .light_sleep_enable = false, // the Zigbee coordinator has to listen all the time
+  };
+  esp_err_t err = esp_pm_configure(&config);
+  Serial.print("Scheduler: dynamic frequency scaling ");
+  Serial.println(err == ESP_OK ? "on" : esp_err_to_name(err));
+#endif
+}
+
+/// @brief Run one task and count it for the statistics
+/// @param id id of the task
+void Scheduler::run(int8_t id) {
+  Task &t = tasks[id];
+  unsigned long startUs = micros();
+  boolean useful = t.fn();
+  unsigned long us = micros() - startUs;
+  t.runCnt++;
+  t.usefulCnt += useful ? 1 : 0;
+  t.busyUs += us;
+  busyUs += us;
+}
+
+/// @brief Add a task to the slot of its due time
+/// @param id id of the task
+void Scheduler::link(int8_t id) {
+  uint8_t slot = tasks[id].dueTick % SCHED_SLOTS;
+  tasks[id].next = slots[slot];
+  slots[slot] = id;
+}
+
+/// @brief Remove a task from the slot of its due time
+/// @param id id of the task
+void Scheduler::unlink(int8_t id) {
+  int8_t *p = &slots[tasks[id].dueTick % SCHED_SLOTS];
+  while (*p >= 0 && *p != id) {
+    p = &tasks[*p].next;
+  }
+  if (*p == id) {
+    *p = tasks[id].next;
+  }
+}
+
+/// @brief Print and reset the statistics: passes of loop() per second, the time outside of the
+/// tasks (idle), the part of it slept in idle() and for each task the dispatches, the useful ones
+/// and the time spent in it
+void Scheduler::printStats() {
+  uint64_t now = timeService.nowMs();
+  uint32_t elapsedMs = max((uint32_t)(now - lastStatsTime), (uint32_t)1);
+  Serial.print("Scheduler ");
+  Serial.print(rtosTaskName);
+  Serial.print(" stats: ");
+  Serial.print((float)passCnt * 1000 / elapsedMs);
+  Serial.print(" passes/s, idle ");
+  Serial.print(100.0f - (float)busyUs / 10 / elapsedMs);
+  Serial.print(" %, sleeping ");
+  Serial.print((float)sleepUs / 10 / elapsedMs);
+  Serial.println(" %");
+  for (uint8_t id = 0; id < taskCnt; id++) {
+    Task &t = tasks[id];
+    Serial.print("  ");
+    Serial.print(t.name);
+    Serial.print(": runs ");
+    Serial.print(t.runCnt);
+    Serial.print(", useful ");
+    Serial.print(t.usefulCnt);
+    Serial.print(", busy ");
+    Serial.print(t.busyUs / 1000);
+    Serial.println(" ms");
+    t.runCnt = 0;
+    t.usefulCnt = 0;
+    t.busyUs = 0;
+  }
+  passCnt = 0;
+  busyUs = 0;
+  sleepUs = 0;
+  lastStatsTime = now;
+}
@@ -0,0 +1,87 @@
+// scheduler.h
+
+#pragma once
+
+// Cooperative scheduler for loop(): every helper registers its periodic work as a task. dispatch()
+// only runs the tasks, which are due, and tells when the next one is due. So loop() doesn't poll
+// every state machine on every pass.
+// The tasks are kept in a timer wheel: SCHED_SLOTS slots of SCHED_TICK_MS each. A task is linked
+// into the slot of its due time, tasks due later than one turn of the wheel wait for more turns.
+// So dispatch() only looks at the slots, which passed since the last call.
+// Each FreeRTOS task runs its own scheduler. trigger() and requestStats() may be called from other
+// tasks, everything else only from the task of the scheduler.
+#define SCHED_TICK_MS 10
+#define SCHED_SLOTS 64
+#define SCHED_MAX_TASKS 12
+
+// how often shall the scheduler statistics be printed?
+#define SCHED_STATS_MS 60 * 60 * 1000
+
+// idle(): loop() sleeps until the next task is due, trigger() wakes it earlier, e.g. from a button
+// callback or an interrupt. The Zigbee stack and the sd writer run in their own FreeRTOS tasks and
+// go on while loop() sleeps.
+#define SCHED_IDLE_ENABLED 1
+#define SCHED_IDLE_MIN_MS 2 // shorter waits are not worth a sleep
+// dynamic frequency scaling: the CPU clock is lowered while all tasks sleep. Needs the power
+// management of ESP-IDF (CONFIG_PM_ENABLE), without it a message is printed and the clock stays.
+#define SCHED_PM_ENABLED 0
+#define SCHED_PM_MAX_MHZ 160
+#define SCHED_PM_MIN_MHZ 40
+
+#include <Arduino.h>
+#include <atomic>
+
+/// @brief work of a task
+/// @return true if the task did something useful, e.g. a new value or page, for the statistics
+typedef boolean (*SchedulerFn)();
+
+/// @brief Scheduler class: timer wheel of periodic tasks, all memory is static
+class Scheduler {
+public:
+  int8_t addTask(const char *name, SchedulerFn fn, uint32_t periodMs);
+  void trigger(int8_t id);
+  uint32_t dispatch();
+  uint32_t getNextDueMs();
+  void idle(uint32_t ms);
+  void initPower();
+  void requestStats();
+  void printStats();
+
+  Scheduler(const char *name)
+      : rtosTaskName(name), tasks{}, taskCnt(0), cursorTick(0), triggered(0), statsRequested(false),
+        loopTaskHandle(NULL), passCnt(0), busyUs(0), sleepUs(0), lastStatsTime(0) {
+    memset(slots, -1, sizeof(slots));
+  }
+
+private:
+  void wake();
+  void link(int8_t id);
+  void unlink(int8_t id);
+  void run(int8_t id);
+
+  const char *rtosTaskName; // name of the FreeRTOS task for the statistics
+  struct Task {
+    const char *name;
+    SchedulerFn fn;
+    uint32_t periodMs;
+    uint64_t dueTick; // tick of the next run
+    int8_t next;      // next task in the same slot, -1 at the end
+    // statistics since the last printStats()
+    uint32_t runCnt;    // dispatches
+    uint32_t usefulCnt; // dispatches, which did something
+    uint32_t busyUs;    // time spent in the task
+  } tasks[SCHED_MAX_TASKS];
+  int8_t slots[SCHED_SLOTS]; // first task of each slot, -1 if empty
+  uint8_t taskCnt;
+  uint64_t cursorTick; // next tick to be looked at
+
+  std::atomic<uint32_t> triggered;  // bit i: run task i at the next dispatch()
+  std::atomic<bool> statsRequested; // print the statistics at the next dispatch()
+  TaskHandle_t loopTaskHandle;      // task of dispatch(), woken by trigger()
+
+  // statistics since the last printStats()
+  uint32_t passCnt; // calls of dispatch()
+  uint64_t busyUs;  // time spent in the tasks
+  uint64_t sleepUs; // time slept in idle()
+  uint64_t lastStatsTime;
+};
@@ -0,0 +1,106 @@
+// spscQueue.h
+
+#pragma once
+
+// Lock free queue for one producer task and one consumer task. If the queue is full, the producer
+// overwrites the oldest element, the consumer notices it and counts the element as dropped. So the
+// producer never waits for the consumer.
+// Each slot has a sequence number (seqlock): odd while the producer writes the slot, even when
+// the element is complete. The consumer checks it before and after copying an element.
+// This code does not depend on Arduino, so it can be tested on the host as well.
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// @brief SpscQueue: single producer single consumer queue, which drops the oldest elements if it
+/// is full. T must be trivially copyable.
+template <typename T, size_t N> class SpscQueue {
+public:
+  SpscQueue() : head(0), tail(0), droppedCnt(0), highWaterMark(0) {
+    for (size_t i = 0; i < N; i++) {
+      slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /// @brief Add an element, only call from the producer. Never blocks.
+  /// @return false if the queue was full and the oldest element will be dropped
+  bool push(const T &value) {
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    Slot &slot = slots[pos % N];
+    slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.value, &value, sizeof(T));
+    slot.seq.store(2 * pos + 2, std::memory_order_release);
+    head.store(pos + 1, std::memory_order_release);
+
+    uint32_t depth = pos + 1 - tail.load(std::memory_order_acquire);
+    if (depth > highWaterMark.load(std::memory_order_relaxed)) {
+      highWaterMark.store(depth > N ? N : depth, std::memory_order_relaxed);
+    }
+    return depth <= N;
+  }
+
+  /// @brief Take the oldest element, only call from the consumer.
+  /// @return false if the queue is empty
+  bool pop(T &value) {
+    uint32_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      uint32_t h = head.load(std::memory_order_acquire);
+      if (pos == h) {
+        tail.store(pos, std::memory_order_release);
+        return false;
+      }
+      if (h - pos > N) {
+        // overwritten by the producer, skip to the oldest element still in the queue
+        droppedCnt.fetch_add(h - N - pos, std::memory_order_relaxed);
+        pos = h - N;
+      }
+      Slot &slot = slots[pos % N];
+      uint32_t seq1 = slot.seq.load(std::memory_order_acquire);
+      memcpy(&value, &slot.value, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint32_t seq2 = slot.seq.load(std::memory_order_relaxed);
+      if (seq1 == 2 * pos + 2 && seq2 == seq1) {
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+      // overwritten while copying
+      droppedCnt.fetch_add(1, std::memory_order_relaxed);
+      pos++;
+    }
+  }
+
+  /// @brief number of elements in the queue, may be outdated immediately
+  size_t size() const {
+    uint32_t depth = head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    return depth > N ? N : depth;
+  }
+
+  /// @brief number of elements dropped since start, because the queue was full
+  uint32_t getDroppedCount() const {
+    return droppedCnt.load(std::memory_order_relaxed);
+  }
+
+  /// @brief highest number of elements in the queue since the last reset
+  uint32_t getHighWaterMark() const {
+    return highWaterMark.load(std::memory_order_relaxed);
+  }
+
+  /// @brief only call from the producer
+  void resetHighWaterMark() {
+    highWaterMark.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    T value;
+  };
+  Slot slots[N];
+  std::atomic<uint32_t> head;       // position of the next push, written by the producer
+  std::atomic<uint32_t> tail;       // position of the next pop, written by the consumer
+  std::atomic<uint32_t> droppedCnt; // written by the consumer
+  std::atomic<uint32_t> highWaterMark;
+};
@@ -0,0 +1,50 @@
+// mailbox.h
+
+#pragma once
+
+// Mailbox of a task: messages are passed by value through a SpscQueue, so the sender and the
+// receiver never share a variable. After each message the wake function of the receiver is
+// called, e.g. to trigger its task in the scheduler. Like the queue, the mailbox holds the newest
+// messages, if the receiver is too slow, and counts the dropped ones.
+// This code does not depend on Arduino, so it can be tested on the host as well.
+
+#include "spscQueue.h"
+
+/// @brief wakes the receiver of a mailbox, called in the task of the sender
+typedef void (*MailboxWakeFn)();
+
+/// @brief Mailbox: one sender task, one receiver task. T must be trivially copyable.
+template <typename T, size_t N> class Mailbox {
+public:
+  Mailbox() : wakeFn(nullptr) {}
+
+  /// @brief Set the function to wake the receiver. Call it before the first send().
+  /// @param fn wake function, nullptr if the receiver polls
+  void setReceiver(MailboxWakeFn fn) {
+    wakeFn = fn;
+  }
+
+  /// @brief Send a message, only call from the sender task. Never blocks.
+  /// @return false if the mailbox was full and the oldest message will be dropped
+  bool send(const T &msg) {
+    bool stored = queue.push(msg);
+    if (wakeFn != nullptr) {
+      wakeFn();
+    }
+    return stored;
+  }
+
+  /// @brief Take the oldest message, only call from the receiver task
+  /// @return false if there is no message
+  bool receive(T &msg) {
+    return queue.pop(msg);
+  }
+
+  uint32_t getDroppedCount() const {
+    return queue.getDroppedCount();
+  }
+
+private:
+  SpscQueue<T, N> queue;
+  MailboxWakeFn wakeFn;
+};
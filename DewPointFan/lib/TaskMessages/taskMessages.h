@@ -0,0 +1,113 @@
+// taskMessages.h
+
+#pragma once
+
+// Messages between the tasks of main.cpp. Each helper belongs to exactly one task:
+// - acquisition (high priority): ProcessSensorData
+// - control (medium priority): ControlFan, MoistureModel, DeltaTuner, ZigbeeSwitchHelper
+// - io (low priority, loop()): RTCHelper, SDHelper, SampleLog, Rollup, DispHelper, serial
+// Everything another task needs is sent as a copy in a message. Within a task, the changes are
+// published as AppEvent on the EventBus of the task.
+
+#include <Arduino.h>
+
+#include "eventBus.h"
+#include "mailbox.h"
+#include "processSensorData.h"
+#include "controlFan.h"
+#include "deltaTuner.h"
+
+// messages a mailbox holds, the receiver is woken by every message
+#define MAILBOX_SIZE 8
+
+// tuner lines kept by the control task until the io task has written them to the sd card, if more
+// adjustments are not yet written, the oldest line is dropped
+#define TUNER_LOG_PENDING 4
+
+/// @brief acquisition -> control and io: new averages or a changed status of the sensors
+typedef struct {
+  AvgMeasurement inner;
+  AvgMeasurement outer;
+  TempAndHumidity sampleI; // last raw samples, see ProcessSensorData::getLastSamples()
+  TempAndHumidity sampleO;
+  VentilationUseFull ventilation;
+  boolean newAverages; // false: only the status changed
+  boolean sensorReset; // the power of the sensors is cycled
+  char logStr[TEMPLOG_LENGTH];
+} SensorMsg;
+
+/// @brief control -> acquisition: parameters of the decision
+typedef struct {
+  float dewPointDiffMin_K; // tuned by DeltaTuner
+} SensorParamMsg;
+
+/// @brief control -> io: state of the fan, sent when it changed
+typedef struct {
+  boolean fanOn;
+  ControlFanStates userSetpoint;
+  char modeChar[2]; // "0", "1", or "A" for auto
+  boolean zigbeeReady;
+  uint8_t boundDevices; // bound plugs
+  char logCtrlStr[LOGCTRLSTR_LENGTH];
+  boolean hasTunerLog;  // DeltaTuner adjusted, the line is in tunerLogStr
+  uint32_t tunerLogSeq; // number of the line, io acknowledges it with CMD_TUNER_LOGGED
+  char tunerLogStr[TUNERLOGSTR_LENGTH];
+} ControlMsg;
+
+/// @brief io -> control
+enum ControlCmd {
+  CMD_CLOCK,              // new month or hour of the week
+  CMD_INCREMENT_SETPOINT, // button click with the display on
+  CMD_ZIGBEE_RESET,       // long press of the boot button
+  CMD_SCHEDULE_PRINT,     // serial command W
+  CMD_SCHEDULE_EDIT,      // serial command W with a rule
+  CMD_SCHEDULE_RESET,     // serial command W 0
+  CMD_TUNER_LOGGED        // the tuner line tunerLogSeq is written to the sd card
+};
+
+typedef struct {
+  ControlCmd cmd;
+  uint8_t month;     // CMD_CLOCK
+  uint8_t weekHour;  // CMD_CLOCK
+  ScheduleRule rule;    // CMD_SCHEDULE_EDIT
+  uint32_t tunerLogSeq; // CMD_TUNER_LOGGED
+} ControlCmdMsg;
+
+/// @brief buttons -> io
+enum ButtonEvent { BUTTON_CLICK, BUTTON_LONG_PRESS };
+
+typedef struct {
+  ButtonEvent event;
+} ButtonMsg;
+
+// handlers of one event type on the bus of a task
+#define EVENTBUS_MAX_HANDLERS 4
+
+/// @brief events within a task
+enum AppEventType : uint8_t {
+  EV_NEW_AVERAGES,
+  EV_VENTILATION_REASON_CHANGED,
+  EV_FAN_STATE_CHANGED,
+  EV_SD_STATE_CHANGED,
+  EV_ZIGBEE_BINDING_CHANGED,
+  EV_MODE_CHANGED,
+  EV_TYPES // number of event types
+};
+
+/// @brief event on the bus of a task, the member of the union is given by the type
+typedef struct {
+  AppEventType type;
+  union {
+    const SensorMsg *sensor;        // EV_NEW_AVERAGES, valid during publish()
+    VentilationUseFull ventilation; // EV_VENTILATION_REASON_CHANGED
+    boolean fanOn;                  // EV_FAN_STATE_CHANGED
+    boolean sdInserted;             // EV_SD_STATE_CHANGED
+    struct {
+      boolean ready;
+      uint8_t boundDevices;
+    } zigbee;                      // EV_ZIGBEE_BINDING_CHANGED
+    ControlFanStates userSetpoint; // EV_MODE_CHANGED
+  };
+} AppEvent;
+
+typedef EventBus<AppEvent, EV_TYPES, EVENTBUS_MAX_HANDLERS> AppEventBus;
@@ -0,0 +1,49 @@
+#include <Arduino.h>
+
+#include "timeService.h"
+
+TimeService timeService;
+
+/// @brief Sample the clock. Call it once at the start of loop() and of every task, at least every
+/// 49 days.
+void TimeService::tick() {
+  std::lock_guard<std::mutex> lock(tickMutex);
+  unsigned long raw = source != nullptr ? source() : millis();
+  if (!started) {
+    // the 64 bit time starts with the first value of the source
+    ms.store(raw);
+    started = true;
+  } else {
+    // the only place, where the roll over of the source is handled
+    ms.store(ms.load() + (uint32_t)(raw - lastRaw));
+  }
+  lastRaw = raw;
+  tickCnt.store(tickCnt.load() + 1);
+}
+
+/// @brief get the time of the last tick()
+/// @return milliseconds since the start
+uint64_t TimeService::nowMs() {
+  return ms.load();
+}
+
+/// @brief get the time and the number of the last tick(), e.g. to see if a value was already
+/// updated in this pass of loop(). Only call it from loop().
+/// @return snapshot of the last tick()
+TimeSnapshot TimeService::getSnapshot() {
+  return TimeSnapshot{ms.load(), tickCnt.load()};
+}
+
+/// @brief get the number of tick() since the start
+uint32_t TimeService::getTickCount() {
+  return tickCnt.load();
+}
+
+/// @brief Replace the source of the milliseconds, e.g. by a virtual clock. The time starts again
+/// with the value of the source at the next tick(), like after a reset of the device.
+/// @param fn source, nullptr for millis()
+void TimeService::setSource(TimeSourceFn fn) {
+  std::lock_guard<std::mutex> lock(tickMutex);
+  source = fn;
+  started = false;
+}
@@ -0,0 +1,50 @@
+// timeService.h
+
+#pragma once
+
+// One clock for all helpers in loop(): tick() samples millis() once at the start of loop() and
+// extends it to 64 bits, so the time never rolls over (millis() does after 49.7 days). All helpers
+// take nowMs() instead of calling millis() themselves, so they see the same time during one pass
+// of loop() and can compare times without the unsigned subtraction trick.
+// Every task of main.cpp calls tick() at the start of its pass, nowMs() is the time of the last
+// tick() of any task. It never goes backwards, but may advance during a pass, when a task of
+// higher priority ticks.
+// The sd writer task measures its short durations with millis() itself.
+// The source of the milliseconds can be replaced by a virtual clock, e.g. to run the helpers on
+// the host faster than real time.
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+/// @brief source of the milliseconds, which may roll over, e.g. millis()
+typedef unsigned long (*TimeSourceFn)();
+
+/// @brief time of one pass of loop()
+typedef struct {
+  uint64_t ms;   // milliseconds since the start
+  uint32_t tick; // number of the tick()
+} TimeSnapshot;
+
+/// @brief TimeService class: 64 bit monotonic milliseconds, sampled once per loop()
+class TimeService {
+public:
+  void tick();
+  uint64_t nowMs();
+  TimeSnapshot getSnapshot();
+  uint32_t getTickCount();
+  void setSource(TimeSourceFn fn);
+
+  TimeService() : source(nullptr), lastRaw(0), started(false), ms(0), tickCnt(0) {}
+
+private:
+  std::mutex tickMutex;          // tick() is called from several tasks
+  TimeSourceFn source;           // nullptr: millis()
+  unsigned long lastRaw;         // value of the source at the last tick()
+  bool started;                  // lastRaw is valid
+  std::atomic<uint64_t> ms;      // milliseconds at the last tick()
+  std::atomic<uint32_t> tickCnt; // ticks since the start
+};
+
+// the clock of loop(), ticked by main.cpp
+extern TimeService timeService;
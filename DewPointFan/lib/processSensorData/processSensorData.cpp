@@ -1,6 +1,7 @@
 #include <Arduino.h>
 
 #include "processSensorData.h"
+#include "timeService.h"
 
 /// @brief initialize process sensor data with two DHT sensors
 /// @return true after initialization
@@ -11,7 +12,7 @@ bool ProcessSensorData::init() {
   dhtO.setup(DHTPINO, DHTesp::DHT22);
   // allow the system to gather valid data and therefore assume that initally valid data may be
   // given
-  timeLastValidDataI_ms = millis();
+  timeLastValidDataI_ms = timeService.nowMs();
   timeLastValidDataO_ms = timeLastValidDataI_ms;
   delayMS = 2000;
 
@@ -32,7 +33,7 @@ bool ProcessSensorData::init() {
 /// @brief This is the loop function to read the temperature and humidity sensors and calculate
 /// wether ventilation is usefull or not
 void ProcessSensorData::loop() {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
   TempAndHumidity sensorData;
 
   switch (processSensorDataStates) {
@@ -73,6 +74,7 @@ void ProcessSensorData::loop() {
       timeLastValidDataO_ms = now;
     }
     calcNewVentilationStartUseFull();
+    newAverages = true;
 
 #ifdef SENSORPWRRESET
     // Check if sensor reset is needed
@@ -260,6 +262,19 @@ boolean ProcessSensorData::calcNewVentilationStartUseFull() {
   }
 }
 
+/// @brief Set the dew point difference, which is needed to start the ventilation, e.g. from the
+/// DeltaTuner. The default is DELTAP.
+/// @param diff_K dew point inside must be this much higher than outside
+void ProcessSensorData::setDewPointDiffMin(float diff_K) {
+  condDewPointDiffmin_K = diff_K;
+}
+
+/// @brief get the dew point difference, which is needed to start the ventilation
+/// @return difference in K
+float ProcessSensorData::getDewPointDiffMin() {
+  return condDewPointDiffmin_K;
+}
+
 VentilationUseFull ProcessSensorData::getVentilationUsefullStatus() {
   return ventilationUseFull;
 }
@@ -337,11 +352,28 @@ void ProcessSensorData::createLogChar(char *logStr) {
            avgMeasurementI.validCnt, avgMeasurementO.validCnt);
 }
 
+/// @brief Get the last raw samples of both sensors without averaging and offsets. A new pair of
+/// samples is available, when hasNewAverages() reports new averages.
+/// @param inner sample of the inner sensor
+/// @param outer sample of the outer sensor
+void ProcessSensorData::getLastSamples(TempAndHumidity *inner, TempAndHumidity *outer) {
+  *inner = bufI.isEmpty() ? TempAndHumidity{NAN, NAN} : bufI.last();
+  *outer = bufO.isEmpty() ? TempAndHumidity{NAN, NAN} : bufO.last();
+}
+
+/// @brief Reports once, if new averages were calculated since the last call
+/// @return true if new averages are available with getAverageMeasurements()
+boolean ProcessSensorData::hasNewAverages() {
+  boolean isNew = newAverages;
+  newAverages = false;
+  return isNew;
+}
+
 /// @brief Returns the duration when the last valid data packages for both sensors where in the
 /// buffer
 /// @return duration in ms
 uint32_t ProcessSensorData::timeSinceAllDataWhereValid() {
-  uint32_t now = millis();
+  uint64_t now = timeService.nowMs();
   /*  Serial.print("Duration i: ");
     Serial.print(now - timeLastValidDataI_ms);
     Serial.println("");
@@ -349,7 +381,8 @@ uint32_t ProcessSensorData::timeSinceAllDataWhereValid() {
     Serial.print(now - timeLastValidDataO_ms);
     Serial.println("");
   */
-  return max(now - timeLastValidDataO_ms, now - timeLastValidDataI_ms);
+  uint64_t duration = max(now - timeLastValidDataO_ms, now - timeLastValidDataI_ms);
+  return (uint32_t)min(duration, (uint64_t)UINT32_MAX);
 }
 
 /// @brief Checks whether both sensor average values are valid
@@ -1,8 +1,11 @@
+#pragma once
+
 #define DHTPINI D0 // Digital pin connected to the DHT sensor
 #define DHTPINO D7 // second DHT
 
 #define DELTAP                                                                                     \
   3.0 // Der Taupunkt draußen muss um diese Gradzahl kleiner sein als drinnen, damit gelüftet wird
+      // Startwert, wird je Jahreszeit vom DeltaTuner angepasst (siehe deltaTuner.h)
 #define TEMP_I_MIN 10.0 // Minimale Innentemperatur, bei der die Lüftung nicht mehr aktiviert wird.
 #define TEMP_O_MIN -2.0 // Minimale Außentemperatur, bei der die Lüftung nicht mehr aktiviert wird.
 #define DEWPOINT_I_MIN 5.0 // Minimaler Taupunkt innen, nur oberhalb läuft der Lüfter
@@ -62,7 +65,7 @@ public:
         tempSensorOffset_degC(TEMP_SENSOR_OFFSET),
         humSensorOffset_pct(HUM_SENSOR_OFFSET),
         ventilationUseFull(NODATA), timeLastValidDataI_ms(0), timeLastValidDataO_ms(0),
-        sensorResetInProgress(false), lastResetTime(0) {}
+        sensorResetInProgress(false), lastResetTime(0), newAverages(false) {}
 
   void printBuffer();
   AvgMeasurement getAverageMeasurements(boolean inner);
@@ -72,6 +75,12 @@ public:
   void printStatus();
   void createLogChar(char *logStr);
 
+  boolean hasNewAverages();
+  void getLastSamples(TempAndHumidity *inner, TempAndHumidity *outer);
+
+  void setDewPointDiffMin(float diff_K);
+  float getDewPointDiffMin();
+
   uint32_t timeSinceAllDataWhereValid();
   boolean areBothSensorAvgValuesValid();
 
@@ -89,8 +98,8 @@ private:
   DHTesp dhtI;
   DHTesp dhtO;
 
-  unsigned long lastReadI;
-  unsigned long lastReadO;
+  uint64_t lastReadI;
+  uint64_t lastReadO;
 
   enum ProcessSensorDataStates {
     INIT,
@@ -114,12 +123,15 @@ private:
   AvgMeasurement avgMeasurementO;
 
   /// @brief store the time in ms since the last valid data arrived
-  uint32_t timeLastValidDataI_ms;
-  uint32_t timeLastValidDataO_ms;
+  uint64_t timeLastValidDataI_ms;
+  uint64_t timeLastValidDataO_ms;
 
   /// @brief Flag indicating if sensor reset is in progress
   boolean sensorResetInProgress;
 
   /// @brief Timestamp for non-blocking sensor reset timing
-  unsigned long lastResetTime;
+  uint64_t lastResetTime;
+
+  /// @brief true, if new averages were calculated since the last hasNewAverages()
+  boolean newAverages;
 };
\ No newline at end of file
@@ -20,6 +20,7 @@ Therefore the apache license from the example applies*/
 #include <Arduino.h>
 
 #include "zigbeeSwitchHelper.h"
+#include "timeService.h"
 
 #ifndef ZIGBEE_MODE_ZCZR
 #error "Zigbee coordinator mode is not selected in Tools->Zigbee mode"
@@ -53,7 +54,7 @@ boolean ZigbeeSwitchHelper::init() {
     ESP.restart();
   }
 
-  lastZigbeeTime = millis();
+  lastZigbeeTime = timeService.nowMs();
   zigbeeSwitchHelperState = ZB_WAIT;
   return true;
 }
@@ -61,7 +62,7 @@ boolean ZigbeeSwitchHelper::init() {
 /// @brief zigbeeSwitchHelper function that is called regularly in loop()
 /// @return true if something is bound
 boolean ZigbeeSwitchHelper::loop() {
-  unsigned long now = millis();
+  uint64_t now = timeService.nowMs();
 
   switch (zigbeeSwitchHelperState) {
   case ZB_WAIT:
@@ -72,6 +73,8 @@ boolean ZigbeeSwitchHelper::loop() {
       if (zbSwitch.bound()) // if something is bound
       {
         // TODO: check if it is a light or plug?
+        updateBoundDeviceCount();
+        pendingDevices = 0xFF; // send all setpoints as soon as ready
         zigbeeSwitchHelperState = ZB_READY;
       } else {
         zigbeeSwitchHelperState = ZB_WAIT;
@@ -83,25 +86,32 @@ boolean ZigbeeSwitchHelper::loop() {
   case ZB_READY:
     if (now - lastZigbeeTime >= ZigbeeREADY_MS) {
       if (zbSwitch.bound()) {
+        updateBoundDeviceCount();
 #ifdef DEBUGZIGBEEHANDLING
         Serial.println("READY");
         // printBoundDevicesLong();
         //  readManufacturer leads to reboot https://github.com/espressif/arduino-esp32/issues/10777
-        Serial.print("Plug: ");
-        Serial.println(lightSetpoint ? "on" : "off");
+        Serial.print("Plugs: ");
+        Serial.print(boundDeviceCount);
+        Serial.print(" setpoints: 0x");
+        Serial.println(deviceSetpoints, HEX);
 #endif
-        if (lightSetpoint) {
-          zbSwitch.lightOn();
-        } else {
-          zbSwitch.lightOff();
-        }
+        // repeat the setpoints of all devices regularly
+        sendDeviceSetpoints(0xFF);
+        pendingDevices = 0;
         lastZigbeeTime = now;
         zigbeeSwitchHelperState = ZB_READY;
       } else // nothing bound anymore
       {
+        boundDeviceCount = 0;
+        unusedDeviceCount = 0;
         lastZigbeeTime = now;
         zigbeeSwitchHelperState = ZB_WAIT;
       }
+    } else if (pendingDevices) {
+      // send changed setpoints immediately, but only to the devices which changed
+      sendDeviceSetpoints(pendingDevices);
+      pendingDevices = 0;
     }
     break;
   default:
@@ -133,22 +143,71 @@ void ZigbeeSwitchHelper::printBoundDevicesLong() {
   }
 }
 
-/// @brief toggle the setpoint for light
+/// @brief Send the on/off setpoint to each selected bound device individually
+/// @param devices bitmask of the devices, bit i is the i-th bound device
+void ZigbeeSwitchHelper::sendDeviceSetpoints(uint8_t devices) {
+  std::list<zb_device_params_t *> boundDevices = zbSwitch.getBoundDevices();
+  uint8_t i = 0;
+  for (const auto &device : boundDevices) {
+    if (i >= ZIGBEE_MAX_DEVICES) {
+      break;
+    }
+    if (devices & (1 << i)) {
+      if (deviceSetpoints & (1 << i)) {
+        zbSwitch.lightOn(device->endpoint, device->short_addr);
+      } else {
+        zbSwitch.lightOff(device->endpoint, device->short_addr);
+      }
+    }
+    i++;
+  }
+}
+
+/// @brief toggle the setpoint for all lights
 void ZigbeeSwitchHelper::toggleLightSetpoint() {
-  lightSetpoint = !lightSetpoint;
-  // don't wait until the next regular update of the lift
-  lastZigbeeTime -= ZigbeeREADY_MS;
+  setDeviceSetpoints(deviceSetpoints ? 0 : 0xFF);
 }
 
-/// @brief The setpoint, if light shall be on or off, is sent regularly with this parameter
+/// @brief The setpoint, if all lights shall be on or off, is sent regularly with this parameter
 /// @param on
 void ZigbeeSwitchHelper::setLightSetpoint(boolean on) {
-  if (lightSetpoint != on) {
-    // if something changed
-    // don't wait until the next regular update of the light
-    lastZigbeeTime -= ZigbeeREADY_MS;
-    lightSetpoint = on;
+  setDeviceSetpoints(on ? 0xFF : 0);
+}
+
+/// @brief Set the setpoint of each bound device individually. Only the devices, whose setpoint
+/// changed, are commanded immediately. All setpoints are repeated regularly.
+/// @param mask bit i: the i-th bound device shall be on
+void ZigbeeSwitchHelper::setDeviceSetpoints(uint8_t mask) {
+  // don't wait until the next regular update of the changed devices
+  pendingDevices |= deviceSetpoints ^ mask;
+  deviceSetpoints = mask;
+}
+
+/// @brief Get the number of bound devices, which can be addressed individually
+/// @return number of devices, at most ZIGBEE_MAX_DEVICES
+uint8_t ZigbeeSwitchHelper::getBoundDeviceCount() {
+  return boundDeviceCount;
+}
+
+/// @brief Get the number of bound devices, which are not switched, because there are more than
+/// ZIGBEE_MAX_DEVICES
+/// @return number of unused devices
+uint8_t ZigbeeSwitchHelper::getUnusedDeviceCount() {
+  return unusedDeviceCount;
+}
+
+/// @brief Count the bound devices. Only the first ZIGBEE_MAX_DEVICES are switched, the others are
+/// reported as unused.
+void ZigbeeSwitchHelper::updateBoundDeviceCount() {
+  size_t bound = zbSwitch.getBoundDevices().size();
+  uint8_t unused = bound > ZIGBEE_MAX_DEVICES ? min(bound - ZIGBEE_MAX_DEVICES, (size_t)255) : 0;
+  if (unused != unusedDeviceCount) {
+    Serial.print("Zigbee: ");
+    Serial.print(unused);
+    Serial.println(" bound plugs unused, see FAN_GROUP_MAX");
   }
+  boundDeviceCount = min(bound, (size_t)ZIGBEE_MAX_DEVICES);
+  unusedDeviceCount = unused;
 }
 
 /// @brief Reset the zigbee device and reboot the esp to allow new binding
@@ -14,17 +14,30 @@ enum ZigbeeSwitchHelperStates { ZB_INIT, ZB_WAIT, ZB_READY };
 
 #include "Zigbee.h"
 
+#include "controlFan.h"
+
 /* Zigbee switch configuration */
 #define SWITCH_ENDPOINT_NUMBER 5
 
+// how many bound plugs are addressed individually? Every one is a fan of the group in ControlFan,
+// further plugs stay bound, but are not switched and reported as unused.
+#define ZIGBEE_MAX_DEVICES FAN_GROUP_MAX
+
 /// @brief ZigbeeSwitchHelper class to help with all zigbee related stuff. Call loop() regularly to
-/// check the status etc. Use setLightSetpoint(true/false) to turn on the zigbee light/socket.
+/// check the status etc. Use setLightSetpoint(true/false) to turn on all zigbee lights/sockets or
+/// setDeviceSetpoints() to switch each bound socket individually.
 class ZigbeeSwitchHelper {
 public:
   boolean init();
 
   void setLightSetpoint(boolean on);
 
+  void setDeviceSetpoints(uint8_t mask);
+
+  uint8_t getBoundDeviceCount();
+
+  uint8_t getUnusedDeviceCount();
+
   boolean loop();
 
   void printBoundDevicesLong();
@@ -33,7 +46,8 @@ public:
 
   ZigbeeSwitchHelper()
       : zbSwitch(ZigbeeSwitch(SWITCH_ENDPOINT_NUMBER)), zigbeeSwitchHelperState(ZB_INIT),
-        lightSetpoint(false), lastZigbeeTime(0) {}
+        deviceSetpoints(0), pendingDevices(0), boundDeviceCount(0), unusedDeviceCount(0),
+        lastZigbeeTime(0) {}
 
   void reset();
 
@@ -41,7 +55,13 @@ public:
 
 private:
   ZigbeeSwitch zbSwitch;
-  boolean lightSetpoint;
   ZigbeeSwitchHelperStates zigbeeSwitchHelperState;
-  unsigned long lastZigbeeTime;
+  uint8_t deviceSetpoints; // bit i: bound device i shall be on
+  uint8_t pendingDevices;  // bit i: setpoint of device i changed and must be sent
+  uint8_t boundDeviceCount;
+  uint8_t unusedDeviceCount; // bound, but more than ZIGBEE_MAX_DEVICES
+  uint64_t lastZigbeeTime;
+
+  void sendDeviceSetpoints(uint8_t devices);
+  void updateBoundDeviceCount();
 };
\ No newline at end of file
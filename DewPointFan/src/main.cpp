@@ -3,9 +3,17 @@
 #include "rtchelper.h"
 #include "processSensorData.h"
 #include "sdhelper.h"
+#include "sampleLog.h"
 
 #include "controlFan.h"
 #include "zigbeeSwitchHelper.h"
+#include "moistureModel.h"
+#include "deltaTuner.h"
+#include "rollup.h"
+#include "timeService.h"
+#include "scheduler.h"
+#include "loopProfiler.h"
+#include "taskMessages.h"
 
 #include "disphelper.h" // call after controlFan and after processSensorData
 #include "Button.h"
@@ -15,71 +23,352 @@
 #error "Filenamelength in SD and RTC don't match"
 #endif
 
+// The work is split into three FreeRTOS tasks, each runs its own Scheduler. They don't share
+// variables, they send messages to each other, see taskMessages.h.
+// - acquisition (high priority): read the sensors
+// - control (medium priority): decide if the fan runs and command the plugs via zigbee
+// - io (low priority, the Arduino loop()): RTC, sd card, display and serial
+#define ACQ_TASK_STACK 4096
+#define ACQ_TASK_PRIORITY 3
+#define CONTROL_TASK_STACK 8192
+#define CONTROL_TASK_PRIORITY 2
+// loop() runs with priority 1
+
+// periods of the scheduler tasks. The helpers check their own timing inside, so the periods only
+// have to be short enough for it.
+#define TASK_SERIAL_MS 50
+#define TASK_SENSOR_MS 100
+#define TASK_FAN_MS 500
+#define TASK_RTC_MS 1000
+#define TASK_SD_MS 250
+#define TASK_DISP_MS 250
+#define TASK_ZIGBEE_MS 250
+#define TASK_STATUS_MS 2000
+#define TASK_RX_MS 1000 // the mailboxes wake the receiving tasks, this is only a fallback
+
 // Sensor power reset feature: If SENSORPWRRESET is defined in processSensorData.h, sensors are
 // powered via SENSORPWRPIN instead of 3.3V, enabling automatic power cycling on communication
 // failure.
 
+// acquisition task
 ProcessSensorData processSensorData;
 
+// control task
 ControlFan controlFan;
+MoistureModel moistureModel;
+DeltaTuner deltaTuner;
+ZigbeeSwitchHelper zigbeeSwitchHelper;
 
+// io task
+Rollup rollup;
 RTCHelper rtcHelper;
 SDHelper sdHelper(D2); // sd CS pin is on D2
+SampleLog sampleLog(sdHelper);
 DispHelper dispHelper;
-ZigbeeSwitchHelper zigbeeSwitchHelper;
 
 // Helper for serial time commands (Z-input)
 SerialTimeHelper serialTimeHelper(rtcHelper);
 
+// one scheduler per FreeRTOS task
+Scheduler acqScheduler("acquisition");
+Scheduler controlScheduler("control");
+Scheduler ioScheduler("io");
+static int8_t controlRxTaskId = -1;
+static int8_t fanTaskId = -1;
+static int8_t zigbeeTaskId = -1;
+static int8_t ioRxTaskId = -1;
+static int8_t dispTaskId = -1;
+static boolean sensorTask();
+static boolean controlRxTask();
+static boolean fanTask();
+static boolean zigbeeTask();
+static boolean ioRxTask();
+static boolean rtcTask();
+static boolean sdTask();
+static boolean dispTask();
+static boolean statusTask();
+static boolean serialTask();
+
+// messages between the tasks
+static Mailbox<SensorMsg, MAILBOX_SIZE> sensorToControl;
+static Mailbox<SensorMsg, MAILBOX_SIZE> sensorToIo;
+static Mailbox<SensorParamMsg, MAILBOX_SIZE> paramToAcq;
+static Mailbox<ControlMsg, MAILBOX_SIZE> controlToIo;
+static Mailbox<ControlCmdMsg, MAILBOX_SIZE> cmdToControl;
+static Mailbox<ButtonMsg, MAILBOX_SIZE> buttonToIo;
+
+// events within the control and the io task
+static AppEventBus controlBus;
+static AppEventBus ioBus;
+
+// state of the acquisition task: a message is sent, when it changes
+static VentilationUseFull acqVentilation = NODATA;
+static boolean acqSensorReset = false;
+
+// state of the control task
+static VentilationUseFull ctrlVentilation = NODATA;
+static boolean ctrlVentUseful = false;
+static boolean ctrlFanOn = false;
+static uint8_t ctrlMonth = 1;
+// tuner lines not yet written by io: the oldest is repeated in each ControlMsg until io acknowledges
+// it with CMD_TUNER_LOGGED, so it is not lost if a ControlMsg is dropped or the sd card is busy
+static char ctrlTunerLog[TUNER_LOG_PENDING][TUNERLOGSTR_LENGTH];
+static uint32_t ctrlTunerLogHead = 0; // number of the next adjustment
+static uint32_t ctrlTunerLogTail = 0; // number of the oldest line not yet written
+static ControlMsg ctrlSentControl; // last ControlMsg sent to io
+
+// state of the io task: the last messages of the other tasks
+static SensorMsg ioSensor;
+static ControlMsg ioControl;
+static boolean ioSdInserted = false;
+static uint8_t ioMonth = 0xFF;
+static uint8_t ioWeekHour = 0xFF;
+static uint32_t ioTunerLogNext = 0; // number of the next tuner line to write
 static uint8_t ledState = HIGH;
 
-/// @brief Call back function for the external mode button click
+char versionStr[10] = "Ver 3.3.1";
+
+/// @brief wake the control task for its mailboxes
+static void wakeControl() {
+  controlScheduler.trigger(controlRxTaskId);
+}
+
+/// @brief wake the io task for its mailboxes
+static void wakeIo() {
+  ioScheduler.trigger(ioRxTaskId);
+}
+
+/// @brief Call back function for the external mode button click, handled by the io task, see
+/// onButton()
 /// @param button_handle
 /// @param usr_data
 static void onButtonSingleClickCb(void *button_handle, void *usr_data) {
   Serial.println("Button single click");
+  buttonToIo.send(ButtonMsg{BUTTON_CLICK});
+}
+
+/// @brief Call back function for the internal "boot" button, directly on the esp32c6 module -> long
+/// press release to initiate a factory reset. Then, after the reset you have 180s to connect a new
+/// plug
+/// @param button_handle
+/// @param usr_data
+static void onLongPressUpEventCb(void *button_handle, void *usr_data) {
+  Serial.println("Button long press up");
+  buttonToIo.send(ButtonMsg{BUTTON_LONG_PRESS});
+}
+
+/// @brief io task: react on a button
+/// @param event click of the mode button or long press of the boot button
+static void onButton(ButtonEvent event) {
+  if (event == BUTTON_LONG_PRESS) {
+    dispHelper.showSpecificDisplay(DISP_ZIGBEERESET);
+    cmdToControl.send(ControlCmdMsg{CMD_ZIGBEE_RESET, 0, 0}); // blocks the systems and reboots
+    return;
+  }
   // If the display is off:
   //  -> only turn on the display and reset the timer
   //  -> DO NOT change the mode / setpoint
   if (!dispHelper.isDisplayOn()) {
     dispHelper.resetActivityTimer(); // reset activity timer inside DispHelper
+    ioScheduler.trigger(dispTaskId);
     return;
   }
 
   // If the display is on:
-  //  -> increase setpoint,
+  //  -> increase setpoint, the control task has a higher priority and answers at once
   //  -> show mode
   //  -> reset the activity timer
-  controlFan.incrementUserSetpoint();
+  cmdToControl.send(ControlCmdMsg{CMD_INCREMENT_SETPOINT, 0, 0});
   dispHelper.showSpecificDisplay(
       DISP_MODE);                  // switch the display to show the mode in next iteration
   dispHelper.resetActivityTimer(); // reset activity timer inside DispHelper
+  ioScheduler.trigger(dispTaskId); // show the mode at once
 }
 
-/// @brief Call back function for the internal "boot" button, directly on the esp32c6 module -> long
-/// press release to initiate a factory reset. Then, after the reset you have 180s to connect a new
-/// plug
-/// @param button_handle
-/// @param usr_data
-static void onLongPressUpEventCb(void *button_handle, void *usr_data) {
-  Serial.println("Button long press up");
-  dispHelper.showSpecificDisplay(DISP_ZIGBEERESET);
-  zigbeeSwitchHelper.reset(); // blocks the systems and reboots
+/// @brief Call back function for the serial command "H [min]": record every sensor sample for the
+/// given minutes, "H 0" stops the recording
+/// @param args minutes
+static void onSampleLogCommand(const String &args) {
+  long minutes = args.length() > 0 ? args.toInt() : SAMPLELOG_DEFAULT_MIN;
+  if (minutes > 0) {
+    sampleLog.start(min(minutes, (long)SAMPLELOG_MAX_MIN));
+  } else {
+    sampleLog.stop();
+  }
 }
 
-char versionStr[10] = "Ver 3.3.1";
-char tmpFileName[RTC_FILENAMELENGTH] = "/2025-06.csv";
-char logStr[TEMPLOG_LENGTH];
-char logCtrlStr[LOGCTRLSTR_LENGTH];
-char timestamp[TIMESTAMP_LENGTH] = "2025-06-25 20:01:10";
-char dateDispStr[DATE_LENGTH] = "25.06.2025";
-char timeDispStr[TIME_LENGTH] = "20:01:10";
-char modeChar[2] = "m"; // active mode "0", "1", or "A" for auto
+/// @brief Call back function for the serial command "S": print the statistics of the tasks, each
+/// FreeRTOS task prints its own
+/// @param args not used
+static void onSchedulerCommand(const String &args) {
+  acqScheduler.requestStats();
+  controlScheduler.requestStats();
+  ioScheduler.requestStats();
+}
+
+#if LOOPPROF_ENABLED == 1
+/// @brief Call back function for the serial command "P": print and reset the latency statistics of
+/// the subsystems, each FreeRTOS task prints its own
+/// @param args not used
+static void onProfilerCommand(const String &args) {
+  loopProfiler.requestStats();
+}
+#endif
+
+/// @brief Call back function for the serial command "W": print the weekly schedule of the fan.
+/// "W q 12345 22 6" makes the hours 22:00 to 6:00 after Monday to Friday quiet (q), preferred (p)
+/// or normal (n), the days are 0 = Sunday ... 6 = Saturday. "W 0" resets the schedule to
+/// SCHEDULE_RULES. The control task owns the schedule, stores it and prints it.
+/// @param args empty, "0" or type, days, start and end hour
+static void onScheduleCommand(const String &args) {
+  ControlCmdMsg msg = {CMD_SCHEDULE_PRINT, 0, 0};
+  if (args == "0") {
+    msg.cmd = CMD_SCHEDULE_RESET;
+  } else if (args.length() > 0) {
+    char type;
+    char days[8];
+    int startHour, endHour;
+    if ((sscanf(args.c_str(), "%c %7s %d %d", &type, days, &startHour, &endHour) != 4) ||
+        !strchr("qpnQPN", type) || startHour < 0 || startHour > 23 || endHour < 0 ||
+        endHour > 24) {
+      Serial.println("Eingabe ungueltig, z.B. W q 0123456 22 6");
+      return;
+    }
+    msg.cmd = CMD_SCHEDULE_EDIT;
+    msg.rule.type = (tolower(type) == 'q')   ? SCHED_QUIET
+                    : (tolower(type) == 'p') ? SCHED_PREFERRED
+                                             : SCHED_NORMAL;
+    msg.rule.days = 0;
+    for (const char *d = days; *d; d++) {
+      if (*d >= '0' && *d <= '6') {
+        msg.rule.days |= 1 << (*d - '0');
+      }
+    }
+    msg.rule.startHour = startHour;
+    msg.rule.endHour = endHour;
+  }
+  cmdToControl.send(msg);
+}
+
+/// @brief Call back function for the serial command "D": print the estimated drift of the RTC,
+/// "D 0" forgets it
+/// @param args "0" to reset
+static void onDriftCommand(const String &args) {
+  if (args == "0") {
+    rtcHelper.resetDrift();
+  }
+  rtcHelper.printDrift();
+}
+
+/// @brief acquisition task: copy the state of the sensors into a message
+/// @param msg message
+/// @param newAverages true if the averages are new
+static void createSensorMsg(SensorMsg &msg, boolean newAverages) {
+  msg.inner = processSensorData.getAverageMeasurements(true);
+  msg.outer = processSensorData.getAverageMeasurements(false);
+  processSensorData.getLastSamples(&msg.sampleI, &msg.sampleO);
+  msg.ventilation = processSensorData.getVentilationUsefullStatus();
+  msg.newAverages = newAverages;
+  msg.sensorReset = processSensorData.isSensorResetInProgress();
+  processSensorData.createLogChar(msg.logStr);
+}
+
+/// @brief control task: copy the state of the fan into a message
+/// @param msg message, the oldest tuner adjustment not yet written is added
+static void createControlMsg(ControlMsg &msg) {
+  msg.fanOn = ctrlFanOn;
+  msg.userSetpoint = controlFan.getUserSetpoint();
+  controlFan.getModeCharacter(msg.modeChar);
+  msg.zigbeeReady = zigbeeSwitchHelper.isReady();
+  msg.boundDevices = zigbeeSwitchHelper.getBoundDeviceCount();
+  controlFan.createLogChar(msg.logCtrlStr);
+  msg.hasTunerLog = ctrlTunerLogHead != ctrlTunerLogTail;
+  msg.tunerLogSeq = ctrlTunerLogTail;
+  memcpy(msg.tunerLogStr, ctrlTunerLog[ctrlTunerLogTail % TUNER_LOG_PENDING], TUNERLOGSTR_LENGTH);
+}
+
+/// @brief control task: does a ControlMsg differ from the last one sent?
+/// @param msg new message
+/// @return true if io has to get it: something changed or a tuner line waits for its
+/// acknowledgement
+static boolean isControlMsgNew(const ControlMsg &msg) {
+  const ControlMsg &sent = ctrlSentControl;
+  return msg.hasTunerLog || msg.hasTunerLog != sent.hasTunerLog || msg.fanOn != sent.fanOn ||
+         msg.userSetpoint != sent.userSetpoint || msg.zigbeeReady != sent.zigbeeReady ||
+         msg.boundDevices != sent.boundDevices || strcmp(msg.modeChar, sent.modeChar) != 0 ||
+         strcmp(msg.logCtrlStr, sent.logCtrlStr) != 0;
+}
+
+/// @brief Control task, EV_NEW_AVERAGES: the models learn and the fan decides at once
+/// @param event new averages
+static void onCtrlNewAverages(const AppEvent &event) {
+  const SensorMsg &sensor = *event.sensor;
+  // learn how effective the fan is and end runs, which don't pay off anymore
+  moistureModel.update(sensor.inner, sensor.outer, ctrlFanOn);
+  controlFan.setRunPaysOff(moistureModel.isRunPayingOff(sensor.inner, sensor.outer));
+
+  // score the runs and tune the dew point difference for the season
+  deltaTuner.update(sensor.inner, sensor.outer, ctrlFanOn, controlFan.getUserSetpoint() == CF_AUTO,
+                    ctrlMonth);
+  paramToAcq.send(SensorParamMsg{deltaTuner.getDeltaP()});
+  // every adjustment is logged by the io task, so it can be audited
+  if (deltaTuner.hasAdjustment()) {
+    if (ctrlTunerLogHead - ctrlTunerLogTail == TUNER_LOG_PENDING) {
+      ctrlTunerLogTail++; // io didn't write the lines for a long time, drop the oldest
+    }
+    deltaTuner.createLogChar(ctrlTunerLog[ctrlTunerLogHead % TUNER_LOG_PENDING]);
+    ctrlTunerLogHead++;
+  }
+  controlScheduler.trigger(fanTaskId);
+}
+
+/// @brief Control task, EV_VENTILATION_REASON_CHANGED: the fan decides at once
+/// @param event new reason
+static void onCtrlVentilationChanged(const AppEvent &event) {
+  ctrlVentUseful = event.ventilation == USEFULL;
+  controlScheduler.trigger(fanTaskId);
+}
+
+/// @brief io task, EV_NEW_AVERAGES: summarize the hour and the day, record the samples
+/// @param event new averages
+static void onIoNewAverages(const AppEvent &event) {
+  const SensorMsg &sensor = *event.sensor;
+  char timestamp[TIMESTAMP_LENGTH];
+  // summarize the hour and the day
+  rtcHelper.createTimeStampLogging(timestamp);
+  rollup.update(timestamp, sensor.inner, sensor.outer, sensor.ventilation, ioControl.fanOn);
+
+  // record every raw sample for debugging, if switched on by the serial command
+  if (sampleLog.isActive()) {
+    sampleLog.addSample(timestamp, sensor.sampleI.temperature, sensor.sampleI.humidity,
+                        sensor.sampleO.temperature, sensor.sampleO.humidity,
+                        ioControl.logCtrlStr);
+  }
+}
+
+/// @brief io task, any change shown on the display: draw the page again at once
+/// @param event not used
+static void onIoStatusChanged(const AppEvent &event) {
+  dispHelper.refresh();
+  ioScheduler.trigger(dispTaskId);
+}
+
+/// @brief FreeRTOS task: run the tasks of a scheduler and sleep in between
+/// @param param Scheduler
+static void schedulerTask(void *param) {
+  Scheduler *scheduler = (Scheduler *)param;
+  for (;;) {
+    timeService.tick();
+    uint32_t nextDueMs = scheduler->dispatch();
+    scheduler->idle(nextDueMs);
+  }
+}
 
 void setup() {
   Serial.begin(115200);
   delay(
       4000); // Wait four seconds, to have enough time to start the serial monitor to see the setup
+  timeService.tick(); // the helpers take the time of their init() from the time service
   rtcHelper.init();
   sdHelper.init();
   dispHelper.init(versionStr);
@@ -100,23 +389,75 @@ void setup() {
   pinMode(LED_BUILTIN, OUTPUT); // builtin LED
 
   processSensorData.init();
+  moistureModel.init();
+  deltaTuner.init();
 
   zigbeeSwitchHelper.init();
-}
 
-void loop() {
-  static unsigned long lastdebugTime = 0;
-  unsigned long now = millis();
+  serialTimeHelper.addCommand('H', "H [min] -> Jede Messung aufzeichnen (H 0: stoppen)",
+                              onSampleLogCommand);
+  serialTimeHelper.addCommand('D', "D -> Drift der RTC anzeigen (D 0: zuruecksetzen)",
+                              onDriftCommand);
+  serialTimeHelper.addCommand('S', "S -> Statistik der Tasks anzeigen", onSchedulerCommand);
+  serialTimeHelper.addCommand('W', "W [q|p|n Tage von bis] -> Wochenplan anzeigen/aendern (W 0: "
+                                   "zuruecksetzen)",
+                              onScheduleCommand);
+#if LOOPPROF_ENABLED == 1
+  serialTimeHelper.addCommand('P', "P -> Laufzeiten der Teilsysteme anzeigen und zuruecksetzen",
+                              onProfilerCommand);
+#endif
 
-  // evaluate serial commands (e.g. "Z" for time distortion test)
-  serialTimeHelper.handleSerial();
+  // the io task starts with the state of the other tasks before they run
+  createSensorMsg(ioSensor, false);
+  createControlMsg(ioControl);
+  ctrlSentControl = ioControl;
+  ioSdInserted = sdHelper.isSDinserted();
+
+  sensorToControl.setReceiver(wakeControl);
+  cmdToControl.setReceiver(wakeControl);
+  sensorToIo.setReceiver(wakeIo);
+  controlToIo.setReceiver(wakeIo);
+  buttonToIo.setReceiver(wakeIo);
+  // paramToAcq is polled by the sensor task
+
+  controlBus.subscribe(EV_NEW_AVERAGES, onCtrlNewAverages);
+  controlBus.subscribe(EV_VENTILATION_REASON_CHANGED, onCtrlVentilationChanged);
+  ioBus.subscribe(EV_NEW_AVERAGES, onIoNewAverages);
+  ioBus.subscribe(EV_VENTILATION_REASON_CHANGED, onIoStatusChanged);
+  ioBus.subscribe(EV_FAN_STATE_CHANGED, onIoStatusChanged);
+  ioBus.subscribe(EV_SD_STATE_CHANGED, onIoStatusChanged);
+  ioBus.subscribe(EV_ZIGBEE_BINDING_CHANGED, onIoStatusChanged);
+  ioBus.subscribe(EV_MODE_CHANGED, onIoStatusChanged);
+
+  ioScheduler.initPower();
+  acqScheduler.addTask("sensor", sensorTask, TASK_SENSOR_MS);
+
+  // the messages first: new averages are used for the fan decision at once
+  controlRxTaskId = controlScheduler.addTask("rx", controlRxTask, TASK_RX_MS);
+  fanTaskId = controlScheduler.addTask("fan", fanTask, TASK_FAN_MS);
+  zigbeeTaskId = controlScheduler.addTask("zigbee", zigbeeTask, TASK_ZIGBEE_MS);
+
+  ioRxTaskId = ioScheduler.addTask("rx", ioRxTask, TASK_RX_MS);
+  ioScheduler.addTask("serial", serialTask, TASK_SERIAL_MS);
+  ioScheduler.addTask("rtc", rtcTask, TASK_RTC_MS);
+  ioScheduler.addTask("sd", sdTask, TASK_SD_MS);
+  dispTaskId = ioScheduler.addTask("disp", dispTask, TASK_DISP_MS);
+  ioScheduler.addTask("status", statusTask, TASK_STATUS_MS);
+
+  xTaskCreate(schedulerTask, "acquisition", ACQ_TASK_STACK, &acqScheduler, ACQ_TASK_PRIORITY,
+              NULL);
+  xTaskCreate(schedulerTask, "control", CONTROL_TASK_STACK, &controlScheduler,
+              CONTROL_TASK_PRIORITY, NULL);
+}
 
-  // If a time input is active, skip the rest of the loop(),
-  // so the serial output is not cluttered by other outputs.
-  if (serialTimeHelper.isWaitingForTimeInput()) {
-    // Optional: a small yield(), so WiFi/RTOS are happy
-    yield();
-    return;
+/// @brief Acquisition task: read the sensors and send new averages or a changed status to the
+/// control and the io task
+/// @return true if new averages were calculated
+static boolean sensorTask() {
+  LOOPPROF_SCOPE(PROF_SENSOR);
+  SensorParamMsg param;
+  while (paramToAcq.receive(param)) {
+    processSensorData.setDewPointDiffMin(param.dewPointDiffMin_K);
   }
 
   // DHT Sensor loop
@@ -124,63 +465,314 @@ void loop() {
   processSensorData.loop();
   // processSensorData.printBuffer();
 
-  // Control Fan loop
-  boolean turnFanOn, isVentUseFul;
+  // Uncomment this section, if you want the processor to reset after 30s without valid data
+  // A proably better way is to connect the sensor to a dedicated power pin and reset the sensor,
+  // see processSensorData.h -> #SENSORPWRRESET
+  /*
+  if(processSensorData.timeSinceAllDataWhereValid() > 30000) {
+    Serial.println("restarting!");
+    ESP.restart();
+  }
+  */
+
+  boolean newAverages = processSensorData.hasNewAverages();
+  VentilationUseFull ventilation = processSensorData.getVentilationUsefullStatus();
+  boolean sensorReset = processSensorData.isSensorResetInProgress();
+  if (!newAverages && ventilation == acqVentilation && sensorReset == acqSensorReset) {
+    return false;
+  }
+  acqVentilation = ventilation;
+  acqSensorReset = sensorReset;
+  SensorMsg msg;
+  createSensorMsg(msg, newAverages);
+  sensorToControl.send(msg);
+  sensorToIo.send(msg);
+  return newAverages;
+}
+
+/// @brief Control task: take the messages of the other tasks and publish the changes
+/// @return true if a message was taken
+static boolean controlRxTask() {
+  boolean received = false;
+  SensorMsg sensor;
+  while (sensorToControl.receive(sensor)) {
+    received = true;
+    AppEvent event;
+    if (sensor.ventilation != ctrlVentilation) {
+      ctrlVentilation = sensor.ventilation;
+      event.type = EV_VENTILATION_REASON_CHANGED;
+      event.ventilation = sensor.ventilation;
+      controlBus.publish(event);
+    }
+    if (sensor.newAverages) {
+      event.type = EV_NEW_AVERAGES;
+      event.sensor = &sensor;
+      controlBus.publish(event);
+    }
+  }
+
+  ControlCmdMsg cmd;
+  while (cmdToControl.receive(cmd)) {
+    received = true;
+    switch (cmd.cmd) {
+    case CMD_CLOCK:
+      ctrlMonth = cmd.month;
+      controlFan.setWeekHour(cmd.weekHour);
+      break;
+    case CMD_INCREMENT_SETPOINT:
+      controlFan.incrementUserSetpoint();
+      controlScheduler.trigger(fanTaskId);
+      break;
+    case CMD_ZIGBEE_RESET:
+      zigbeeSwitchHelper.reset(); // blocks the systems and reboots
+      break;
+    case CMD_SCHEDULE_EDIT:
+      controlFan.getSchedule().edit(cmd.rule.type, cmd.rule.days, cmd.rule.startHour,
+                                    cmd.rule.endHour);
+      controlFan.getSchedule().print();
+      controlScheduler.trigger(fanTaskId);
+      break;
+    case CMD_SCHEDULE_RESET:
+      controlFan.getSchedule().reset();
+      controlFan.getSchedule().print();
+      controlScheduler.trigger(fanTaskId);
+      break;
+    case CMD_SCHEDULE_PRINT:
+      controlFan.getSchedule().print();
+      break;
+    case CMD_TUNER_LOGGED:
+      if (cmd.tunerLogSeq == ctrlTunerLogTail && ctrlTunerLogTail != ctrlTunerLogHead) {
+        ctrlTunerLogTail++; // send the next line at once
+        controlScheduler.trigger(fanTaskId);
+      }
+      break;
+    }
+  }
+  return received;
+}
 
-  isVentUseFul = processSensorData.isVentilationUsefullStatus();
-  turnFanOn = controlFan.loop(isVentUseFul);
-  zigbeeSwitchHelper.setLightSetpoint(turnFanOn);
+/// @brief Control task: decide if the fan runs and which plugs of the group are switched on, send
+/// the state to the io task when it changed
+/// @return true if the fan or the plugs changed
+static boolean fanTask() {
+  LOOPPROF_SCOPE(PROF_FAN);
+  // every bound plug is one fan of the group, they are started one after another
+  controlFan.setFanGroupSize(zigbeeSwitchHelper.getBoundDeviceCount());
+  boolean wasOn = ctrlFanOn;
+  uint8_t oldMask = controlFan.getFanGroupMask();
+  ctrlFanOn = controlFan.loop(ctrlVentUseful);
+  uint8_t mask = controlFan.getFanGroupMask();
+  zigbeeSwitchHelper.setDeviceSetpoints(mask);
+  if (mask != oldMask) {
+    // send the new setpoints at once
+    controlScheduler.trigger(zigbeeTaskId);
+  }
 
-  // RTC loop
+  ControlMsg msg;
+  createControlMsg(msg);
+  if (isControlMsgNew(msg)) {
+    controlToIo.send(msg);
+    ctrlSentControl = msg;
+  }
+  return ctrlFanOn != wasOn || mask != oldMask;
+}
 
+/// @brief Control task: zigbee state machine, sends the setpoints to the plugs
+/// @return true if something is bound
+static boolean zigbeeTask() {
+  LOOPPROF_SCOPE(PROF_ZIGBEE);
+  return zigbeeSwitchHelper.loop();
+}
+
+/// @brief io task: write the tuner line of the last ControlMsg to the sd card, if it is new, and
+/// acknowledge it. The control task repeats the line until the acknowledgement arrives, so a line
+/// is retried while the sd card is busy or missing, and a line already written is only
+/// acknowledged again.
+static void logTunerAdjustment() {
+  if (!ioControl.hasTunerLog) {
+    return;
+  }
+  if (ioControl.tunerLogSeq > ioTunerLogNext) {
+    ioTunerLogNext = ioControl.tunerLogSeq; // the control task dropped older lines
+  }
+  if (ioControl.tunerLogSeq == ioTunerLogNext) {
+    char timestamp[TIMESTAMP_LENGTH];
+    rtcHelper.createTimeStampLogging(timestamp);
+    if (!sdHelper.writeLine(TUNERFILENAME, TUNER_CSV_HEADER, timestamp, ioControl.tunerLogStr)) {
+      return; // try again with the next ControlMsg
+    }
+    Serial.print("Tuner: ");
+    Serial.print(timestamp);
+    Serial.print(";");
+    Serial.println(ioControl.tunerLogStr);
+    ioTunerLogNext++;
+  }
+  ControlCmdMsg ack = {CMD_TUNER_LOGGED, 0, 0};
+  ack.tunerLogSeq = ioControl.tunerLogSeq;
+  cmdToControl.send(ack);
+}
+
+/// @brief io task: take the messages of the other tasks and publish the changes. Adjustments of
+/// the tuner are logged.
+/// @return true if a message was taken
+static boolean ioRxTask() {
+  boolean received = false;
+  AppEvent event;
+
+  ButtonMsg button;
+  while (buttonToIo.receive(button)) {
+    received = true;
+    onButton(button.event);
+  }
+
+  SensorMsg sensor;
+  while (sensorToIo.receive(sensor)) {
+    received = true;
+    boolean ventilationChanged = sensor.ventilation != ioSensor.ventilation;
+    ioSensor = sensor;
+    if (ventilationChanged) {
+      event.type = EV_VENTILATION_REASON_CHANGED;
+      event.ventilation = sensor.ventilation;
+      ioBus.publish(event);
+    }
+    if (sensor.newAverages) {
+      event.type = EV_NEW_AVERAGES;
+      event.sensor = &ioSensor;
+      ioBus.publish(event);
+    }
+  }
+
+  ControlMsg control;
+  while (controlToIo.receive(control)) {
+    received = true;
+    ControlMsg old = ioControl;
+    ioControl = control;
+    if (control.fanOn != old.fanOn) {
+      event.type = EV_FAN_STATE_CHANGED;
+      event.fanOn = control.fanOn;
+      ioBus.publish(event);
+    }
+    if (control.userSetpoint != old.userSetpoint) {
+      event.type = EV_MODE_CHANGED;
+      event.userSetpoint = control.userSetpoint;
+      ioBus.publish(event);
+    }
+    if (control.zigbeeReady != old.zigbeeReady || control.boundDevices != old.boundDevices) {
+      event.type = EV_ZIGBEE_BINDING_CHANGED;
+      event.zigbee.ready = control.zigbeeReady;
+      event.zigbee.boundDevices = control.boundDevices;
+      ioBus.publish(event);
+    }
+  }
+  if (received) {
+    logTunerAdjustment();
+  }
+  return received;
+}
+
+/// @brief io task: new log file every month, the month and the hour of the week for the control
+/// task
+/// @return true if the file name changed
+static boolean rtcTask() {
+  LOOPPROF_SCOPE(PROF_RTC);
   rtcHelper.loop();
-  if (rtcHelper.createFileName()) {
+  boolean newFile = rtcHelper.createFileName();
+  if (newFile) {
+    char fileName[RTC_FILENAMELENGTH];
     Serial.println("newFileName detected");
-    rtcHelper.getFileName(tmpFileName);
-    sdHelper.setFileName(tmpFileName);
+    rtcHelper.getFileName(fileName);
+    sdHelper.setFileName(fileName);
     sdHelper.writeCSVHeader();
     sdHelper.saveDataNow();
   }
+  uint8_t month = rtcHelper.getLocalMonth();
+  uint8_t weekHour = rtcHelper.getLocalWeekHour();
+  if (month != ioMonth || weekHour != ioWeekHour) {
+    ioMonth = month;
+    ioWeekHour = weekHour;
+    cmdToControl.send(ControlCmdMsg{CMD_CLOCK, month, weekHour});
+  }
+  return newFile;
+}
 
-  yield();
+/// @brief io task: write the data log, the samples, the summaries and the events
+/// @return true if something was written
+static boolean sdTask() {
+  LOOPPROF_SCOPE(PROF_SD);
+  boolean written = false;
+  char timestamp[TIMESTAMP_LENGTH];
+  sampleLog.loop();
 
   // SD loop
-  if (sdHelper.loop()) // check if it is time to write data to the sd card
-  {
+  boolean writeNow = sdHelper.loop(); // check if it is time to write data to the sd card
+  if (sdHelper.isSDinserted() != ioSdInserted) {
+    ioSdInserted = !ioSdInserted;
+    AppEvent event;
+    event.type = EV_SD_STATE_CHANGED;
+    event.sdInserted = ioSdInserted;
+    ioBus.publish(event);
+  }
+  if (writeNow) {
     // data should be updated and written!
-    rtcHelper.getFileName(tmpFileName);
-    sdHelper.setFileName(tmpFileName);
+    char fileName[RTC_FILENAMELENGTH];
+    rtcHelper.getFileName(fileName);
+    sdHelper.setFileName(fileName);
 
     rtcHelper.createTimeStampLogging(timestamp);
-    processSensorData.createLogChar(logStr);
-    controlFan.createLogChar(logCtrlStr);
+    sdHelper.writeData(timestamp, ioSensor.logStr, ioControl.logCtrlStr);
+    written = true;
+  }
 
-    sdHelper.writeData(timestamp, logStr, logCtrlStr);
+  // write the finished hours and days to the summary files, retry later if the card is missing
+  for (uint8_t period = 0; period < ROLLUP_PERIODS; period++) {
+    if (rollup.hasRow((RollupPeriods)period) && ioSdInserted) {
+      char rollupFileName[ROLLUP_FILENAMELENGTH];
+      char rollupDateStr[ROLLUP_DATE_LENGTH];
+      char rollupLogStr[ROLLUP_LOGSTR_LENGTH];
+      rollup.getFileName((RollupPeriods)period, rollupFileName);
+      rollup.createLogChar((RollupPeriods)period, rollupDateStr, rollupLogStr);
+      if (sdHelper.writeLine(rollupFileName, ROLLUP_CSV_HEADER, rollupDateStr, rollupLogStr)) {
+        rollup.rowWritten((RollupPeriods)period);
+        written = true;
+      }
+    }
   }
 
-  yield();
+  // log if a torn record was cut off the data log
+  if (sdHelper.hasRecoveryEvent()) {
+    char eventLogStr[EVENTLOGSTR_LENGTH];
+    rtcHelper.createTimeStampLogging(timestamp);
+    sdHelper.createRecoveryLogChar(eventLogStr);
+    sdHelper.writeLine(EVENTFILENAME, EVENT_CSV_HEADER, timestamp, eventLogStr);
+    written = true;
+  }
+  return written;
+}
 
-  // Check if a new screens needs to be drawn to the display
-  switch (dispHelper.loop()) {
+/// @brief io task: check if a new screen needs to be drawn to the display
+/// @return true if a screen was drawn
+static boolean dispTask() {
+  LOOPPROF_SCOPE(PROF_DISP);
+  char dateDispStr[DATE_LENGTH];
+  char timeDispStr[TIME_LENGTH];
+  DispHelperState page = dispHelper.loop();
+  switch (page) {
   case DISP_TIME:
-    controlFan.getModeCharacter(modeChar);
     rtcHelper.createTimeStampDispShort(dateDispStr, timeDispStr);
 
-    dispHelper.showTimeAndStatus(dateDispStr, timeDispStr, sdHelper.isSDinserted(),
-                                 zigbeeSwitchHelper.isReady(), versionStr, modeChar, turnFanOn);
+    dispHelper.showTimeAndStatus(dateDispStr, timeDispStr, ioSdInserted,
+                                 ioControl.zigbeeReady, versionStr, ioControl.modeChar,
+                                 ioControl.fanOn);
     break;
   case DISP_VERSION:
-    dispHelper.showVersion(sdHelper.isSDinserted(), zigbeeSwitchHelper.isReady(), versionStr);
+    dispHelper.showVersion(ioSdInserted, ioControl.zigbeeReady, versionStr);
     break;
   case DISP_TEMP:
-    controlFan.getModeCharacter(modeChar);
-
-    dispHelper.showTemp(processSensorData.getAverageMeasurements(true),
-                        processSensorData.getAverageMeasurements(false),
-                        processSensorData.getVentilationUsefullStatus(), modeChar, turnFanOn);
+    dispHelper.showTemp(ioSensor.inner, ioSensor.outer, ioSensor.ventilation, ioControl.modeChar,
+                        ioControl.fanOn);
     break;
   case DISP_MODE:
-    dispHelper.showMode(controlFan.getUserSetpoint());
+    dispHelper.showMode(ioControl.userSetpoint);
     break;
   case DISP_ZIGBEERESET:
     dispHelper.showZigBeeReset();
@@ -192,46 +784,58 @@ void loop() {
     // don't change display
     break;
   };
+  return page != DISP_NOTHING;
+}
 
-  yield();
+/// @brief io task: the following code is executed every 2s
+/// @return true if the sensor reset screen was requested
+static boolean statusTask() {
+  // Check if sensor reset is in progress and update display accordingly
+  if (ioSensor.sensorReset) {
+    dispHelper.showSpecificDisplay(DISP_SENSORRESET);
+  }
 
-  // Zigbee Loop
-  zigbeeSwitchHelper.loop();
+  // uncomment to see some status on the serial interface
+  /*
+  Serial.print(ioSensor.logStr);
+  Serial.print(" ");
+  Serial.println(ioControl.logCtrlStr);
+  */
+
+  // Uncomment to let the yellow LED blink...
+  /*
+  ledState == HIGH ? ledState = LOW : ledState = HIGH;
+  digitalWrite(LED_BUILTIN, ledState);
+   */
+  return ioSensor.sensorReset;
+}
 
-  yield();
+/// @brief io task: evaluate serial commands (e.g. "Z" for time distortion test)
+/// @return always false
+static boolean serialTask() {
+  LOOPPROF_SCOPE(PROF_SERIAL);
+  serialTimeHelper.handleSerial();
+  return false;
+}
 
-  // the following code is executed every 2s:
-  if (now - lastdebugTime >= 2000) {
-    lastdebugTime = now;
+void loop() {
+  // sample the time once, all helpers use it during this pass
+  timeService.tick();
 
-    // Check if sensor reset is in progress and update display accordingly
-    if (processSensorData.isSensorResetInProgress()) {
-      dispHelper.showSpecificDisplay(DISP_SENSORRESET);
-    }
+  // If a time input is active, skip the rest of the loop(),
+  // so the serial output is not cluttered by other outputs.
+  // The messages of the other tasks are still taken, so their mailboxes don't drop any.
+  if (serialTimeHelper.isWaitingForTimeInput()) {
+    serialTimeHelper.handleSerial();
+    ioRxTask();
+    // sleep a little, the input is typed by hand
+    ioScheduler.idle(TASK_SERIAL_MS);
+    return;
+  }
 
-    // Uncomment this section, if you want the processor to reset after 30s without valid data
-    // A proably better way is to connect the sensor to a dedicated power pin and reset the sensor,
-    // see processSensorData.h -> #SENSORPWRRESET
-    /*
-    if(processSensorData.timeSinceAllDataWhereValid() > 30000) {
-      Serial.println("restarting!");
-      ESP.restart();
-    }
-    */
-
-    // uncomment to see some status on the serial interface
-    /*
-    Serial.print(dateDispStr);
-    Serial.print(" ");
-    Serial.println(timeDispStr);
-    processSensorData.printStatus();
-    Serial.println(logCtrlStr);
-    */
-
-    // Uncomment to let the yellow LED blink...
-    /*
-    ledState == HIGH ? ledState = LOW : ledState = HIGH;
-    digitalWrite(LED_BUILTIN, ledState);
-     */
-  }
-}
\ No newline at end of file
+  // run the tasks of the io task, which are due, and sleep until the next one or a message
+  uint32_t nextDueMs = ioScheduler.dispatch();
+  ioScheduler.idle(nextDueMs);
+
+  yield();
+}
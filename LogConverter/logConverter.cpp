@@ -0,0 +1,152 @@
+// Convert the binary data log of the sd card to the CSV format, which the visualization reads.
+// With -e a CSV log is converted to the binary format, e.g. to compare the sizes.
+// With -v the sequence numbers and CRCs of a CSV log are checked.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logRecord.h"
+
+/// @brief binary -> CSV, the lines end with "\r\n" like the lines written by the firmware
+static int decodeFile(FILE *in, FILE *out, long *records) {
+  uint8_t fileHeader[LOGRECORD_FILEHEADER_SIZE];
+  if (fread(fileHeader, 1, sizeof(fileHeader), in) != sizeof(fileHeader) ||
+      !logRecordCheckFileHeader(fileHeader)) {
+    fprintf(stderr, "no binary log of version %d\n", LOGRECORD_VERSION);
+    return 1;
+  }
+  uint8_t record[LOGRECORD_SIZE];
+  char line[LOGRECORD_CSVLINE_LENGTH];
+  size_t n;
+  while ((n = fread(record, 1, sizeof(record), in)) == sizeof(record)) {
+    logRecordDecode(record, line, sizeof(line));
+    fprintf(out, "%s\r\n", line);
+    (*records)++;
+  }
+  if (n != 0) {
+    fprintf(stderr, "incomplete record at the end ignored (%zu bytes)\n", n);
+  }
+  return 0;
+}
+
+/// @brief CSV -> binary. Every line is split into the date, the sensor and the control part.
+static int encodeFile(FILE *in, FILE *out, long *records) {
+  uint8_t fileHeader[LOGRECORD_FILEHEADER_SIZE];
+  logRecordFileHeader(fileHeader);
+  fwrite(fileHeader, 1, sizeof(fileHeader), out);
+
+  uint8_t record[LOGRECORD_SIZE];
+  char line[256];
+  long lineNr = 0;
+  int errors = 0;
+  while (fgets(line, sizeof(line), in)) {
+    lineNr++;
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == 0) {
+      continue;
+    }
+    if (strcmp(line, LOGRECORD_CSV_HEADER) == 0) {
+      logRecordEncodeHeader(record);
+    } else {
+      // date;8 sensor values;4 control values
+      char *tempStr = strchr(line, ';');
+      char *controlStr = tempStr;
+      for (int i = 0; i < 8 && controlStr; i++) {
+        controlStr = strchr(controlStr + 1, ';');
+      }
+      if (!controlStr) {
+        fprintf(stderr, "line %ld: wrong number of columns\n", lineNr);
+        errors++;
+        continue;
+      }
+      *tempStr++ = 0;
+      *controlStr++ = 0;
+      if (!logRecordEncode(line, tempStr, controlStr, record)) {
+        fprintf(stderr, "line %ld: can't be stored binary\n", lineNr);
+        errors++;
+        continue;
+      }
+    }
+    fwrite(record, 1, sizeof(record), out);
+    (*records)++;
+  }
+  return errors ? 1 : 0;
+}
+
+/// @brief check the CRC and the sequence numbers of every line of a CSV log
+static int verifyFile(FILE *in, long *records) {
+  char line[256];
+  long lineNr = 0;
+  int errors = 0;
+  uint32_t seq, lastSeq = 0;
+  bool hasSeq = false;
+  while (fgets(line, sizeof(line), in)) {
+    lineNr++;
+    size_t len = strcspn(line, "\r\n");
+    seq = UINT32_MAX;
+    if (!logRecordCsvCheckLine(line, len, &seq)) {
+      fprintf(stderr, "line %ld: torn or wrong CRC\n", lineNr);
+      errors++;
+      continue;
+    }
+    if (seq != UINT32_MAX) {
+      if (hasSeq && seq != lastSeq + 1) {
+        fprintf(stderr, "line %ld: sequence %lu after %lu\n", lineNr, (unsigned long)seq,
+                (unsigned long)lastSeq);
+      }
+      lastSeq = seq;
+      hasSeq = true;
+    }
+    (*records)++;
+  }
+  fprintf(stderr, "%ld valid lines, %d errors\n", *records, errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  bool encode = argc > 1 && strcmp(argv[1], "-e") == 0;
+  bool verify = argc > 1 && strcmp(argv[1], "-v") == 0;
+  int first = (encode || verify) ? 2 : 1;
+  if (argc < first + 1 || argc > first + 2) {
+    fprintf(stderr,
+            "usage: %s [-e|-v] input [output]\n"
+            "  binary log -> CSV, with -e CSV -> binary log. Output to stdout by default\n"
+            "  -v: check the sequence numbers and CRCs of a CSV log\n",
+            argv[0]);
+    return 2;
+  }
+  FILE *in = fopen(argv[first], "rb");
+  if (!in) {
+    perror(argv[first]);
+    return 2;
+  }
+  if (verify) {
+    long records = 0;
+    int result = verifyFile(in, &records);
+    fclose(in);
+    return result;
+  }
+  FILE *out = argc > first + 1 ? fopen(argv[first + 1], "wb") : stdout;
+  if (!out) {
+    perror(argv[first + 1]);
+    return 2;
+  }
+
+  long records = 0;
+  int result = encode ? encodeFile(in, out, &records) : decodeFile(in, out, &records);
+  long inBytes = ftell(in);
+  long outBytes = ftell(out);
+  fclose(in);
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  // sizes of both formats
+  long binBytes = encode ? outBytes : inBytes;
+  long csvBytes = encode ? inBytes : outBytes;
+  if (csvBytes > 0 && binBytes >= 0) {
+    fprintf(stderr, "%ld records, binary %ld bytes, csv %ld bytes (%.0f %%)\n", records, binBytes,
+            csvBytes, 100.0 * binBytes / csvBytes);
+  }
+  return result;
+}
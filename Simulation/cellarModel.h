@@ -0,0 +1,107 @@
+// cellarModel.h
+// Moisture and temperature model of a cellar room for closed loop simulations.
+//
+// Indoor air (absolute humidity x_i in g/m^3) per hour:
+//   dx_i/dt = (nInf + nFan * fan) * (x_o - x_i) + kWall * (w - x_i) + source
+//   dw/dt   = kWall / wallCapacity * (x_i - w)
+// w is the moisture of a buffer layer of the walls, given as the absolute humidity of the air in
+// equilibrium with it. wallCapacity is the moisture capacity of this layer relative to the room
+// air.
+//
+// Indoor temperature per hour:
+//   dT_i/dt = (tInf + tFan * fan) * (T_o - T_i) + tGround * (groundTemp - T_i)
+
+#pragma once
+
+#include <cmath>
+
+/// @brief saturation vapour pressure over water (Magnus formula)
+/// @param temp temperature in degC
+/// @return pressure in hPa
+inline double saturationPressure(double temp) {
+  return 6.112 * exp(17.62 * temp / (243.12 + temp));
+}
+
+/// @brief absolute humidity of air
+/// @param temp temperature in degC
+/// @param relHum relative humidity in %
+/// @return absolute humidity in g/m^3
+inline double absoluteHumidity(double temp, double relHum) {
+  return 216.7 * (relHum / 100.0 * saturationPressure(temp)) / (273.15 + temp);
+}
+
+/// @brief relative humidity of air, limited to 100 %
+/// @param temp temperature in degC
+/// @param absHum absolute humidity in g/m^3
+/// @return relative humidity in %
+inline double relativeHumidity(double temp, double absHum) {
+  double relHum = 100.0 * absHum * (273.15 + temp) / (216.7 * saturationPressure(temp));
+  return relHum > 100.0 ? 100.0 : relHum;
+}
+
+/// @brief dew point of air (Magnus formula)
+/// @param temp temperature in degC
+/// @param relHum relative humidity in %
+/// @return dew point in degC
+inline double dewPoint(double temp, double relHum) {
+  double gamma = log(relHum / 100.0) + 17.62 * temp / (243.12 + temp);
+  return 243.12 * gamma / (17.62 - gamma);
+}
+
+typedef struct {
+  double nInf;         // air exchange by infiltration in 1/h
+  double nFan;         // additional air exchange while the fan runs in 1/h
+  double kWall;        // exchange between room air and wall buffer in 1/h
+  double wallCapacity; // moisture capacity of the wall buffer relative to the room air
+  double source;       // moisture source (e.g. ground) in g/m^3/h
+  double tInf;         // temperature exchange with outside air in 1/h
+  double tFan;         // additional temperature exchange while the fan runs in 1/h
+  double tGround;      // temperature exchange with ground/building in 1/h
+  double groundTemp;   // temperature of ground/building in degC
+} CellarParameters;
+
+/// @brief CellarModel class to simulate the indoor climate of the cellar depending on the outdoor
+/// climate and the fan.
+class CellarModel {
+public:
+  CellarModel(const CellarParameters &parameters) : p(parameters), tempI(15), absHumI(10), wall(10) {}
+
+  /// @brief set the indoor state, the wall buffer starts in equilibrium with the air
+  void init(double temp, double relHum) {
+    tempI = temp;
+    absHumI = absoluteHumidity(temp, relHum);
+    wall = absHumI;
+  }
+
+  /// @brief advance the model by one time step (explicit Euler)
+  /// @param dt_h time step in hours, should be much smaller than 1/(nInf+nFan)
+  void step(double dt_h, double tempO, double relHumO, bool fanOn) {
+    double absHumO = absoluteHumidity(tempO, relHumO);
+    double exchange = p.nInf + (fanOn ? p.nFan : 0.0);
+    double toWall = p.kWall * (wall - absHumI);
+    absHumI += dt_h * (exchange * (absHumO - absHumI) + toWall + p.source);
+    wall -= dt_h * toWall / p.wallCapacity;
+    // condensation: the air can't hold more than saturation
+    double absHumMax = absoluteHumidity(tempI, 100.0);
+    absHumI = absHumI > absHumMax ? absHumMax : absHumI;
+
+    double tExchange = p.tInf + (fanOn ? p.tFan : 0.0);
+    tempI += dt_h * (tExchange * (tempO - tempI) + p.tGround * (p.groundTemp - tempI));
+  }
+
+  double getTemperature() const {
+    return tempI;
+  }
+  double getRelativeHumidity() const {
+    return relativeHumidity(tempI, absHumI);
+  }
+  double getAbsoluteHumidity() const {
+    return absHumI;
+  }
+
+private:
+  CellarParameters p;
+  double tempI;   // indoor temperature in degC
+  double absHumI; // indoor absolute humidity in g/m^3
+  double wall;    // wall buffer as absolute humidity in g/m^3
+};
@@ -0,0 +1,365 @@
+// cellarSim.cpp
+// Closed loop simulation of the dew point ventilation: The real ProcessSensorData and ControlFan
+// code of the firmware is coupled to the CellarModel, whose parameters are fitted from the logged
+// CSV files of the sd card. The outdoor climate is replayed from the logs, the indoor climate is
+// simulated depending on the fan.
+//
+// Build (from this folder):
+//   g++ -std=c++17 -O2 -I shim -I ../DewPointFan/lib/processSensorData -I
+//   ../DewPointFan/lib/ControlFan -I ../DewPointFan/lib/MoistureModel -I
+//   ../DewPointFan/lib/TimeService cellarSim.cpp ../DewPointFan/lib/processSensorData/*.cpp
+//   ../DewPointFan/lib/ControlFan/*.cpp ../DewPointFan/lib/MoistureModel/*.cpp
+//   ../DewPointFan/lib/TimeService/*.cpp -o cellarSim
+// Usage:
+//   ./cellarSim [-r years] 2024-01.csv 2024-02.csv ...
+
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include "Arduino.h"
+#include "DHTesp.h"
+
+#include "processSensorData.h"
+#include "controlFan.h"
+#include "moistureModel.h"
+#include "timeService.h"
+
+#include "cellarModel.h"
+
+// simulation step of the firmware loop
+#define SIM_STEP_MS 1000
+
+// only log rows closer than this are used to fit the model
+#define FIT_MAX_GAP_H 0.25
+
+// time constant of the wall buffer estimation for the fit
+#define FIT_WALL_TAU_H 24.0
+
+// default moisture capacity of the wall buffer relative to the room air
+#define WALL_CAPACITY 20.0
+
+/* ===== stand-ins for the Arduino and DHT functions ===== */
+
+SimSerial Serial;
+// 32 bits like millis() of the ESP32, so it rolls over after 49.7 days of simulated time
+static uint32_t simMillis = 0;
+static TempAndHumidity simSensors[8];
+
+unsigned long millis() {
+  return simMillis;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+void simSetSensor(uint8_t pin, float temperature, float humidity) {
+  simSensors[pin % 8] = {temperature, humidity};
+}
+
+TempAndHumidity simGetSensor(uint8_t pin) {
+  return simSensors[pin % 8];
+}
+
+/* ===== logged data ===== */
+
+typedef struct {
+  double time_h; // hours since 1970
+  double tempI, tempO, humI, humO;
+  bool fanOn;
+} LogRow;
+
+/// @brief days since 1970-01-01 of a civil date
+static long daysFromCivil(int y, int m, int d) {
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  long yoe = y - era * 400;
+  long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/// @brief read one CSV file of the data logger, header and invalid rows are skipped
+static void readLogFile(const char *fileName, std::vector<LogRow> &rows) {
+  FILE *f = fopen(fileName, "r");
+  if (!f) {
+    fprintf(stderr, "can't open %s\n", fileName);
+    return;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    int y, mo, d, h, mi, s;
+    float tI, tO, hI, hO, dpI, dpO;
+    unsigned vI, vO, fan;
+    if (sscanf(line, "%d-%d-%d %d:%d:%d;%f;%f;%f;%f;%f;%f;%u;%u;f%u", &y, &mo, &d, &h, &mi, &s,
+               &tI, &tO, &hI, &hO, &dpI, &dpO, &vI, &vO, &fan) != 15) {
+      continue; // header or broken row
+    }
+    if (vI == 0 || vO == 0 || y < 2020) {
+      continue; // no valid measurement or no valid time
+    }
+    LogRow row;
+    row.time_h = daysFromCivil(y, mo, d) * 24.0 + h + mi / 60.0 + s / 3600.0;
+    row.tempI = tI;
+    row.tempO = tO;
+    row.humI = hI;
+    row.humO = hO;
+    row.fanOn = fan == 1;
+    rows.push_back(row);
+  }
+  fclose(f);
+}
+
+/* ===== fit ===== */
+
+#define FIT_N 4
+
+/// @brief least squares fit of y = sum(c_j * x_j) via the normal equations
+/// @return false if the equations are singular
+static bool leastSquares(const std::vector<std::vector<double>> &x, const std::vector<double> &y,
+                         double c[FIT_N]) {
+  double a[FIT_N][FIT_N + 1] = {};
+  for (size_t k = 0; k < y.size(); k++) {
+    for (int i = 0; i < FIT_N; i++) {
+      for (int j = 0; j < FIT_N; j++) {
+        a[i][j] += x[k][i] * x[k][j];
+      }
+      a[i][FIT_N] += x[k][i] * y[k];
+    }
+  }
+  // gaussian elimination with partial pivoting
+  for (int i = 0; i < FIT_N; i++) {
+    int pivot = i;
+    for (int r = i + 1; r < FIT_N; r++) {
+      if (fabs(a[r][i]) > fabs(a[pivot][i])) {
+        pivot = r;
+      }
+    }
+    if (fabs(a[pivot][i]) < 1e-12) {
+      return false;
+    }
+    for (int j = 0; j <= FIT_N; j++) {
+      std::swap(a[i][j], a[pivot][j]);
+    }
+    for (int r = 0; r < FIT_N; r++) {
+      if (r == i) {
+        continue;
+      }
+      double factor = a[r][i] / a[i][i];
+      for (int j = i; j <= FIT_N; j++) {
+        a[r][j] -= factor * a[i][j];
+      }
+    }
+  }
+  for (int i = 0; i < FIT_N; i++) {
+    c[i] = a[i][FIT_N] / a[i][i];
+  }
+  return true;
+}
+
+/// @brief fit the model parameters to the logged data by a one step prediction
+static CellarParameters fitParameters(const std::vector<LogRow> &rows, double wallCapacity) {
+  CellarParameters p = {0.05, 1.0, 0.1, wallCapacity, 0.0, 0.02, 0.5, 0.05, 12.0};
+  std::vector<std::vector<double>> xHum, xTemp;
+  std::vector<double> yHum, yTemp;
+  double wall = absoluteHumidity(rows[0].tempI, rows[0].humI);
+
+  for (size_t k = 0; k + 1 < rows.size(); k++) {
+    const LogRow &r = rows[k];
+    const LogRow &n = rows[k + 1];
+    double dt = n.time_h - r.time_h;
+    double absI = absoluteHumidity(r.tempI, r.humI);
+    double absO = absoluteHumidity(r.tempO, r.humO);
+    if (dt <= 0 || dt > FIT_MAX_GAP_H) {
+      wall = absI;
+      continue;
+    }
+    double fan = r.fanOn ? 1.0 : 0.0;
+
+    xHum.push_back({absO - absI, fan * (absO - absI), wall - absI, 1.0});
+    yHum.push_back((absoluteHumidity(n.tempI, n.humI) - absI) / dt);
+
+    xTemp.push_back({r.tempO - r.tempI, fan * (r.tempO - r.tempI), -r.tempI, 1.0});
+    yTemp.push_back((n.tempI - r.tempI) / dt);
+
+    wall += (absI - wall) * dt / FIT_WALL_TAU_H;
+  }
+
+  double c[FIT_N];
+  if (yHum.size() > 10 * FIT_N && leastSquares(xHum, yHum, c)) {
+    p.nInf = max(c[0], 0.01);
+    p.nFan = max(c[1], 0.0);
+    p.kWall = max(c[2], 0.0);
+    p.source = c[3];
+  } else {
+    fprintf(stderr, "moisture fit failed, using defaults\n");
+  }
+  if (yTemp.size() > 10 * FIT_N && leastSquares(xTemp, yTemp, c) && c[2] > 1e-3) {
+    p.tInf = max(c[0], 0.0);
+    p.tFan = max(c[1], 0.0);
+    p.tGround = c[2];
+    p.groundTemp = c[3] / c[2];
+  } else {
+    fprintf(stderr, "temperature fit failed, using defaults\n");
+  }
+  return p;
+}
+
+/* ===== closed loop simulation ===== */
+
+enum Strategy { STRAT_REPLAY, STRAT_AUTO, STRAT_MODEL, STRAT_ON, STRAT_OFF, STRAT_CNT };
+static const char *strategyNames[STRAT_CNT] = {"replay", "auto", "model", "on", "off"};
+
+// static storage like on the device, so all members start with zero
+static ProcessSensorData processSensorData[STRAT_CNT];
+static ControlFan controlFan[STRAT_CNT];
+static MoistureModel moistureModel[STRAT_CNT];
+
+typedef struct {
+  double fanHours;
+  unsigned long fanStarts;
+  double meanDewPointI;
+  double meanRelHumI;
+  double hoursAbove70;
+  double rmseAbsHum; // replay only: deviation of the model from the logged indoor humidity
+  double modelFanEffect; // learned MoistureModel parameters at the end
+  double modelDrift;
+} SimResult;
+
+/// @brief Simulate the cellar with the given strategy. The outdoor climate is interpolated from the
+/// logged rows, which are repeated for the given number of years.
+static SimResult simulate(Strategy strategy, const std::vector<LogRow> &rows,
+                          const CellarParameters &p, int years) {
+  SimResult res = {};
+  CellarModel cellar(p);
+  cellar.init(rows[0].tempI, rows[0].humI);
+  ProcessSensorData &sensors = processSensorData[strategy];
+  ControlFan &fan = controlFan[strategy];
+  MoistureModel &model = moistureModel[strategy];
+  // every strategy starts like a reset device
+  simMillis = 0;
+  timeService.setSource(millis);
+  timeService.tick();
+  sensors.init();
+  fan.init();
+  model.init();
+  fan.setFanGroupSize(1);
+  // the device starts in AUTO: one click -> ON, two clicks -> OFF
+  if (strategy == STRAT_ON) {
+    fan.incrementUserSetpoint();
+  } else if (strategy == STRAT_OFF) {
+    fan.incrementUserSetpoint();
+    fan.incrementUserSetpoint();
+  }
+
+  const double dt_h = SIM_STEP_MS / 3600000.0;
+  double simHours = 0;
+  double sqErr = 0;
+  unsigned long errCnt = 0;
+  bool wasOn = false;
+  for (int year = 0; year < years; year++) {
+    size_t k = 0;
+    for (double t = rows.front().time_h; t < rows.back().time_h; t += dt_h) {
+      while (rows[k + 1].time_h <= t) {
+        k++;
+        if (strategy != STRAT_REPLAY) {
+          continue;
+        }
+        if (rows[k].time_h - rows[k - 1].time_h > FIT_MAX_GAP_H) {
+          // the model didn't run during the gap, it starts again from the log
+          cellar.init(rows[k].tempI, rows[k].humI);
+          continue;
+        }
+        double e = cellar.getAbsoluteHumidity() - absoluteHumidity(rows[k].tempI, rows[k].humI);
+        sqErr += e * e;
+        errCnt++;
+      }
+      const LogRow &r = rows[k];
+      const LogRow &n = rows[k + 1];
+      if (n.time_h - r.time_h > FIT_MAX_GAP_H) {
+        continue; // gap in the log: no outdoor climate known
+      }
+      double a = (t - r.time_h) / (n.time_h - r.time_h);
+      double tempO = r.tempO + a * (n.tempO - r.tempO);
+      double humO = r.humO + a * (n.humO - r.humO);
+
+      simSetSensor(DHTPINO, tempO, humO);
+      simSetSensor(DHTPINI, cellar.getTemperature(), cellar.getRelativeHumidity());
+      timeService.tick();
+      sensors.loop();
+      if (sensors.hasNewAverages()) {
+        // the model learns in all strategies, but only ends runs in STRAT_MODEL
+        AvgMeasurement inner = sensors.getAverageMeasurements(true);
+        AvgMeasurement outer = sensors.getAverageMeasurements(false);
+        model.update(inner, outer, wasOn);
+        if (strategy == STRAT_MODEL) {
+          fan.setRunPaysOff(model.isRunPayingOff(inner, outer));
+        }
+      }
+      bool fanOn = fan.loop(sensors.isVentilationUsefullStatus());
+      if (strategy == STRAT_REPLAY) {
+        fanOn = r.fanOn;
+      }
+      cellar.step(dt_h, tempO, humO, fanOn);
+      simAdvanceMillis(SIM_STEP_MS);
+
+      double relHumI = cellar.getRelativeHumidity();
+      simHours += dt_h;
+      res.fanHours += fanOn ? dt_h : 0;
+      res.fanStarts += (fanOn && !wasOn) ? 1 : 0;
+      res.meanDewPointI += dewPoint(cellar.getTemperature(), relHumI) * dt_h;
+      res.meanRelHumI += relHumI * dt_h;
+      res.hoursAbove70 += (relHumI > 70.0) ? dt_h : 0;
+      wasOn = fanOn;
+    }
+  }
+  res.meanDewPointI /= simHours;
+  res.meanRelHumI /= simHours;
+  res.rmseAbsHum = errCnt ? sqrt(sqErr / errCnt) : NAN;
+  res.modelFanEffect = model.getFanEffect();
+  res.modelDrift = model.getDrift();
+  return res;
+}
+
+int main(int argc, char **argv) {
+  int years = 1;
+  double wallCapacity = WALL_CAPACITY;
+  std::vector<LogRow> rows;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      years = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      wallCapacity = atof(argv[++i]);
+    } else {
+      readLogFile(argv[i], rows);
+    }
+  }
+  if (rows.size() < 100) {
+    fprintf(stderr, "usage: cellarSim [-r repeat] [-w wallCapacity] log.csv ...\n");
+    fprintf(stderr, "not enough valid rows in the log files\n");
+    return 1;
+  }
+  std::sort(rows.begin(), rows.end(),
+            [](const LogRow &a, const LogRow &b) { return a.time_h < b.time_h; });
+
+  CellarParameters p = fitParameters(rows, wallCapacity);
+  printf("rows: %zu, %.1f days\n", rows.size(), (rows.back().time_h - rows.front().time_h) / 24);
+  printf("moisture:    nInf %.3f/h nFan %.3f/h kWall %.3f/h capacity %.1f source %.3f g/m3/h\n",
+         p.nInf, p.nFan, p.kWall, p.wallCapacity, p.source);
+  printf("temperature: tInf %.3f/h tFan %.3f/h tGround %.3f/h ground %.1f C\n", p.tInf, p.tFan,
+         p.tGround, p.groundTemp);
+
+  clock_t start = clock();
+  printf("%-8s %10s %8s %10s %10s %12s %10s %10s %10s\n", "strategy", "fan [h]", "starts",
+         "DP_i [C]", "H_i [%]", "H_i>70% [h]", "rmse g/m3", "a [1/min]", "b [K/min]");
+  for (int s = 0; s < STRAT_CNT; s++) {
+    SimResult res = simulate((Strategy)s, rows, p, years);
+    printf("%-8s %10.1f %8lu %10.2f %10.1f %12.1f %10.3f %10.4f %10.4f\n", strategyNames[s],
+           res.fanHours, res.fanStarts, res.meanDewPointI, res.meanRelHumI, res.hoursAbove70,
+           res.rmseAbsHum, res.modelFanEffect, res.modelDrift);
+  }
+  printf("simulated in %.1f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+  return 0;
+}
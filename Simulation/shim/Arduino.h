@@ -0,0 +1,74 @@
+// Host stand-in for the few Arduino functions used by ProcessSensorData and ControlFan.
+// The simulation drives the clock with simAdvanceMillis(), the host tests in ../test define
+// millis() themselves.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+typedef bool boolean;
+
+using std::isnan;
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define HEX 16
+
+class __FlashStringHelper;
+#define F(x) ((const __FlashStringHelper *)(x))
+
+// pins of the XIAO ESP32-C6, only used as ids by the DHT stand-in
+#define D0 0
+#define D1 1
+#define D2 2
+#define D3 3
+#define D7 7
+
+template <typename T> T constrain(T x, T low, T high) {
+  return x < low ? low : (x > high ? high : x);
+}
+
+unsigned long millis();
+unsigned long micros();
+void simAdvanceMillis(unsigned long ms);
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) {
+  return LOW;
+}
+inline void delay(unsigned long) {}
+
+/// @brief ESP stand-in, a restart ends the host program
+class EspClass {
+public:
+  void restart() {
+    std::exit(1);
+  }
+};
+
+inline EspClass ESP;
+
+/// @brief Serial stand-in, the firmware debug output is dropped in the simulation
+class SimSerial {
+public:
+  template <typename T> void print(T) {}
+  template <typename T> void print(T, int) {}
+  template <typename T> void println(T) {}
+  template <typename T> void println(T, int) {}
+  void println() {}
+  template <typename... T> void printf(const char *, T...) {}
+};
+
+extern SimSerial Serial;
+
+#include "FreeRTOS.h"
@@ -0,0 +1,54 @@
+// Host stand-in for rlogiacco/CircularBuffer with the subset used by ProcessSensorData.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t S> class CircularBuffer {
+public:
+  typedef uint8_t index_t;
+
+  /// @brief add an element at the end, the oldest one is dropped if the buffer is full
+  /// @return false if an element was overwritten
+  bool push(T value) {
+    if (count == S) {
+      head = (head + 1) % S;
+      buffer[(head + count - 1) % S] = value;
+      return false;
+    }
+    buffer[(head + count) % S] = value;
+    count++;
+    return true;
+  }
+
+  T operator[](index_t index) const {
+    return buffer[(head + index) % S];
+  }
+
+  T last() const {
+    return buffer[(head + count - 1) % S];
+  }
+
+  index_t size() const {
+    return count;
+  }
+  index_t available() const {
+    return S - count;
+  }
+  bool isEmpty() const {
+    return count == 0;
+  }
+  bool isFull() const {
+    return count == S;
+  }
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+
+private:
+  T buffer[S];
+  index_t head = 0;
+  index_t count = 0;
+};
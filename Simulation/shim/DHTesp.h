@@ -0,0 +1,43 @@
+// Host stand-in for the DHTesp library. The values of each sensor are set by the simulation with
+// simSetSensor() and returned by getTempAndHumidity().
+
+#pragma once
+
+#include "Arduino.h"
+
+typedef struct {
+  float temperature;
+  float humidity;
+} TempAndHumidity;
+
+void simSetSensor(uint8_t pin, float temperature, float humidity);
+TempAndHumidity simGetSensor(uint8_t pin);
+
+class DHTesp {
+public:
+  enum DHT_MODEL_t { AUTO_DETECT, DHT11, DHT22, AM2302, RHT03 };
+
+  void setup(uint8_t dhtPin, DHT_MODEL_t model) {
+    pin = dhtPin;
+  }
+
+  TempAndHumidity getTempAndHumidity() {
+    return simGetSensor(pin);
+  }
+
+  /// @brief same formula as DHTesp::computeDewPoint() (not the fast one)
+  float computeDewPoint(float temperature, float percentHumidity, bool isFahrenheit = false) {
+    double A0 = 373.15 / (273.15 + (double)temperature);
+    double SUM = -7.90298 * (A0 - 1);
+    SUM += 5.02808 * log10(A0);
+    SUM += -1.3816e-7 * (pow(10, (11.344 * (1 - 1 / A0))) - 1);
+    SUM += 8.1328e-3 * (pow(10, (-3.49149 * (A0 - 1))) - 1);
+    SUM += log10(1013.246);
+    double VP = pow(10, SUM - 3) * (double)percentHumidity;
+    double T = log(VP / 0.61078);
+    return (241.88 * T) / (17.558 - T);
+  }
+
+private:
+  uint8_t pin = 0;
+};
@@ -0,0 +1,299 @@
+// Host stand-in for the file system of the Arduino core (fs::FS and fs::File) with the subset used
+// by the SDHelper. Each volume (SD card, SPIFFS) is a SimFs, which keeps its files in memory.
+//
+// Faults and costs of a real card can be simulated per volume:
+// - writeBudget: bytes which can still be written, then every write stops short like at a power
+//   loss or an I/O error. When it is used up, files can't be truncated either. -1: no limit. A test
+//   may change it while a writer task writes.
+// - writeCallUs and writeByteNs: duration of one write or flush and of each byte. The durations
+//   are added to simFsMicros, which micros() of a test can return.
+// - clusterAllocUs: duration to allocate a cluster of clusterBytes, when a write makes a file
+//   longer than its clusters, like the search of a free cluster and the update of the FAT.
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// time spent in the simulated file systems in us
+inline uint64_t simFsMicros = 0;
+
+class File;
+
+/// @brief one volume of files in memory
+class SimFs {
+public:
+  std::atomic<long> writeBudget{-1};
+  uint32_t writeCallUs = 0;
+  uint32_t writeByteNs = 0;
+  uint32_t writeCalls = 0; // number of writes since the start
+  uint32_t clusterBytes = 32768;
+  uint32_t clusterAllocUs = 0;
+  uint32_t clusterAllocs = 0; // number of allocated clusters since the start
+
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  std::set<std::string> dirs = {"/"};
+
+  File open(const char *path, const char *mode = FILE_READ);
+
+  bool exists(const char *path) {
+    return files.count(path) > 0 || dirs.count(path) > 0;
+  }
+
+  bool mkdir(const char *path) {
+    if (!dirs.count(parent(path))) {
+      return false;
+    }
+    dirs.insert(path);
+    return true;
+  }
+
+  bool rmdir(const char *path) {
+    std::string dir = std::string(path) + "/";
+    for (const auto &file : files) {
+      if (file.first.compare(0, dir.size(), dir) == 0) {
+        return false; // not empty
+      }
+    }
+    return dirs.erase(path) > 0;
+  }
+
+  bool remove(const char *path) {
+    return files.erase(path) > 0;
+  }
+
+  bool rename(const char *from, const char *to) {
+    auto it = files.find(from);
+    if (it == files.end() || !dirs.count(parent(to))) {
+      return false;
+    }
+    files[to] = it->second;
+    files.erase(it);
+    return true;
+  }
+
+  bool truncate(const char *path, size_t len) {
+    auto it = files.find(path);
+    if (it == files.end() || writeBudget == 0) {
+      return false;
+    }
+    it->second->resize(len);
+    return true;
+  }
+
+  uint64_t usedBytes() {
+    uint64_t used = 0;
+    for (const auto &file : files) {
+      used += file.second->size();
+    }
+    return used;
+  }
+
+  /// @brief content of a file, empty if there is none
+  std::string content(const char *path) {
+    auto it = files.find(path);
+    return it == files.end() ? std::string() : std::string(it->second->begin(), it->second->end());
+  }
+
+  /// @brief the writer asks to write len bytes, how many get through?
+  size_t allowWrite(size_t len) {
+    writeCalls++;
+    long budget = writeBudget;
+    if (budget >= 0) {
+      len = min(len, (size_t)budget);
+      writeBudget -= (long)len;
+    }
+    simFsMicros += writeCallUs + (uint64_t)len * writeByteNs / 1000;
+    return len;
+  }
+
+  /// @brief a file grows from size to newSize, allocate its new clusters
+  void allocate(size_t size, size_t newSize) {
+    size_t clusters =
+        (newSize + clusterBytes - 1) / clusterBytes - (size + clusterBytes - 1) / clusterBytes;
+    clusterAllocs += clusters;
+    simFsMicros += (uint64_t)clusters * clusterAllocUs;
+  }
+
+  static std::string parent(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == 0 ? "/" : path.substr(0, slash);
+  }
+};
+
+/// @brief open file or directory of a SimFs
+class File {
+public:
+  File() : fs(nullptr), pos(0), readable(false), writable(false), append(false), dirIdx(0) {}
+
+  explicit operator bool() const {
+    return fs != nullptr;
+  }
+
+  size_t write(const uint8_t *buf, size_t len) {
+    if (!writable) {
+      return 0;
+    }
+    len = fs->allowWrite(len);
+    if (append) {
+      pos = data->size();
+    }
+    if (pos + len > data->size()) {
+      fs->allocate(data->size(), pos + len);
+      data->resize(pos + len);
+    }
+    memcpy(data->data() + pos, buf, len);
+    pos += len;
+    return len;
+  }
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  size_t print(const char *str) {
+    return write((const uint8_t *)str, strlen(str));
+  }
+  size_t print(const __FlashStringHelper *str) {
+    return print((const char *)str);
+  }
+  size_t println(const char *str) {
+    return print(str) + println();
+  }
+  size_t println(const __FlashStringHelper *str) {
+    return println((const char *)str);
+  }
+  size_t println() {
+    return print("\r\n");
+  }
+
+  void flush() {
+    if (writable) {
+      simFsMicros += fs->writeCallUs;
+    }
+  }
+
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    if (!readable) {
+      return 0;
+    }
+    len = min(len, data->size() - min(pos, data->size()));
+    memcpy(buf, data->data() + pos, len);
+    pos += len;
+    return len;
+  }
+  int available() {
+    return (readable && pos < data->size()) ? data->size() - pos : 0;
+  }
+  size_t readBytesUntil(char terminator, char *buf, size_t len) {
+    size_t n = 0;
+    int c;
+    while (n < len && (c = read()) >= 0 && c != terminator) {
+      buf[n++] = c;
+    }
+    return n;
+  }
+
+  bool seek(size_t position) {
+    if (data == nullptr) {
+      return false;
+    }
+    pos = position;
+    return true;
+  }
+  size_t position() {
+    return pos;
+  }
+  size_t size() {
+    return data != nullptr ? data->size() : 0;
+  }
+
+  void close() {
+    fs = nullptr;
+    data = nullptr;
+  }
+
+  /// @brief name of the file without the directory, like the Arduino core since version 2
+  const char *name() {
+    return baseName.c_str();
+  }
+  const char *path() {
+    return fullPath.c_str();
+  }
+
+  bool isDirectory() {
+    return fs != nullptr && data == nullptr;
+  }
+
+  File openNextFile() {
+    if (!isDirectory() || dirIdx >= dirEntries.size()) {
+      return File();
+    }
+    return fs->open(dirEntries[dirIdx++].c_str(), FILE_READ);
+  }
+
+private:
+  friend class SimFs;
+
+  SimFs *fs;
+  std::shared_ptr<std::vector<uint8_t>> data; // nullptr for a directory
+  size_t pos;
+  bool readable, writable, append;
+  std::string fullPath, baseName;
+  std::vector<std::string> dirEntries; // paths of the entries of a directory
+  size_t dirIdx;
+};
+
+/// @brief Open a file with the modes of fopen() or a directory
+inline File SimFs::open(const char *path, const char *mode) {
+  File file;
+  std::string p = path;
+  file.fullPath = p;
+  file.baseName = p.substr(p.find_last_of('/') + 1);
+  if (dirs.count(p)) {
+    file.fs = this;
+    std::string prefix = p == "/" ? "/" : p + "/";
+    for (const auto &dir : dirs) {
+      if (dir != p && dir.compare(0, prefix.size(), prefix) == 0 && parent(dir) == p) {
+        file.dirEntries.push_back(dir);
+      }
+    }
+    for (const auto &f : files) {
+      if (parent(f.first) == p) {
+        file.dirEntries.push_back(f.first);
+      }
+    }
+    return file;
+  }
+  std::string m = mode;
+  auto it = files.find(p);
+  if (m[0] == 'r' && it == files.end()) {
+    return file; // doesn't exist
+  }
+  if (m[0] != 'r' && !dirs.count(parent(p))) {
+    return file; // no directory
+  }
+  if (it == files.end() || m[0] == 'w') {
+    files[p] = std::make_shared<std::vector<uint8_t>>();
+    it = files.find(p);
+  }
+  file.fs = this;
+  file.data = it->second;
+  file.readable = m[0] == 'r' || m.find('+') != std::string::npos;
+  file.writable = m[0] != 'r' || m.find('+') != std::string::npos;
+  file.append = m[0] == 'a';
+  return file;
+}
@@ -0,0 +1,128 @@
+// Host stand-in for the few FreeRTOS functions used by the Scheduler and the SDHelper. Like on the
+// device, Arduino.h includes it.
+//
+// By default no task is created (xTaskCreate() fails), so the SDHelper does its work in the
+// calling thread, and ulTaskNotifyTake() doesn't block, but advances the virtual clock of the test
+// by the timeout with simAdvanceMillis(). With simThreads = true, every task is a std::thread and
+// ulTaskNotifyTake() really waits, e.g. to test the SDHelper with its writer task.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+void simAdvanceMillis(unsigned long ms);
+
+// run the tasks as threads?
+inline bool simThreads = false;
+
+/// @brief notification state of one task
+struct SimTask {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifyCnt = 0;
+  std::thread thread;
+};
+typedef SimTask *TaskHandle_t;
+
+// task of the thread, nullptr in the main thread
+inline thread_local TaskHandle_t simCurrentTask = nullptr;
+
+/// @brief task of the calling thread, the main thread has its own
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static SimTask mainTask;
+  return simCurrentTask != nullptr ? simCurrentTask : &mainTask;
+}
+
+inline BaseType_t xTaskCreate(void (*fn)(void *), const char *name, uint32_t stack, void *param,
+                              UBaseType_t priority, TaskHandle_t *handle) {
+  if (!simThreads) {
+    return pdFAIL;
+  }
+  SimTask *task = new SimTask();
+  *handle = task;
+  task->thread = std::thread([fn, param, task]() {
+    simCurrentTask = task;
+    fn(param);
+  });
+  task->thread.detach();
+  return pdPASS;
+}
+
+inline bool xPortInIsrContext() {
+  return false;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifyCnt++;
+  }
+  task->cv.notify_one();
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  SimTask *task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (task->notifyCnt == 0) {
+    if (!simThreads) {
+      lock.unlock();
+      simAdvanceMillis(ticks); // sleep in virtual time
+      lock.lock();
+    } else {
+      task->cv.wait_for(lock, std::chrono::milliseconds(ticks),
+                        [task]() { return task->notifyCnt > 0; });
+    }
+  }
+  uint32_t cnt = task->notifyCnt;
+  if (cnt > 0) {
+    task->notifyCnt = clearOnExit ? 0 : cnt - 1;
+  }
+  return cnt;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  if (simThreads) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+  } else {
+    simAdvanceMillis(ticks);
+  }
+}
+
+typedef std::recursive_timed_mutex *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+  return new std::recursive_timed_mutex();
+}
+
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    mutex->lock();
+    return pdTRUE;
+  }
+  return mutex->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex) {
+  mutex->unlock();
+  return pdTRUE;
+}
@@ -0,0 +1,60 @@
+// Host stand-in for the Preferences library (key-value storage in the flash of the ESP32). The
+// values are kept in memory, so they are lost at the end of the program like after erasing the
+// flash. simPreferencesClear() erases all name spaces.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+inline std::map<std::string, std::vector<uint8_t>> simPreferences;
+
+inline void simPreferencesClear() {
+  simPreferences.clear();
+}
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false) {
+    nameSpace = std::string(name) + "/";
+    return true;
+  }
+  void end() {}
+
+  bool clear() {
+    for (auto it = simPreferences.begin(); it != simPreferences.end();) {
+      it = it->first.compare(0, nameSpace.size(), nameSpace) == 0 ? simPreferences.erase(it)
+                                                                  : std::next(it);
+    }
+    return true;
+  }
+
+  uint8_t getUChar(const char *key, uint8_t defaultValue = 0) {
+    auto it = simPreferences.find(nameSpace + key);
+    return (it == simPreferences.end() || it->second.size() != 1) ? defaultValue : it->second[0];
+  }
+  size_t putUChar(const char *key, uint8_t value) {
+    simPreferences[nameSpace + key] = std::vector<uint8_t>(1, value);
+    return 1;
+  }
+
+  size_t getBytes(const char *key, void *buf, size_t maxLen) {
+    auto it = simPreferences.find(nameSpace + key);
+    if (it == simPreferences.end() || it->second.size() > maxLen) {
+      return 0;
+    }
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+  size_t putBytes(const char *key, const void *value, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)value;
+    simPreferences[nameSpace + key] = std::vector<uint8_t>(bytes, bytes + len);
+    return len;
+  }
+
+private:
+  std::string nameSpace;
+};
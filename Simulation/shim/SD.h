@@ -0,0 +1,48 @@
+// Host stand-in for the SD library: the card is a SimFs in memory. simSdInserted decides, if the
+// card can be mounted and read.
+// The SDHelper truncates files through the VFS with truncate(SD_MOUNTPOINT "/..."), which is
+// redirected to the card here.
+
+#pragma once
+
+#include <unistd.h>
+
+#include "FS.h"
+#include "SPI.h"
+
+inline bool simSdInserted = true;
+
+/// @brief SD card stand-in
+class SDClass : public SimFs {
+public:
+  bool begin(uint8_t csPin = 0) {
+    mounted = simSdInserted;
+    return mounted;
+  }
+  void end() {
+    mounted = false;
+  }
+  bool readRAW(uint8_t *buf, uint32_t sector) {
+    return mounted && simSdInserted;
+  }
+  uint64_t totalBytes() {
+    return simSdTotalBytes;
+  }
+
+  uint64_t simSdTotalBytes = 64ULL * 1024 * 1024;
+
+private:
+  bool mounted = false;
+};
+
+inline SDClass SD;
+
+/// @brief truncate() of the VFS, only files of the card below /sd are supported
+inline int simTruncate(const char *path, off_t len) {
+  if (strncmp(path, "/sd/", 4) != 0) {
+    return -1;
+  }
+  return SD.truncate(path + 3, len) ? 0 : -1;
+}
+
+#define truncate(path, len) simTruncate(path, len)
@@ -0,0 +1,3 @@
+// Host stand-in for the SPI library, the SD stand-in doesn't need the bus.
+
+#pragma once
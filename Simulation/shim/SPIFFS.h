@@ -0,0 +1,15 @@
+// Host stand-in for the SPIFFS library: the internal flash is a SimFs in memory.
+
+#pragma once
+
+#include "FS.h"
+
+/// @brief SPIFFS stand-in
+class SPIFFSClass : public SimFs {
+public:
+  bool begin(bool formatOnFail = false) {
+    return true;
+  }
+};
+
+inline SPIFFSClass SPIFFS;
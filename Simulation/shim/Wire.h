@@ -0,0 +1,11 @@
+// Host stand-in for the I2C library, the RTC stand-in doesn't use it.
+
+#pragma once
+
+/// @brief TwoWire stand-in
+class TwoWire {
+public:
+  void begin() {}
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,118 @@
+// Host stand-in for the Zigbee library with the subset used by ZigbeeSwitchHelper.
+// The bound plugs are added with simBindPlug(), their on/off state is read with simPlugIsOn().
+
+#pragma once
+
+#include <list>
+
+#include "Arduino.h"
+
+// the host stand-in is always built as coordinator
+#define ZIGBEE_MODE_ZCZR
+
+typedef enum { ZIGBEE_COORDINATOR, ZIGBEE_ROUTER, ZIGBEE_END_DEVICE } zigbee_role_t;
+
+typedef struct {
+  uint8_t ieee_addr[8];
+  uint8_t endpoint;
+  uint16_t short_addr;
+} zb_device_params_t;
+
+// how many plugs can be bound to the stand-in?
+#define SIM_ZIGBEE_PLUGS 16
+
+/// @brief state of one simulated plug
+typedef struct {
+  zb_device_params_t params;
+  bool on;
+  uint32_t commands;      // number of on/off commands received
+  unsigned long lastOnMs; // millis() of the last on command, which switched it on
+} SimPlug;
+
+inline SimPlug simPlugs[SIM_ZIGBEE_PLUGS];
+inline uint8_t simPlugCount = 0;
+
+/// @brief bind another plug to the switch
+/// @return index of the plug
+inline uint8_t simBindPlug() {
+  SimPlug &plug = simPlugs[simPlugCount];
+  plug = SimPlug{};
+  plug.params.endpoint = 1;
+  plug.params.short_addr = 0x1000 + simPlugCount;
+  plug.params.ieee_addr[0] = simPlugCount;
+  return simPlugCount++;
+}
+
+/// @brief find the simulated plug by its address
+inline SimPlug *simFindPlug(uint8_t endpoint, uint16_t shortAddr) {
+  for (uint8_t i = 0; i < simPlugCount; i++) {
+    if (simPlugs[i].params.endpoint == endpoint && simPlugs[i].params.short_addr == shortAddr) {
+      return &simPlugs[i];
+    }
+  }
+  return nullptr;
+}
+
+class ZigbeeEP {};
+
+/// @brief ZigbeeSwitch stand-in, every bound plug is addressed by endpoint and short address
+class ZigbeeSwitch : public ZigbeeEP {
+public:
+  explicit ZigbeeSwitch(uint8_t endpoint) {}
+
+  void setManufacturerAndModel(const char *, const char *) {}
+  void allowMultipleBinding(bool) {}
+
+  bool bound() {
+    return simPlugCount > 0;
+  }
+
+  std::list<zb_device_params_t *> getBoundDevices() {
+    std::list<zb_device_params_t *> devices;
+    for (uint8_t i = 0; i < simPlugCount; i++) {
+      devices.push_back(&simPlugs[i].params);
+    }
+    return devices;
+  }
+
+  void lightOn(uint8_t endpoint, uint16_t shortAddr) {
+    SimPlug *plug = simFindPlug(endpoint, shortAddr);
+    if (plug != nullptr) {
+      if (!plug->on) {
+        plug->lastOnMs = millis();
+      }
+      plug->on = true;
+      plug->commands++;
+    }
+  }
+
+  void lightOff(uint8_t endpoint, uint16_t shortAddr) {
+    SimPlug *plug = simFindPlug(endpoint, shortAddr);
+    if (plug != nullptr) {
+      plug->on = false;
+      plug->commands++;
+    }
+  }
+
+  char *readManufacturer(uint8_t, uint16_t, uint8_t *) {
+    return (char *)"Sim";
+  }
+  char *readModel(uint8_t, uint16_t, uint8_t *) {
+    return (char *)"Plug";
+  }
+};
+
+/// @brief Zigbee core stand-in
+class ZigbeeCore {
+public:
+  void addEndpoint(ZigbeeEP *) {}
+  void setRebootOpenNetwork(uint8_t) {}
+  bool begin(zigbee_role_t) {
+    return true;
+  }
+  void factoryReset() {
+    simPlugCount = 0;
+  }
+};
+
+inline ZigbeeCore Zigbee;
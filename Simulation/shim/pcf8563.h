@@ -0,0 +1,41 @@
+// Host stand-in for the PCF8563 RTC library: the RTC keeps the date of simRtcDate, a test can set
+// it and check what the RTCHelper wrote.
+
+#pragma once
+
+#include "Arduino.h"
+
+#define PCF_TIMEFORMAT_YYYY_MM_DD_H_M_S 0
+
+/// @brief date and time of the RTC
+class RTC_Date {
+public:
+  RTC_Date() : year(0), month(0), day(0), hour(0), minute(0), second(0) {}
+  uint16_t year;
+  uint8_t month, day, hour, minute, second;
+};
+
+inline RTC_Date simRtcDate;
+inline bool simRtcValid = true;
+
+/// @brief PCF8563 stand-in
+class PCF8563_Class {
+public:
+  void begin() {}
+  bool isValid() {
+    return simRtcValid;
+  }
+  RTC_Date getDateTime() {
+    return simRtcDate;
+  }
+  void setDateTime(RTC_Date date) {
+    simRtcDate = date;
+    simRtcValid = true;
+  }
+  const char *formatDateTime(int format) {
+    static char str[32]; // room for any value of the fields
+    snprintf(str, sizeof(str), "%04d-%02d-%02d %02d:%02d:%02d", simRtcDate.year, simRtcDate.month,
+             simRtcDate.day, simRtcDate.hour, simRtcDate.minute, simRtcDate.second);
+    return str;
+  }
+};
@@ -0,0 +1,181 @@
+// dstTableTest.cpp
+// Host comparison of the DST table of the RTCHelper (updateDstTable() and isDst()) with the former
+// isDST_Europe_CET(), which searched the last Sunday of March and October for every conversion.
+// The local time is compared for every hour from 2000 to 2100, for every minute around the changes
+// and for random times, which make the table jump between the years.
+// The former function ended DST at 3:00 base time (CET) on the last Sunday in October, which is
+// 4:00 CEST. RTC_TZ ends it at 3:00 CEST = 2:00 CET like the zoneinfo of Europe/Berlin (see
+// timeZoneTest), so this hour differs once per year.
+
+#include <sys/time.h>
+#include <time.h>
+
+#include "Arduino.h"
+
+#include "rtchelper.h"
+
+#include "hostTest.h"
+
+#define FIRST_YEAR 2000
+#define LAST_YEAR 2100
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+static time_t simSystemTime = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+// ESP system time, which drives the cached clock of the RTCHelper
+extern "C" int settimeofday(const struct timeval *tv, const struct timezone *tz) {
+  simSystemTime = tv->tv_sec;
+  return 0;
+}
+
+extern "C" time_t time(time_t *t) {
+  if (t != NULL) {
+    *t = simSystemTime;
+  }
+  return simSystemTime;
+}
+
+// ===== former DST rule of rtchelper.cpp =====
+
+static uint8_t dayOfWeek(uint16_t year, uint8_t month, uint8_t day) {
+  int y = year;
+  int m = month;
+  if (m < 3) {
+    m += 12;
+    y -= 1;
+  }
+  int K = y % 100;
+  int J = y / 100;
+  int h = (day + (13 * (m + 1)) / 5 + K + K / 4 + J / 4 + 5 * J) % 7;
+  return (h + 6) % 7; // 0 = Sunday
+}
+
+static uint8_t lastSunday(uint16_t year, uint8_t month) {
+  uint8_t lastDay = 31; // March and October
+  return lastDay - dayOfWeek(year, month, lastDay);
+}
+
+static bool isDST_Europe_CET(uint16_t year, uint8_t month, uint8_t day, uint8_t hour) {
+  if (month < 3 || month > 10)
+    return false;
+  if (month > 3 && month < 10)
+    return true;
+  uint8_t ls = lastSunday(year, month);
+  if (month == 3) {
+    if (day > ls)
+      return true;
+    if (day < ls)
+      return false;
+    return (hour >= 2);
+  } else {
+    if (day < ls)
+      return true;
+    if (day > ls)
+      return false;
+    return (hour < 3);
+  }
+}
+
+// ===== comparison =====
+
+static uint32_t epochOf(uint16_t year, uint8_t month, uint8_t day, uint8_t hour) {
+  struct tm date = {};
+  date.tm_year = year - 1900;
+  date.tm_mon = month - 1;
+  date.tm_mday = day;
+  date.tm_hour = hour;
+  return timegm(&date);
+}
+
+/// @brief local time of the former function as "YYYY-MM-DD hh:mm:ss"
+static void formerLocalTime(uint32_t baseEpoch, char *str) {
+  time_t t = baseEpoch;
+  struct tm base;
+  gmtime_r(&t, &base);
+  if (isDST_Europe_CET(base.tm_year + 1900, base.tm_mon + 1, base.tm_mday, base.tm_hour)) {
+    t += 3600;
+  }
+  struct tm local;
+  gmtime_r(&t, &local);
+  strftime(str, TIMESTAMP_LENGTH, "%Y-%m-%d %H:%M:%S", &local);
+}
+
+/// @brief is baseEpoch in the hour, which the former function kept in DST too long?
+static bool isFormerLateHour(uint32_t baseEpoch) {
+  time_t t = baseEpoch;
+  struct tm base;
+  gmtime_r(&t, &base);
+  return base.tm_mon == 9 && base.tm_mday == lastSunday(base.tm_year + 1900, 10) &&
+         base.tm_hour == 2;
+}
+
+static uint32_t compared = 0, lateHours = 0;
+
+/// @brief compare the local time of the RTCHelper with the former function
+static void compare(RTCHelper &rtcHelper, uint32_t baseEpoch) {
+  char actual[TIMESTAMP_LENGTH], former[TIMESTAMP_LENGTH];
+  simSystemTime = baseEpoch;
+  rtcHelper.createTimeStampLogging(actual);
+  formerLocalTime(baseEpoch, former);
+  compared++;
+  if (isFormerLateHour(baseEpoch)) {
+    time_t t = baseEpoch;
+    struct tm base;
+    gmtime_r(&t, &base);
+    char standard[TIMESTAMP_LENGTH];
+    strftime(standard, sizeof(standard), "%Y-%m-%d %H:%M:%S", &base);
+    CHECK_MSG(strcmp(actual, standard) == 0, "base %u: %s, expected standard time %s", baseEpoch,
+              actual, standard);
+    lateHours += baseEpoch % 3600 == 0;
+    return;
+  }
+  CHECK_MSG(strcmp(actual, former) == 0, "base %u: %s, former %s", baseEpoch, actual, former);
+}
+
+int main() {
+  // the RTC is newer than the compiler date, so init() takes it as system time
+  simRtcDate.year = 2099;
+  simRtcDate.month = 1;
+  simRtcDate.day = 1;
+  RTCHelper rtcHelper;
+  CHECK(rtcHelper.init());
+
+  int failures = hostTestFailures;
+  uint32_t end = epochOf(LAST_YEAR + 1, 1, 1, 0);
+  for (uint32_t e = epochOf(FIRST_YEAR, 1, 1, 0); e < end && hostTestFailures == failures;
+       e += 3600) {
+    compare(rtcHelper, e);
+  }
+  CHECK(lateHours == LAST_YEAR - FIRST_YEAR + 1);
+
+  // every minute around the changes
+  for (uint16_t year = FIRST_YEAR; year <= LAST_YEAR && hostTestFailures == failures; year++) {
+    uint32_t changes[] = {epochOf(year, 3, lastSunday(year, 3), 2),
+                          epochOf(year, 10, lastSunday(year, 10), 2)};
+    for (uint32_t change : changes) {
+      for (uint32_t e = change - 2 * 3600; e < change + 3 * 3600; e += 60) {
+        compare(rtcHelper, e);
+      }
+    }
+  }
+
+  // random times, the table changes the year every time
+  uint32_t start = epochOf(FIRST_YEAR, 1, 1, 0);
+  uint32_t random = 12345;
+  for (int i = 0; i < 200000 && hostTestFailures == failures; i++) {
+    random = random * 1103515245 + 12345;
+    compare(rtcHelper, start + random % (end - start));
+  }
+
+  printf("  %u times compared\n", compared);
+  return hostTestResult("dstTableTest");
+}
@@ -0,0 +1,98 @@
+// eventBusTest.cpp
+// Host test and measurement of the EventBus: the handlers are called in the order they subscribed,
+// only for their event type, and the limits of the table hold. Then the time of publish() with
+// 0, 1, 2 and 4 handlers is printed.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "eventBus.h"
+
+#include "hostTest.h"
+
+#define PUBLISH_RUNS 5000000L
+
+enum TestEventType : uint8_t { EV_A, EV_B, EV_C, EV_D, EV_TYPES };
+
+typedef struct {
+  TestEventType type;
+  int value;
+} TestEvent;
+
+static volatile int sink = 0;
+static char order[16];
+static uint8_t orderLen = 0;
+
+static void first(const TestEvent &event) {
+  order[orderLen++] = '1';
+}
+
+static void second(const TestEvent &event) {
+  order[orderLen++] = '2';
+}
+
+static void add(const TestEvent &event) {
+  sink += event.value;
+}
+
+static void exclusiveOr(const TestEvent &event) {
+  sink ^= event.value;
+}
+
+static void testDispatch() {
+  EventBus<TestEvent, EV_TYPES, 2> bus;
+  CHECK(bus.subscribe(EV_A, first));
+  CHECK(bus.subscribe(EV_A, second));
+  CHECK(!bus.subscribe(EV_A, add)); // MAX_HANDLERS
+  CHECK(bus.subscribe(EV_B, second));
+  CHECK(!bus.subscribe(EV_TYPES, first));
+
+  TestEvent event = {EV_A, 0};
+  bus.publish(event);
+  event.type = EV_B;
+  bus.publish(event);
+  event.type = EV_C; // no handler
+  bus.publish(event);
+  order[orderLen] = 0;
+  CHECK_MSG(strcmp(order, "122") == 0, "handlers called %s", order);
+  event.type = EV_TYPES; // unknown, not counted
+  bus.publish(event);
+  CHECK(bus.getPublishCount() == 3);
+}
+
+/// @brief print the time of one publish() of the type
+static void measure(EventBus<TestEvent, EV_TYPES, 4> &bus, TestEventType type, int handlers) {
+  TestEvent event = {type, 0};
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < PUBLISH_RUNS; i++) {
+    event.value = (int)i;
+    bus.publish(event);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+                  .count() /
+              PUBLISH_RUNS;
+  printf("  %d handlers: %6.2f ns per publish\n", handlers, ns);
+}
+
+static void testPublishTime() {
+  static EventBus<TestEvent, EV_TYPES, 4> bus;
+  bus.subscribe(EV_B, add);
+  bus.subscribe(EV_C, add);
+  bus.subscribe(EV_C, exclusiveOr);
+  for (int i = 0; i < 4; i++) {
+    bus.subscribe(EV_D, add);
+  }
+  printf("publish, %ld events each:\n", PUBLISH_RUNS);
+  measure(bus, EV_A, 0);
+  measure(bus, EV_B, 1);
+  measure(bus, EV_C, 2);
+  measure(bus, EV_D, 4);
+  CHECK(bus.getPublishCount() == 4 * PUBLISH_RUNS);
+}
+
+int main() {
+  testDispatch();
+  testPublishTime();
+  return hostTestResult("eventBusTest");
+}
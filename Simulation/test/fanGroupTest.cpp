@@ -0,0 +1,111 @@
+// fanGroupTest.cpp
+// Host test of the fan group: ControlFan chooses and staggers the fans, ZigbeeSwitchHelper
+// switches the bound plugs of the Zigbee stand-in. More plugs than FAN_GROUP_MAX are bound, the
+// surplus ones must be reported as unused and never be switched.
+
+#include "Arduino.h"
+#include "Zigbee.h"
+
+#include "controlFan.h"
+#include "timeService.h"
+#include "zigbeeSwitchHelper.h"
+
+#include "hostTest.h"
+
+// step of the virtual clock
+#define STEP_MS 100
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+static ControlFan controlFan;
+static ZigbeeSwitchHelper zigbeeSwitchHelper;
+
+/// @brief one pass of the control task of main.cpp
+static void controlPass() {
+  timeService.tick();
+  controlFan.setFanGroupSize(zigbeeSwitchHelper.getBoundDeviceCount());
+  controlFan.loop(false);
+  zigbeeSwitchHelper.setDeviceSetpoints(controlFan.getFanGroupMask());
+  zigbeeSwitchHelper.loop();
+}
+
+/// @brief run the control task for some time
+static void runFor(unsigned long ms) {
+  for (unsigned long t = 0; t < ms; t += STEP_MS) {
+    simMillis += STEP_MS;
+    controlPass();
+  }
+}
+
+static uint8_t plugsOn() {
+  uint8_t cnt = 0;
+  for (uint8_t i = 0; i < simPlugCount; i++) {
+    cnt += simPlugs[i].on;
+  }
+  return cnt;
+}
+
+int main() {
+  const uint8_t plugs = FAN_GROUP_MAX + 2;
+  for (uint8_t i = 0; i < plugs; i++) {
+    simBindPlug();
+  }
+
+  timeService.tick();
+  controlFan.init();
+  zigbeeSwitchHelper.init();
+  runFor(2 * ZigbeeWAIT_MS);
+  CHECK(zigbeeSwitchHelper.isReady());
+  CHECK(zigbeeSwitchHelper.getBoundDeviceCount() == FAN_GROUP_MAX);
+  CHECK(zigbeeSwitchHelper.getUnusedDeviceCount() == plugs - FAN_GROUP_MAX);
+  CHECK(plugsOn() == 0);
+
+  // AUTO -> ON: the fans start one after another
+  controlFan.incrementUserSetpoint();
+  unsigned long start = millis();
+  uint8_t started = 0;
+  while (millis() - start < (FAN_GROUP_MAX + 1) * FAN_STAGGER_MS) {
+    uint8_t before = plugsOn();
+    runFor(STEP_MS);
+    uint8_t after = plugsOn();
+    CHECK_MSG(after <= before + 1, "%u plugs started at once", after - before);
+    started += after > before ? after - before : 0;
+  }
+  CHECK(started == FAN_GROUP_MAX);
+  CHECK(plugsOn() == FAN_GROUP_MAX);
+
+  // the starts are FAN_STAGGER_MS apart
+  for (uint8_t i = 0; i < FAN_GROUP_MAX; i++) {
+    for (uint8_t j = 0; j < FAN_GROUP_MAX; j++) {
+      if (i != j) {
+        long diff = (long)simPlugs[i].lastOnMs - (long)simPlugs[j].lastOnMs;
+        CHECK_MSG(diff >= FAN_STAGGER_MS || diff <= -FAN_STAGGER_MS,
+                  "plug %u and %u started %ld ms apart", i, j, diff);
+      }
+    }
+  }
+
+  // the surplus plugs are not commanded at all, even by the regular repetition
+  runFor(2 * ZigbeeREADY_MS);
+  for (uint8_t i = FAN_GROUP_MAX; i < plugs; i++) {
+    CHECK_MSG(simPlugs[i].commands == 0, "unused plug %u got %u commands", i,
+              simPlugs[i].commands);
+  }
+
+  // ON -> OFF: all fans stop at once
+  controlFan.incrementUserSetpoint();
+  runFor(FANwaitMS + STEP_MS);
+  CHECK(plugsOn() == 0);
+
+  // each fan ran
+  for (uint8_t i = 0; i < FAN_GROUP_MAX; i++) {
+    CHECK(controlFan.getFanRunSeconds(i) > 0);
+  }
+
+  return hostTestResult("fanGroupTest");
+}
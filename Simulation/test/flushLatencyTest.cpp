@@ -0,0 +1,112 @@
+// flushLatencyTest.cpp
+// Host measurement of the batched writes of the data log: the SDHelper writes to the SD stand-in,
+// which charges a fixed time per write call and a time per byte like a card on the SPI bus. The
+// same records are written once with the LogBuffer batching (SD_FLUSH_RECORDS) and once with a
+// flush after every record. The time spent in the card and the longest single flush are printed.
+
+#include "Arduino.h"
+#include "SD.h"
+
+#include "sdhelper.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+// cost model of the card: one write with the update of the FAT and 1 MB/s on the bus
+#define CARD_WRITE_CALL_US 3000
+#define CARD_WRITE_BYTE_NS 1000
+
+#define RECORDS 200
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+unsigned long micros() {
+  return simFsMicros;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+typedef struct {
+  uint64_t busyUs;   // time spent in the card
+  uint64_t maxUs;    // longest call of writeData() or flush()
+  uint32_t calls;    // write calls to the card
+  size_t lines;      // lines in the log file
+} Result;
+
+/// @brief write RECORDS records to fileName
+/// @param flushEach flush after every record instead of batching
+static Result writeRecords(const char *fileName, boolean flushEach) {
+  SDHelper sdHelper(0);
+  Result result = {};
+  sdHelper.init();
+  for (int i = 0; i < 3; i++) {
+    simMillis += SDwaitMS;
+    timeService.tick();
+    sdHelper.loop();
+  }
+  char fn[SD_FILENAMELENGTH];
+  memcpy(fn, fileName, SD_FILENAMELENGTH);
+  sdHelper.setFileName(fn);
+  sdHelper.writeCSVHeader();
+
+  uint64_t startUs = simFsMicros;
+  uint32_t startCalls = SD.writeCalls;
+  for (int i = 0; i < RECORDS; i++) {
+    char date[24], temp[64], control[24];
+    snprintf(date, sizeof(date), "2024-05-%02d %02d:%02d:00", 1 + i / 240, (i / 10) % 24,
+             (i % 10) * 6);
+    snprintf(temp, sizeof(temp), "12.3;15.2;81.0;60.5;9.1;7.5;%d;10", i % 11);
+    snprintf(control, sizeof(control), "f1;m1;%d;0", i);
+    uint64_t callUs = simFsMicros;
+    sdHelper.writeData(date, temp, control);
+    if (flushEach) {
+      sdHelper.flush();
+    }
+    result.maxUs = max(result.maxUs, simFsMicros - callUs);
+    simMillis += SD_SAVE_INTERVALL_MS;
+    timeService.tick();
+  }
+  sdHelper.flush();
+  result.busyUs = simFsMicros - startUs;
+  result.calls = SD.writeCalls - startCalls;
+  std::string content = SD.content(fileName);
+  result.lines = std::count(content.begin(), content.end(), '\n');
+  return result;
+}
+
+static void printResult(const char *name, const Result &r) {
+  printf("  %-14s %6u write calls %8.1f ms in the card (%6.2f ms per record), longest call "
+         "%6.2f ms\n",
+         name, r.calls, r.busyUs / 1000.0, r.busyUs / 1000.0 / RECORDS, r.maxUs / 1000.0);
+}
+
+int main() {
+  SD.writeCallUs = CARD_WRITE_CALL_US;
+  SD.writeByteNs = CARD_WRITE_BYTE_NS;
+  timeService.tick();
+
+  Result batched = writeRecords("/2024/05.csv", false);
+  Result single = writeRecords("/2024/06.csv", true);
+
+  printf("flush latency, %d records, SD_FLUSH_RECORDS %d:\n", RECORDS, SD_FLUSH_RECORDS);
+  printResult("batched", batched);
+  printResult("flush each", single);
+
+  // header + every record, nothing lost by the batching
+  CHECK(batched.lines == RECORDS + 1);
+  CHECK(single.lines == RECORDS + 1);
+  // one write per SD_FLUSH_RECORDS records
+  CHECK(batched.calls <= RECORDS / SD_FLUSH_RECORDS + 2);
+  CHECK(batched.busyUs < single.busyUs);
+  // a batch costs more than a single record, but much less than the records one by one
+  CHECK(batched.maxUs < (uint64_t)SD_FLUSH_RECORDS * single.maxUs);
+
+  return hostTestResult("flushLatencyTest");
+}
@@ -0,0 +1,36 @@
+// hostTest.h
+// Minimal checks for the host tests of the firmware libraries. Every test is a small program,
+// which returns the number of failed checks, see runTests.sh.
+
+#pragma once
+
+#include <cstdio>
+
+static int hostTestFailures = 0;
+
+// check a condition, print the location if it fails
+#define CHECK(cond)                                                                                \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                              \
+      hostTestFailures++;                                                                          \
+    }                                                                                              \
+  } while (0)
+
+// check a condition, print the location and a formatted message if it fails
+#define CHECK_MSG(cond, ...)                                                                       \
+  do {                                                                                             \
+    if (!(cond)) {                                                                                 \
+      printf("%s:%d: CHECK(%s) failed: ", __FILE__, __LINE__, #cond);                              \
+      printf(__VA_ARGS__);                                                                         \
+      printf("\n");                                                                                \
+      hostTestFailures++;                                                                          \
+    }                                                                                              \
+  } while (0)
+
+/// @brief print the result of the test
+/// @return exit code of the test program
+static int hostTestResult(const char *name) {
+  printf("%s: %s\n", name, hostTestFailures == 0 ? "ok" : "FAILED");
+  return hostTestFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+// logQueueStressTest.cpp
+// Host stress test of the way of the records from loop() to the card with real threads:
+// - SpscQueue: a producer thread pushes numbered elements as fast as possible, the consumer must
+//   get every element complete and in order, or count it as dropped.
+// - SDHelper with its writer task (simThreads): loop() writes records, while the card fails now
+//   and then. The writer task reports the lost card, loop() alone changes its state. At the end,
+//   every record is in the log file once and in order, or counted as dropped.
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "Arduino.h"
+#include "SD.h"
+
+#include "logRecord.h"
+#include "sdhelper.h"
+#include "spscQueue.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+#define QUEUE_ELEMENTS 500000
+#define RECORDS 3000
+#define FAIL_EVERY 400 // records between two failures of the card
+#define FAIL_FOR 60    // records written while the card fails
+
+bool logRecordCsvCheckLine(const char *line, size_t len, uint32_t *seq);
+
+SimSerial Serial;
+static std::atomic<uint32_t> simMillis(0);
+
+unsigned long millis() {
+  return simMillis;
+}
+
+unsigned long micros() {
+  return simFsMicros;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+/// @brief element with a check value, a torn copy doesn't match
+typedef struct {
+  uint32_t n;
+  uint32_t data[15];
+  uint32_t check;
+} Element;
+
+static void testSpscQueue() {
+  static SpscQueue<Element, SD_QUEUE_SIZE> queue;
+  std::atomic<bool> done(false);
+
+  std::thread producer([&]() {
+    Element e;
+    for (uint32_t n = 0; n < QUEUE_ELEMENTS; n++) {
+      e.n = n;
+      e.check = n;
+      for (uint32_t i = 0; i < 15; i++) {
+        e.data[i] = n * 31 + i;
+        e.check ^= e.data[i];
+      }
+      queue.push(e);
+      if (n % 16 == 0) {
+        std::this_thread::yield(); // give the consumer a chance, it drops less
+      }
+    }
+    done = true;
+  });
+
+  uint32_t received = 0, torn = 0, outOfOrder = 0;
+  int64_t last = -1;
+  Element e;
+  while (true) {
+    boolean finished = done; // read before pop(), so no element is missed
+    if (!queue.pop(e)) {
+      if (finished) {
+        break;
+      }
+      continue;
+    }
+    uint32_t check = e.n;
+    for (uint32_t i = 0; i < 15; i++) {
+      check ^= e.data[i];
+    }
+    torn += check != e.check;
+    outOfOrder += (int64_t)e.n <= last;
+    last = e.n;
+    received++;
+  }
+  producer.join();
+
+  printf("  SpscQueue: %u received, %u dropped\n", received, queue.getDroppedCount());
+  CHECK(torn == 0);
+  CHECK(outOfOrder == 0);
+  CHECK(received + queue.getDroppedCount() == QUEUE_ELEMENTS);
+  CHECK(last == QUEUE_ELEMENTS - 1);
+}
+
+/// @brief one loop() of the io task
+static void ioLoop(SDHelper &sdHelper, uint32_t ms) {
+  simMillis += ms;
+  timeService.tick();
+  sdHelper.loop();
+}
+
+static void testWriterTask() {
+  simThreads = true;
+  SDHelper sdHelper(0);
+  sdHelper.init();
+  for (int i = 0; i < 3; i++) {
+    ioLoop(sdHelper, SDwaitMS);
+  }
+  char fn[SD_FILENAMELENGTH] = "/2024/05.csv";
+  sdHelper.setFileName(fn);
+  sdHelper.writeCSVHeader();
+
+  uint32_t failures = 0, lostCard = 0;
+  for (uint32_t n = 0; n < RECORDS; n++) {
+    if (n % FAIL_EVERY == FAIL_EVERY / 2) {
+      SD.writeBudget = 0; // the writer task fails from now on
+      failures++;
+    } else if (n % FAIL_EVERY == FAIL_EVERY / 2 + FAIL_FOR) {
+      SD.writeBudget = -1;
+    }
+    char date[32], temp[48], control[24];
+    snprintf(date, sizeof(date), "2024-05-%02u %02u:%02u:00", 1 + n / 240, (n / 10) % 24,
+             (n % 10) * 6);
+    snprintf(temp, sizeof(temp), "12.3;15.2;81.0;60.5;9.1;7.5;%u;10", n % 11);
+    snprintf(control, sizeof(control), "f1;m1;%u;0", n);
+    sdHelper.writeData(date, temp, control);
+    ioLoop(sdHelper, 1000);
+    lostCard += !sdHelper.isSDinserted();
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  SD.writeBudget = -1;
+
+  // wait until the writer task wrote everything, also the records of the flash log
+  std::string content;
+  uint32_t lines = 0;
+  for (int i = 0; i < 1000; i++) {
+    ioLoop(sdHelper, 1000);
+    sdHelper.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    content = SD.content(fn);
+    lines = std::count(content.begin(), content.end(), '\n');
+    if (sdHelper.isSDinserted() && sdHelper.getBufferedCount() == 0 &&
+        lines >= RECORDS + 1 - sdHelper.getDroppedCount()) {
+      break;
+    }
+  }
+
+  // every record once and in order
+  uint32_t records = 0, invalid = 0, outOfOrder = 0;
+  int64_t last = -1;
+  size_t start = 0;
+  while (start < content.size()) {
+    size_t end = content.find("\r\n", start);
+    if (end == std::string::npos) {
+      invalid++;
+      break;
+    }
+    uint32_t seq = UINT32_MAX;
+    if (!logRecordCsvCheckLine(content.c_str() + start, end - start, &seq)) {
+      invalid++;
+    } else if (seq != UINT32_MAX) {
+      // the record number is the 3rd column of the control part
+      unsigned n = 0;
+      const char *ctrl = strstr(content.c_str() + start, ";f1;m1;");
+      if (ctrl != nullptr && sscanf(ctrl, ";f1;m1;%u;", &n) == 1) {
+        outOfOrder += (int64_t)n <= last;
+        last = n;
+      }
+      records++;
+    }
+    start = end + 2;
+  }
+  printf("  SDHelper: %u records written, %u dropped, %u card failures, %u loops without card\n",
+         records, sdHelper.getDroppedCount(), failures, lostCard);
+  CHECK(invalid == 0);
+  CHECK(outOfOrder == 0);
+  CHECK(records + sdHelper.getDroppedCount() == RECORDS);
+  CHECK(lostCard > 0); // loop() noticed the failures of the writer task
+  CHECK(sdHelper.isSDinserted());
+}
+
+int main() {
+  timeService.tick();
+  testSpscQueue();
+  testWriterTask();
+  int result = hostTestResult("logQueueStressTest");
+  fflush(stdout);
+  std::_Exit(result); // the writer task still runs, don't destroy the objects it uses
+}
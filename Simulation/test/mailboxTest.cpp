@@ -0,0 +1,152 @@
+// mailboxTest.cpp
+// Host test of the Mailbox with the messages of taskMessages.h:
+// - one task: a full mailbox keeps the newest messages in order, send() reports the overwritten
+//   ones, getDroppedCount() counts them and the wake function is called for every message.
+// - real threads: a sender thread sends numbered SensorMsg as fast as possible, a receiver thread
+//   takes them. Every message arrives complete and in order or is counted as dropped, the last one
+//   always arrives and the receiver is woken once per message.
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+#include "Arduino.h"
+
+#include "taskMessages.h"
+
+#include "hostTest.h"
+
+#define THREAD_MESSAGES 200000
+
+SimSerial Serial;
+
+unsigned long millis() {
+  return 0;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+}
+
+static std::atomic<uint32_t> wakeCnt(0);
+
+static void wake() {
+  wakeCnt++;
+}
+
+/// @brief message number n, every part of it depends on n
+static void fillSensorMsg(SensorMsg &msg, uint32_t n) {
+  memset(&msg, 0, sizeof(msg));
+  msg.inner.temperature = n;
+  msg.outer.temperature = -(float)n;
+  msg.newAverages = n % 2;
+  snprintf(msg.logStr, TEMPLOG_LENGTH, "%u;%u", n, n * 7);
+}
+
+/// @brief is the message complete?
+/// @return number of the message, -1 if the parts don't fit together
+static int64_t checkSensorMsg(const SensorMsg &msg) {
+  uint32_t n = msg.inner.temperature;
+  char logStr[TEMPLOG_LENGTH];
+  snprintf(logStr, TEMPLOG_LENGTH, "%u;%u", n, n * 7);
+  if (msg.outer.temperature != -(float)n || msg.newAverages != (boolean)(n % 2) ||
+      strcmp(msg.logStr, logStr) != 0) {
+    return -1;
+  }
+  return n;
+}
+
+static void testFullMailbox() {
+  static Mailbox<ControlMsg, MAILBOX_SIZE> box;
+  wakeCnt = 0;
+  box.setReceiver(wake);
+  const uint32_t extra = 5;
+  uint32_t refused = 0;
+  for (uint32_t n = 0; n < MAILBOX_SIZE + extra; n++) {
+    ControlMsg msg = {};
+    msg.fanOn = n % 2;
+    msg.boundDevices = n;
+    snprintf(msg.logCtrlStr, LOGCTRLSTR_LENGTH, "f%u;m1;%u;0", n % 2, n);
+    refused += !box.send(msg);
+  }
+  CHECK(wakeCnt == MAILBOX_SIZE + extra);
+  CHECK(refused == extra);
+
+  // the newest MAILBOX_SIZE messages in order
+  ControlMsg msg;
+  uint32_t n = extra;
+  while (box.receive(msg)) {
+    char logCtrlStr[LOGCTRLSTR_LENGTH];
+    snprintf(logCtrlStr, LOGCTRLSTR_LENGTH, "f%u;m1;%u;0", n % 2, n);
+    CHECK_MSG(msg.boundDevices == n && msg.fanOn == (boolean)(n % 2) &&
+                  strcmp(msg.logCtrlStr, logCtrlStr) == 0,
+              "message %u instead of %u", msg.boundDevices, n);
+    n++;
+  }
+  CHECK(n == MAILBOX_SIZE + extra);
+  CHECK(box.getDroppedCount() == extra);
+  CHECK(!box.receive(msg));
+
+  // after it is empty, nothing more is dropped
+  box.send(msg);
+  CHECK(box.receive(msg));
+  CHECK(box.getDroppedCount() == extra);
+}
+
+static void testThreads() {
+  static Mailbox<SensorMsg, MAILBOX_SIZE> box;
+  wakeCnt = 0;
+  box.setReceiver(wake);
+  std::atomic<bool> done(false);
+
+  std::thread sender([&]() {
+    SensorMsg msg;
+    for (uint32_t n = 0; n < THREAD_MESSAGES; n++) {
+      fillSensorMsg(msg, n);
+      box.send(msg);
+      if (n % 16 == 0) {
+        std::this_thread::yield(); // give the receiver a chance, it drops less
+      }
+    }
+    done = true;
+  });
+
+  uint32_t received = 0, torn = 0, outOfOrder = 0;
+  int64_t last = -1;
+  std::thread receiver([&]() {
+    SensorMsg msg;
+    while (true) {
+      boolean finished = done; // read before receive(), so no message is missed
+      if (!box.receive(msg)) {
+        if (finished) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      int64_t n = checkSensorMsg(msg);
+      if (n < 0) {
+        torn++;
+        continue;
+      }
+      outOfOrder += n <= last;
+      last = n;
+      received++;
+    }
+  });
+  sender.join();
+  receiver.join();
+
+  printf("  %u received, %u dropped, %u wakes\n", received, box.getDroppedCount(),
+         wakeCnt.load());
+  CHECK(torn == 0);
+  CHECK(outOfOrder == 0);
+  CHECK(received + box.getDroppedCount() == THREAD_MESSAGES);
+  CHECK(last == THREAD_MESSAGES - 1);
+  CHECK(wakeCnt == THREAD_MESSAGES);
+}
+
+int main() {
+  testFullMailbox();
+  testThreads();
+  return hostTestResult("mailboxTest");
+}
@@ -0,0 +1,182 @@
+// preallocTest.cpp
+// Host measurement of SD_PREALLOCATE: runTests.sh builds this test with SD_PREALLOCATE 0 and 1.
+// The SD stand-in charges a time per write call, per byte and per cluster, which a write adds to
+// a file, like the search of a free cluster and the update of the FAT. The records of a month are
+// written and the time of each append is printed, the creation of the file separately.
+// Then the month changes, and later the device is restarted and the next month starts without the
+// file of the month before being open, like after a month without power.
+// The run without SD_PREALLOCATE saves its log files as reference, the run with must leave the
+// same bytes after findLogicalEnd(), the trim at the change of the month and the trim of the month,
+// which ended while the device was off.
+
+#include "Arduino.h"
+#include "SD.h"
+
+#include "sdhelper.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+// cost model of the card: one write with the update of the FAT, 1 MB/s on the bus and the
+// allocation of a cluster
+#define CARD_WRITE_CALL_US 3000
+#define CARD_WRITE_BYTE_NS 1000
+#define CARD_CLUSTER_US 10000
+
+#define MONTH_RECORDS (31 * 24 * 3600 * 1000UL / (SD_SAVE_INTERVALL_MS))
+#define NEXT_MONTH_RECORDS 720
+#define AFTER_RESTART_RECORDS 100
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+unsigned long micros() {
+  return simFsMicros;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+typedef struct {
+  uint32_t appends;    // writeData() calls, which wrote to the card
+  uint64_t appendUs;   // time of these calls
+  uint64_t maxUs;      // longest of these calls
+  uint64_t createUs;   // writeCSVHeader(), which opens the new file
+  uint32_t clusters;   // clusters allocated by the appends
+} Result;
+
+static void startSdHelper(SDHelper &sdHelper) {
+  sdHelper.init();
+  for (int i = 0; i < 3; i++) {
+    simMillis += SDwaitMS;
+    timeService.tick();
+    sdHelper.loop();
+  }
+}
+
+/// @brief write records to a new log file
+/// @param month month of the log file in 2024
+static Result writeMonth(SDHelper &sdHelper, uint8_t month, uint32_t records) {
+  Result result = {};
+  char fn[SD_FILENAMELENGTH];
+  snprintf(fn, sizeof(fn), "/2024/%02u.csv", month);
+  sdHelper.setFileName(fn);
+  uint64_t startUs = simFsMicros;
+  sdHelper.writeCSVHeader(); // opens the new file
+  result.createUs = simFsMicros - startUs;
+  for (uint32_t i = 0; i < records; i++) {
+    char date[24], temp[64], control[24];
+    snprintf(date, sizeof(date), "2024-%02u-%02u %02u:%02u:00", month, 1 + i / 240,
+             (i / 10) % 24, (i % 10) * 6);
+    snprintf(temp, sizeof(temp), "12.3;15.2;81.0;60.5;9.1;7.5;%u;10", i % 11);
+    snprintf(control, sizeof(control), "f%u;m1;%u;0", (i / 30) % 2, i);
+    startUs = simFsMicros;
+    uint32_t writeCalls = SD.writeCalls;
+    uint32_t clusters = SD.clusterAllocs;
+    sdHelper.writeData(date, temp, control);
+    uint64_t us = simFsMicros - startUs;
+    if (SD.writeCalls != writeCalls) {
+      result.appends++;
+      result.appendUs += us;
+      result.maxUs = max(result.maxUs, us);
+      result.clusters += SD.clusterAllocs - clusters;
+    }
+    simMillis += SD_SAVE_INTERVALL_MS;
+    timeService.tick();
+  }
+  sdHelper.flush();
+  return result;
+}
+
+static void printResult(const char *name, const Result &r) {
+  printf("  %-10s %4u appends %6.2f ms mean, %6.2f ms max, %3u clusters, creation %8.2f ms\n",
+         name, r.appends, r.appendUs / 1000.0 / max(r.appends, (uint32_t)1), r.maxUs / 1000.0,
+         r.clusters, r.createUs / 1000.0);
+}
+
+#if SD_PREALLOCATE
+/// @brief content of the log file without the zeros of the preallocation
+static std::string logicalContent(const char *fn) {
+  std::string content = SD.content(fn);
+  size_t end = content.find_last_not_of('\0');
+  return end == std::string::npos ? std::string() : content.substr(0, end + 1);
+}
+#endif
+
+/// @brief save the log file of the run without SD_PREALLOCATE or compare with it
+static void checkReference(const char *prefix, const char *fn, boolean trimmed) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s-%.2s.csv", prefix, fn + 6);
+  std::string content = SD.content(fn);
+  CHECK_MSG(content.size() > 0, "%s is empty", fn);
+#if SD_PREALLOCATE
+  FILE *f = fopen(path, "rb");
+  CHECK_MSG(f != NULL, "no reference %s, run the test without SD_PREALLOCATE first", path);
+  if (f == NULL) {
+    return;
+  }
+  std::string reference;
+  char buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+    reference.append(buf, n);
+  }
+  fclose(f);
+  if (trimmed) {
+    CHECK_MSG(content == reference, "%s: %zu bytes, without SD_PREALLOCATE %zu bytes", fn,
+              content.size(), reference.size());
+  } else {
+    // the month is still written: the data in the zeros
+    CHECK_MSG(logicalContent(fn) == reference, "%s differs", fn);
+    CHECK(content.size() == SD_PREALLOC_BYTES);
+  }
+#else
+  FILE *f = fopen(path, "wb");
+  CHECK_MSG(f != NULL, "can't save %s", path);
+  if (f != NULL) {
+    fwrite(content.data(), 1, content.size(), f);
+    fclose(f);
+  }
+#endif
+}
+
+int main(int argc, char **argv) {
+  const char *prefix = argc > 1 ? argv[1] : "build/preallocTest";
+  SD.writeCallUs = CARD_WRITE_CALL_US;
+  SD.writeByteNs = CARD_WRITE_BYTE_NS;
+  SD.clusterAllocUs = CARD_CLUSTER_US;
+  timeService.tick();
+
+  // a month and the change to the next
+  SDHelper sdHelper(0);
+  startSdHelper(sdHelper);
+  Result month = writeMonth(sdHelper, 5, MONTH_RECORDS);
+  writeMonth(sdHelper, 6, NEXT_MONTH_RECORDS);
+
+  // the device is off at the change of the month, the file of June is not open after the restart
+  SDHelper restarted(0);
+  startSdHelper(restarted);
+  writeMonth(restarted, 7, AFTER_RESTART_RECORDS);
+
+  printf("SD_PREALLOCATE %d, %lu records of a month, %u bytes per cluster:\n", SD_PREALLOCATE,
+         MONTH_RECORDS, SD.clusterBytes);
+  printResult(SD_PREALLOCATE ? "prealloc" : "append", month);
+
+  CHECK(month.appends >= MONTH_RECORDS / SD_FLUSH_RECORDS);
+#if SD_PREALLOCATE
+  CHECK(month.clusters == 0); // allocated with the file
+  CHECK(month.maxUs < CARD_CLUSTER_US);
+#else
+  CHECK(month.clusters > 0);
+#endif
+  checkReference(prefix, "/2024/05.csv", true);
+  checkReference(prefix, "/2024/06.csv", true);
+  checkReference(prefix, "/2024/07.csv", !SD_PREALLOCATE);
+
+  return hostTestResult(SD_PREALLOCATE ? "preallocTest (SD_PREALLOCATE 1)"
+                                       : "preallocTest (SD_PREALLOCATE 0)");
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Build and run the host tests of the firmware libraries with the stand-ins of ../shim.
+# Usage (from this folder): ./runTests.sh [name of a test ...]
+
+LIB=../../DewPointFan/lib
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++17 -O2 -Wall -pthread}
+OUT=${OUT:-build}
+
+mkdir -p "$OUT"
+failed=0
+
+# runTest name sources...: build name.cpp with the sources and run it
+runTest() {
+  name=$1
+  shift
+  runVariant "$name" "$name" "" "" "$@"
+}
+
+# runVariant name binary flags args sources...: build name.cpp with the sources and the compiler
+# flags into binary and run it with the args, e.g. to build a test with another configuration
+runVariant() {
+  name=$1
+  binary=$2
+  flags=$3
+  args=$4
+  shift 4
+  if [ -n "$SELECTED" ] && ! echo " $SELECTED " | grep -q " $name "; then
+    return
+  fi
+  if ! $CXX $CXXFLAGS $flags -I . -I ../shim -I $LIB/ControlFan -I $LIB/TimeService \
+    -I $LIB/zigbeeSwitchHelper -I $LIB/SDhelper -I $LIB/LogRecord -I $LIB/SpscQueue \
+    -I $LIB/RTChelper -I $LIB/Scheduler -I $LIB/EventBus -I $LIB/TaskMessages \
+    -I $LIB/processSensorData -I $LIB/DeltaTuner \
+    "$name.cpp" "$@" -o "$OUT/$binary"; then
+    echo "$binary: BUILD FAILED"
+    failed=$((failed + 1))
+    return
+  fi
+  if ! "$OUT/$binary" $args; then
+    failed=$((failed + 1))
+  fi
+}
+
+SELECTED="$*"
+
+SDHELPER="$LIB/SDhelper/sdhelper.cpp $LIB/SDhelper/logBuffer.cpp $LIB/SDhelper/flashLog.cpp \
+  $LIB/SDhelper/sdArchive.cpp $LIB/LogRecord/logRecord.cpp $LIB/TimeService/timeService.cpp"
+
+runTest scheduleTest $LIB/ControlFan/fanSchedule.cpp
+
+runTest fanGroupTest $LIB/ControlFan/controlFan.cpp $LIB/ControlFan/fanSchedule.cpp \
+  $LIB/TimeService/timeService.cpp $LIB/zigbeeSwitchHelper/zigbeeSwitchHelper.cpp
+
+runTest flushLatencyTest $SDHELPER
+runTest sdRecoveryTest $SDHELPER
+runTest logQueueStressTest $SDHELPER
+
+runTest dstTableTest $LIB/RTChelper/rtchelper.cpp $LIB/RTChelper/timeZone.cpp \
+  $LIB/RTChelper/rtcDrift.cpp $LIB/TimeService/timeService.cpp
+runTest timeZoneTest $LIB/RTChelper/timeZone.cpp
+
+runTest timeRolloverTest $SDHELPER $LIB/ControlFan/controlFan.cpp $LIB/ControlFan/fanSchedule.cpp
+
+runTest schedulerTest $LIB/Scheduler/scheduler.cpp $LIB/TimeService/timeService.cpp
+
+runTest eventBusTest
+runTest mailboxTest
+
+# the run without SD_PREALLOCATE saves the reference files for the run with
+runVariant preallocTest preallocTest-append -DSD_PREALLOCATE=0 "$OUT/preallocTest" $SDHELPER
+runVariant preallocTest preallocTest-prealloc -DSD_PREALLOCATE=1 "$OUT/preallocTest" $SDHELPER
+
+if [ $failed -ne 0 ]; then
+  echo "$failed tests failed"
+  exit 1
+fi
+echo "all tests passed"
@@ -0,0 +1,82 @@
+// scheduleTest.cpp
+// Host test of the weekly schedule: edit the hours like the serial command W, the edited schedule
+// must survive a restart (Preferences) and "W 0" must restore the SCHEDULE_RULES table.
+
+#include "Arduino.h"
+#include "Preferences.h"
+
+#include "fanSchedule.h"
+
+#include "hostTest.h"
+
+SimSerial Serial;
+
+unsigned long millis() {
+  return 0;
+}
+
+/// @brief hour of the week
+static uint8_t weekHour(uint8_t day, uint8_t hour) {
+  return day * 24 + hour;
+}
+
+int main() {
+  // the default table of fanSchedule.h has no quiet or preferred hours
+  FanSchedule schedule;
+  schedule.init();
+  for (uint8_t h = 0; h < SCHED_WEEKHOURS; h++) {
+    CHECK(!schedule.isQuietHour(h) && !schedule.isPreferredHour(h));
+  }
+
+  // "W q 0123456 22 6": quiet every night, Saturday night continues into Sunday
+  schedule.edit(SCHED_QUIET, SCHED_EVERYDAY, 22, 6);
+  // "W p 06 10 16": preferred on weekends
+  schedule.edit(SCHED_PREFERRED, SCHED_WEEKEND, 10, 16);
+  // "W n 1 23 24": Monday 23:00 normal again
+  schedule.edit(SCHED_NORMAL, SCHED_MONDAY, 23, 24);
+
+  CHECK(schedule.isQuietHour(weekHour(0, 0)));
+  CHECK(schedule.isQuietHour(weekHour(0, 5)));
+  CHECK(!schedule.isQuietHour(weekHour(0, 6)));
+  CHECK(schedule.isQuietHour(weekHour(2, 22)));
+  CHECK(schedule.isQuietHour(weekHour(6, 23)));
+  CHECK(!schedule.isQuietHour(weekHour(1, 23)));
+  CHECK(schedule.isPreferredHour(weekHour(6, 10)));
+  CHECK(schedule.isPreferredHour(weekHour(0, 15)));
+  CHECK(!schedule.isPreferredHour(weekHour(1, 12)));
+  CHECK(!schedule.isPreferredHour(weekHour(0, 16)));
+
+  // an hour is never quiet and preferred at once
+  schedule.edit(SCHED_PREFERRED, SCHED_SUNDAY, 0, 2);
+  CHECK(schedule.isPreferredHour(weekHour(0, 1)) && !schedule.isQuietHour(weekHour(0, 1)));
+
+  // after a restart the edited schedule is loaded from the flash
+  FanSchedule restarted;
+  restarted.init();
+  for (uint8_t h = 0; h < SCHED_WEEKHOURS; h++) {
+    CHECK_MSG(restarted.isQuietHour(h) == schedule.isQuietHour(h) &&
+                  restarted.isPreferredHour(h) == schedule.isPreferredHour(h),
+              "hour %u differs after the restart", h);
+  }
+
+  // "W 0": back to the table, also after the next restart
+  restarted.reset();
+  FanSchedule afterReset;
+  afterReset.init();
+  for (uint8_t h = 0; h < SCHED_WEEKHOURS; h++) {
+    CHECK(!restarted.isQuietHour(h) && !restarted.isPreferredHour(h));
+    CHECK(!afterReset.isQuietHour(h) && !afterReset.isPreferredHour(h));
+  }
+
+  // a stored schedule of another version is ignored
+  schedule.edit(SCHED_QUIET, SCHED_EVERYDAY, 0, 24);
+  Preferences prefs;
+  prefs.begin("fansched", false);
+  prefs.putUChar("version", SCHED_DATA_VERSION + 1);
+  prefs.end();
+  FanSchedule otherVersion;
+  otherVersion.init();
+  CHECK(!otherVersion.isQuietHour(weekHour(3, 12)));
+
+  return hostTestResult("scheduleTest");
+}
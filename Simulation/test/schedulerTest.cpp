@@ -0,0 +1,211 @@
+// schedulerTest.cpp
+// Host test of the Scheduler with a virtual clock: idle() sleeps with ulTaskNotifyTake() of the
+// FreeRTOS stand-in, which advances millis() by the timeout. So loop() sleeps exactly until the
+// next task is due. Every task must run at its due time, never early, and keep its rhythm.
+// trigger() runs a task at the next dispatch() without sleeping first, and a pass, which blocks
+// loop() for longer than some periods, doesn't make the tasks catch up.
+
+#include "Arduino.h"
+
+#include "scheduler.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+#define RUN_MS (10UL * 60 * 1000)
+#define BLOCK_MS 3000 // one pass of loop() blocks for so long
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+unsigned long micros() {
+  return simMillis * 1000UL;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+/// @brief runs of one task for the checks
+typedef struct {
+  uint32_t periodMs;
+  uint32_t runs;
+  uint32_t lateRuns; // runs later than the due time
+  uint64_t lastRun;
+  uint64_t nextDue;
+} Runs;
+
+static Runs fast = {50}, mid = {250}, slow = {2000};
+static uint32_t buttonRuns = 0;
+static boolean blockOnce = false;
+static int8_t buttonId = -1;
+
+static Scheduler *testScheduler = nullptr;
+
+/// @brief new scheduler for a test, the tasks start again
+static void startTest(Scheduler &sched) {
+  testScheduler = &sched;
+  fast = {50};
+  mid = {250};
+  slow = {2000};
+  buttonRuns = 0;
+  timeService.tick();
+}
+
+/// @brief check a periodic run against its due time
+static void periodic(Runs &r, const char *name) {
+  uint64_t now = timeService.nowMs();
+  if (r.runs > 0) {
+    CHECK_MSG(now >= r.nextDue, "%s early at %llu, due %llu", name, (unsigned long long)now,
+              (unsigned long long)r.nextDue);
+    r.lateRuns += now >= r.nextDue + SCHED_TICK_MS;
+  }
+  r.runs++;
+  r.lastRun = now;
+  r.nextDue = now + r.periodMs;
+}
+
+static boolean fastTask() {
+  periodic(fast, "fast");
+  if (fast.runs % 10 == 0) {
+    testScheduler->trigger(buttonId); // e.g. a callback of the same task
+  }
+  return true;
+}
+
+static boolean midTask() {
+  periodic(mid, "mid");
+  if (blockOnce) {
+    blockOnce = false;
+    simMillis += BLOCK_MS;
+  }
+  return true;
+}
+
+static boolean slowTask() {
+  periodic(slow, "slow");
+  return false;
+}
+
+static boolean buttonTask() {
+  buttonRuns++;
+  return true;
+}
+
+/// @brief loop() of a task with the scheduler
+/// @return ms slept in idle()
+static uint32_t loopPass(Scheduler &sched) {
+  timeService.tick();
+  uint32_t ms = sched.dispatch();
+  CHECK_MSG(ms <= SCHED_SLOTS * SCHED_TICK_MS, "next due in %u ms", ms);
+  uint32_t before = simMillis;
+  sched.idle(ms);
+  return simMillis - before;
+}
+
+static void testDeadlines() {
+  Scheduler sched("test");
+  startTest(sched);
+  sched.addTask("fast", fastTask, fast.periodMs);
+  sched.addTask("mid", midTask, mid.periodMs);
+  sched.addTask("slow", slowTask, slow.periodMs);
+  buttonId = sched.addTask("button", buttonTask, 60UL * 60 * 1000);
+
+  uint32_t passes = 0, idlePasses = 0;
+  while (simMillis < RUN_MS) {
+    uint32_t runs = fast.runs + mid.runs + slow.runs + buttonRuns;
+    uint32_t slept = loopPass(sched);
+    passes++;
+    idlePasses += runs == fast.runs + mid.runs + slow.runs + buttonRuns;
+    if (slept >= SCHED_IDLE_MIN_MS) {
+      // slept exactly until the next task is due
+      timeService.tick();
+      uint64_t now = timeService.nowMs();
+      uint64_t nextDue = min(fast.nextDue, min(mid.nextDue, slow.nextDue));
+      CHECK_MSG(now == nextDue, "woke at %llu, next due %llu", (unsigned long long)now,
+                (unsigned long long)nextDue);
+    }
+  }
+
+  printf("  %u passes, fast %u, mid %u, slow %u, button %u runs\n", passes, fast.runs, mid.runs,
+         slow.runs, buttonRuns);
+  // every task at its period, on time
+  CHECK(fast.runs == RUN_MS / fast.periodMs);
+  CHECK(mid.runs == RUN_MS / mid.periodMs);
+  CHECK(slow.runs == RUN_MS / slow.periodMs);
+  CHECK(fast.lateRuns == 0 && mid.lateRuns == 0 && slow.lateRuns == 0);
+  // the button ran after every 10th run of fast, at the next pass and not at its own period
+  CHECK(buttonRuns == 1 + fast.runs / 10);
+  // the fast task is due within one turn of the wheel and a trigger() handled by dispatch() doesn't
+  // wake the next idle(), so every pass runs a task
+  CHECK_MSG(idlePasses == 0, "%u of %u passes without a task", idlePasses, passes);
+}
+
+static void testTrigger() {
+  Scheduler sched("trigger");
+  startTest(sched);
+  sched.addTask("slow", slowTask, slow.periodMs);
+  buttonId = sched.addTask("button", buttonTask, 60UL * 60 * 1000);
+  loopPass(sched);
+  loopPass(sched);
+  CHECK(buttonRuns == 1); // the first dispatch()
+
+  // only the slow task: idle() sleeps one turn of the wheel at most
+  uint32_t slept = loopPass(sched);
+  CHECK_MSG(slept > 0 && slept <= SCHED_SLOTS * SCHED_TICK_MS, "slept %u ms", slept);
+
+  // trigger() from another task or an interrupt while loop() runs: idle() doesn't sleep
+  timeService.tick();
+  sched.dispatch();
+  sched.trigger(buttonId);
+  uint32_t before = simMillis;
+  sched.idle(SCHED_SLOTS * SCHED_TICK_MS);
+  CHECK(simMillis == before);
+  CHECK(sched.getNextDueMs() == 0);
+  timeService.tick();
+  sched.dispatch();
+  CHECK(buttonRuns == 2);
+  CHECK(sched.getNextDueMs() > 0);
+}
+
+static void testBlockedPass() {
+  Scheduler sched("blocked");
+  startTest(sched);
+  sched.addTask("fast", fastTask, fast.periodMs);
+  sched.addTask("mid", midTask, mid.periodMs);
+  buttonId = sched.addTask("button", buttonTask, 60UL * 60 * 1000);
+  for (int i = 0; i < 20; i++) {
+    loopPass(sched);
+  }
+
+  // mid blocks loop() for BLOCK_MS: fast runs once after it, not once for every missed period
+  blockOnce = true;
+  while (blockOnce) {
+    loopPass(sched);
+  }
+  uint32_t fastRuns = fast.runs;
+  loopPass(sched);
+  CHECK_MSG(fast.runs == fastRuns + 1, "fast ran %u times after the block", fast.runs - fastRuns);
+
+  // then the rhythm goes on from the end of the block
+  fast.lateRuns = 0;
+  mid.lateRuns = 0;
+  uint32_t midRuns = mid.runs;
+  uint64_t end = timeService.nowMs() + 10 * mid.periodMs;
+  while (timeService.nowMs() < end) {
+    loopPass(sched);
+  }
+  CHECK(mid.runs - midRuns >= 9);
+  CHECK(fast.lateRuns == 0 && mid.lateRuns == 0);
+}
+
+int main() {
+  testDeadlines();
+  testTrigger();
+  testBlockedPass();
+  return hostTestResult("schedulerTest");
+}
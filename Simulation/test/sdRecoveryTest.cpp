@@ -0,0 +1,280 @@
+// sdRecoveryTest.cpp
+// Host fault injection for the data log with SD_LOG_CRC: a batch of records is torn by a power
+// loss at every byte offset. After the restart, the recovery must cut off the torn line, so the
+// file only has complete and valid lines and the sequence numbers continue.
+// A log file written without the CRC columns (before an update) must get a new header before the
+// first line with CRC.
+// Without restart, the part of a short write must be cut off before the buffer is written again,
+// and the records of the flash log must be on the card once, also if a write fails during the
+// replay of two months.
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "SD.h"
+#include "SPIFFS.h"
+
+#include "logRecord.h"
+#include "sdhelper.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+#define LOGFILE "/2024/05.csv"
+#define BATCH SD_FLUSH_RECORDS
+
+bool logRecordCsvCheckLine(const char *line, size_t len, uint32_t *seq);
+
+SimSerial Serial;
+static uint32_t simMillis = 0;
+static int recordCnt = 0;
+
+unsigned long millis() {
+  return simMillis;
+}
+
+unsigned long micros() {
+  return simFsMicros;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  simMillis += ms;
+}
+
+/// @brief start the SDHelper like after a reset
+static void boot(SDHelper &sdHelper, boolean withHeader) {
+  sdHelper.init();
+  for (int i = 0; i < 3; i++) {
+    simMillis += SDwaitMS;
+    timeService.tick();
+    sdHelper.loop();
+  }
+  char fn[SD_FILENAMELENGTH] = LOGFILE;
+  sdHelper.setFileName(fn);
+  if (withHeader) {
+    sdHelper.writeCSVHeader(); // rtcTask() writes the header after every start
+  }
+}
+
+static void writeRecords(SDHelper &sdHelper, int count) {
+  for (int i = 0; i < count; i++, recordCnt++) {
+    char date[32], temp[48], control[24];
+    snprintf(date, sizeof(date), "2024-05-%02d %02d:%02d:00", 1 + recordCnt / 240,
+             (recordCnt / 10) % 24, (recordCnt % 10) * 6);
+    snprintf(temp, sizeof(temp), "12.3;15.2;81.0;60.5;9.1;7.5;%d;10", recordCnt % 11);
+    snprintf(control, sizeof(control), "f1;m1;%d;0", recordCnt);
+    sdHelper.writeData(date, temp, control);
+  }
+}
+
+static void resetCard() {
+  SD.files.clear();
+  SD.dirs = {"/"};
+  SD.writeBudget = -1;
+}
+
+/// @brief split the file into lines without line end
+static std::vector<std::string> lines(const std::string &content) {
+  std::vector<std::string> result;
+  size_t start = 0;
+  while (start < content.size()) {
+    size_t end = content.find('\n', start);
+    if (end == std::string::npos) {
+      result.push_back(content.substr(start)); // torn, without line end
+      break;
+    }
+    size_t len = end - start;
+    if (len > 0 && content[end - 1] == '\r') {
+      len--;
+    }
+    result.push_back(content.substr(start, len));
+    start = end + 1;
+  }
+  return result;
+}
+
+/// @brief every line is complete and valid, the sequence numbers increase
+static boolean checkFile(const std::string &content, int k) {
+  boolean ok = content.empty() || content.back() == '\n';
+  CHECK_MSG(ok, "tear at %d: last line without line end", k);
+  uint32_t lastSeq = 0;
+  boolean first = true;
+  for (const std::string &line : lines(content)) {
+    uint32_t seq = UINT32_MAX;
+    if (!logRecordCsvCheckLine(line.c_str(), line.size(), &seq)) {
+      CHECK_MSG(false, "tear at %d: invalid line '%s'", k, line.c_str());
+      return false;
+    }
+    if (seq != UINT32_MAX) {
+      if (!first && seq != lastSeq + 1) {
+        CHECK_MSG(false, "tear at %d: seq %u after %u", k, seq, lastSeq);
+        return false;
+      }
+      lastSeq = seq;
+      first = false;
+    }
+  }
+  return ok;
+}
+
+/// @brief write one batch before and one batch torn after tear bytes, then restart and write on
+/// @param tear bytes of the second batch, which reach the card, -1: no power loss
+/// @return content of the file before the restart
+static std::string tornBatch(long tear, std::string &before) {
+  resetCard();
+  recordCnt = 0;
+  {
+    SDHelper sdHelper(0);
+    boot(sdHelper, true);
+    writeRecords(sdHelper, BATCH);
+    sdHelper.flush();
+    before = SD.content(LOGFILE);
+    SD.writeBudget = tear;
+    writeRecords(sdHelper, BATCH);
+    sdHelper.flush();
+  }
+  return SD.content(LOGFILE);
+}
+
+static void testTornWrites() {
+  std::string before;
+  std::string full = tornBatch(-1, before);
+  std::string batch = full.substr(before.size());
+  CHECK(batch.size() > 0);
+
+  int failures = hostTestFailures;
+  for (long k = 0; k < (long)batch.size() && hostTestFailures == failures; k++) {
+    tornBatch(k, before);
+    CHECK(SD.content(LOGFILE) == before + batch.substr(0, k));
+
+    // power loss, restart and continue
+    SD.writeBudget = -1;
+    SDHelper sdHelper(0);
+    boot(sdHelper, true);
+    writeRecords(sdHelper, 3);
+    sdHelper.flush();
+
+    std::string after = SD.content(LOGFILE);
+    size_t complete = batch.rfind('\n', k - 1);
+    size_t kept = before.size() + (k == 0 || complete == std::string::npos ? 0 : complete + 1);
+    CHECK_MSG(after.compare(0, kept, full, 0, kept) == 0, "tear at %ld: valid lines lost", k);
+    checkFile(after, k);
+    CHECK(sdHelper.hasRecoveryEvent() == (kept != before.size() + k));
+  }
+}
+
+static void testFormatChange() {
+  resetCard();
+  // written by the firmware before SD_LOG_CRC
+  SD.mkdir("/2024");
+  File file = SD.open(LOGFILE, FILE_WRITE);
+  file.println(LOGRECORD_CSV_HEADER);
+  file.println("2024-05-01 00:00:00;12.3;15.2;81.0;60.5;9.1;7.5;10;10;f0;m1;0;360");
+  file.close();
+
+  // the first record after the update, without header before (e.g. replayed from the flash log)
+  SDHelper sdHelper(0);
+  boot(sdHelper, false);
+  writeRecords(sdHelper, 2);
+  sdHelper.flush();
+
+  std::vector<std::string> l = lines(SD.content(LOGFILE));
+  CHECK(l.size() == 5);
+  if (l.size() == 5) {
+    CHECK(l[0] == LOGRECORD_CSV_HEADER);
+#if SD_LOG_CRC
+    CHECK(l[2] == LOGRECORD_CSV_HEADER LOGRECORD_CSV_HEADER_CRC);
+#endif
+  }
+  checkFile(SD.content(LOGFILE), -1);
+
+  // the next start continues in the same format without another header
+  SDHelper restarted(0);
+  boot(restarted, false);
+  writeRecords(restarted, 2);
+  restarted.flush();
+  CHECK(lines(SD.content(LOGFILE)).size() == 7);
+  checkFile(SD.content(LOGFILE), -1);
+}
+
+/// @brief loop() of the io task, until the card is back and everything is written
+static void runLoops(SDHelper &sdHelper, int count) {
+  for (int i = 0; i < count; i++) {
+    simMillis += SDwaitMS;
+    timeService.tick();
+    sdHelper.loop();
+  }
+  sdHelper.flush();
+}
+
+/// @brief write 2 batches and 3 records, the second batch is written with a short write
+/// @param tear bytes of the second batch, which reach the card, -1: no error
+static std::string shortWrite(long tear) {
+  resetCard();
+  SPIFFS.files.clear(); // empty flash log
+  recordCnt = 0;
+  SDHelper sdHelper(0);
+  boot(sdHelper, true);
+  writeRecords(sdHelper, BATCH);
+  SD.writeBudget = tear;
+  writeRecords(sdHelper, BATCH);
+  SD.writeBudget = -1;
+  writeRecords(sdHelper, 3); // to the flash log, if the card was lost
+  runLoops(sdHelper, 10);
+  return SD.content(LOGFILE);
+}
+
+static void testShortWrite() {
+  std::string full = shortWrite(-1);
+  std::string before;
+  tornBatch(-1, before);
+  int failures = hostTestFailures;
+  for (long k = 1; k < (long)(full.size() - before.size()) && hostTestFailures == failures; k++) {
+    CHECK_MSG(shortWrite(k) == full, "short write of %ld bytes: records lost or twice", k);
+  }
+}
+
+static void testReplayMonths() {
+  // reference without error
+  resetCard();
+  SPIFFS.files.clear();
+  recordCnt = 0;
+  SDHelper reference(0);
+  boot(reference, false);
+  writeRecords(reference, 3);
+  char june[SD_FILENAMELENGTH] = "/2024/06.csv";
+  reference.setFileName(june);
+  writeRecords(reference, 3);
+  reference.flush();
+  std::string may = SD.content(LOGFILE);
+  std::string juneContent = SD.content(june);
+
+  // the same records in the flash log, the card is back, but fails after the records of May
+  resetCard();
+  SPIFFS.files.clear();
+  recordCnt = 0;
+  simSdInserted = false;
+  SDHelper sdHelper(0);
+  boot(sdHelper, false);
+  writeRecords(sdHelper, 3);
+  sdHelper.setFileName(june);
+  writeRecords(sdHelper, 3);
+  simSdInserted = true;
+  SD.writeBudget = may.size();
+  runLoops(sdHelper, 5);
+  SD.writeBudget = -1;
+  runLoops(sdHelper, 10);
+
+  CHECK(SD.content(LOGFILE) == may);
+  CHECK(SD.content(june) == juneContent);
+}
+
+int main() {
+  timeService.tick();
+  testTornWrites();
+  testFormatChange();
+  testShortWrite();
+  testReplayMonths();
+  return hostTestResult("sdRecoveryTest");
+}
@@ -0,0 +1,135 @@
+// timeRolloverTest.cpp
+// Host test of the roll over of millis() after 49.7 days: the TimeService gets a 32 bit source
+// shortly before 0xFFFFFFFF with setSource(). nowMs() must go on without a jump, the pause and the
+// run of the fan must keep their length and the SDHelper must save and write its records in the
+// same rhythm across the roll over.
+
+#include "Arduino.h"
+#include "SD.h"
+
+#include "controlFan.h"
+#include "sdhelper.h"
+#include "timeService.h"
+
+#include "hostTest.h"
+
+// the source rolls over after START_BEFORE_ROLLOVER_MS
+#define START_BEFORE_ROLLOVER_MS (20UL * 60 * 1000)
+#define STEP_MS 1000
+#define RUN_MS (3UL * 3600 * 1000)
+
+SimSerial Serial;
+static uint32_t rawMs = 0xFFFFFFFFUL - START_BEFORE_ROLLOVER_MS + 1;
+
+/// @brief millis() of the device: 32 bit, also where unsigned long has 64 bit
+unsigned long millis() {
+  return rawMs;
+}
+
+unsigned long micros() {
+  return simFsMicros;
+}
+
+void simAdvanceMillis(unsigned long ms) {
+  rawMs += ms;
+}
+
+static unsigned long wrappingSource() {
+  return rawMs;
+}
+
+static void testTimeService() {
+  timeService.setSource(wrappingSource);
+  timeService.tick();
+  uint64_t last = timeService.nowMs();
+  CHECK(last == rawMs); // starts with the value of the source
+  boolean rolledOver = false;
+  for (unsigned long t = 0; t < 2 * START_BEFORE_ROLLOVER_MS; t += 777) {
+    uint32_t before = rawMs;
+    rawMs += 777;
+    rolledOver |= rawMs < before;
+    timeService.tick();
+    uint64_t now = timeService.nowMs();
+    CHECK_MSG(now == last + 777, "nowMs %llu after %llu", (unsigned long long)now,
+              (unsigned long long)last);
+    last = now;
+  }
+  CHECK(rolledOver);
+  CHECK(last > 0xFFFFFFFFULL);
+}
+
+static void testControlAndSd() {
+  rawMs = 0xFFFFFFFFUL - START_BEFORE_ROLLOVER_MS + 1;
+  timeService.setSource(wrappingSource);
+  timeService.tick();
+
+  ControlFan controlFan;
+  controlFan.init();
+  controlFan.setFanGroupSize(1);
+  SDHelper sdHelper(0);
+  sdHelper.init();
+  char fn[SD_FILENAMELENGTH] = "/2024/05.csv";
+  sdHelper.setFileName(fn);
+
+  uint64_t lastChange = timeService.nowMs(), lastSave = 0, firstBuffered = 0;
+  boolean fanOn = false, rolledOver = false;
+  uint32_t runs = 0, pauses = 0, saves = 0;
+  for (unsigned long t = 0; t < RUN_MS; t += STEP_MS) {
+    uint32_t before = rawMs;
+    rawMs += STEP_MS;
+    rolledOver |= rawMs < before;
+    timeService.tick();
+    uint64_t now = timeService.nowMs();
+
+    // mode AUTO, ventilation always usefull: runs of FanON_MS with pauses of FanOFF_MS
+    boolean on = controlFan.loop(true);
+    if (on != fanOn) {
+      uint64_t duration = now - lastChange;
+      if (on && pauses++ > 0) {
+        CHECK_MSG(duration >= FanOFF_MS && duration <= FanOFF_MS + FANwaitMS,
+                  "pause of %llu ms", (unsigned long long)duration);
+      } else if (!on) {
+        runs++;
+        CHECK_MSG(duration >= FanON_MS && duration <= FanON_MS + FANwaitMS, "run of %llu ms",
+                  (unsigned long long)duration);
+      }
+      fanOn = on;
+      lastChange = now;
+    }
+
+    // a record every SD_SAVE_INTERVALL_MS
+    uint8_t buffered = sdHelper.getBufferedCount();
+    uint32_t writeCalls = SD.writeCalls;
+    if (sdHelper.loop()) {
+      if (saves++ > 0) {
+        uint64_t interval = now - lastSave;
+        CHECK_MSG(interval >= SD_SAVE_INTERVALL_MS && interval <= SD_SAVE_INTERVALL_MS + SDwaitMS,
+                  "save after %llu ms", (unsigned long long)interval);
+      }
+      lastSave = now;
+      char date[] = "2024-05-01 00:00:00", temp[] = "12.3;15.2;81.0;60.5;9.1;7.5;10;10",
+           control[] = "f1;m1;0;0";
+      sdHelper.writeData(date, temp, control);
+      buffered++;
+    }
+    // the buffer is written, when SD_FLUSH_RECORDS are collected or the oldest is old enough
+    if (SD.writeCalls != writeCalls) {
+      CHECK_MSG(buffered >= SD_FLUSH_RECORDS || now - firstBuffered >= SD_FLUSH_MAX_AGE_MS,
+                "%u records written after %llu ms", buffered,
+                (unsigned long long)(now - firstBuffered));
+    }
+    if (buffered == 0 || SD.writeCalls != writeCalls) {
+      firstBuffered = now;
+    }
+  }
+
+  CHECK(rolledOver);
+  CHECK(runs >= 3);
+  CHECK(saves >= RUN_MS / (SD_SAVE_INTERVALL_MS + SDwaitMS));
+}
+
+int main() {
+  testTimeService();
+  testControlAndSd();
+  return hostTestResult("timeRolloverTest");
+}
@@ -0,0 +1,114 @@
+// timeZoneTest.cpp
+// Host comparison of the POSIX TZ rules of timeZone.cpp with the zoneinfo of the host (glibc
+// localtime_r()) for 14 zones: the offset to UTC is compared every 15 minutes from 2026 to 2037,
+// with the DST decision of RTCHelper::isDst(). Zones without zoneinfo on the host are skipped.
+// For Europe/Berlin, summer time ends at 3:00 CEST = 2:00 CET, one hour earlier than the former
+// isDST_Europe_CET() (see dstTableTest).
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "timeZone.h"
+
+#include "hostTest.h"
+
+#define FIRST_YEAR 2026
+#define LAST_YEAR 2037
+#define STEP_S (15 * 60)
+
+/// @brief zone of the zoneinfo and its rules, like the last line of the zoneinfo file
+typedef struct {
+  const char *zone;
+  const char *tz;
+} Zone;
+
+static const Zone zones[] = {
+    {"Europe/Berlin", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Europe/London", "GMT0BST,M3.5.0/1,M10.5.0"},
+    {"America/New_York", "EST5EDT,M3.2.0,M11.1.0"},
+    {"America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+    {"Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Pacific/Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+    {"Asia/Tokyo", "JST-9"},
+    {"America/Sao_Paulo", "<-03>3"},
+    {"Asia/Kolkata", "IST-5:30"},
+    {"Australia/Lord_Howe", "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0"},
+    {"America/St_Johns", "NST3:30NDT,M3.2.0,M11.1.0"},
+    {"America/Santiago", "<-04>4<-03>,M9.1.6/24,M4.1.6/24"},
+    {"Asia/Tehran", "<+0330>-3:30"},
+    {"America/Nuuk", "<-02>2<-01>,M3.5.0/-1,M10.5.0/0"},
+};
+
+/// @brief offset to UTC like the RTCHelper: DST table of the year of the standard time
+static int32_t tzOffset(const TzInfo &info, uint32_t utc) {
+  uint32_t base = utc + info.stdOffset;
+  time_t t = base;
+  struct tm date;
+  gmtime_r(&t, &date);
+  uint32_t dstStart, dstEnd;
+  tzTransitions(info, date.tm_year + 1900, &dstStart, &dstEnd);
+  bool dst;
+  if (dstStart <= dstEnd) {
+    dst = base >= dstStart && base < dstEnd;
+  } else {
+    dst = base >= dstStart || base < dstEnd; // southern hemisphere
+  }
+  return dst ? info.dstOffset : info.stdOffset;
+}
+
+static uint32_t yearStart(int year) {
+  struct tm date = {};
+  date.tm_year = year - 1900;
+  date.tm_mday = 1;
+  return timegm(&date);
+}
+
+int main() {
+  // parser
+  TzInfo info;
+  CHECK(!tzParse("", &info));
+  CHECK(!tzParse("CE-1", &info));
+  CHECK(!tzParse("CET-1CEST", &info)); // DST without rules
+  CHECK(!tzParse("CET-1CEST,M13.5.0,M10.5.0", &info));
+  CHECK(tzParse("CET-1CEST,M3.5.0,M10.5.0/3", &info));
+  CHECK(info.stdOffset == 3600 && info.dstOffset == 7200 && info.end.time == 3 * 3600);
+
+  int skipped = 0;
+  for (const Zone &zone : zones) {
+    char path[64];
+    snprintf(path, sizeof(path), "/usr/share/zoneinfo/%s", zone.zone);
+    if (access(path, R_OK) != 0) {
+      printf("  %s: no zoneinfo, skipped\n", zone.zone);
+      skipped++;
+      continue;
+    }
+    if (!tzParse(zone.tz, &info)) {
+      CHECK_MSG(false, "%s: can't parse %s", zone.zone, zone.tz);
+      continue;
+    }
+    char tzEnv[80];
+    snprintf(tzEnv, sizeof(tzEnv), ":%s", zone.zone);
+    setenv("TZ", tzEnv, 1);
+    tzset();
+
+    uint32_t differences = 0;
+    for (uint32_t utc = yearStart(FIRST_YEAR); utc < yearStart(LAST_YEAR + 1); utc += STEP_S) {
+      time_t t = utc;
+      struct tm local;
+      localtime_r(&t, &local);
+      int32_t offset = tzOffset(info, utc);
+      if (offset != local.tm_gmtoff) {
+        if (differences++ == 0) {
+          CHECK_MSG(false, "%s at UTC %u: offset %d, zoneinfo %ld", zone.zone, utc, offset,
+                    local.tm_gmtoff);
+        }
+      }
+    }
+    if (differences > 0) {
+      printf("  %s: %u differences\n", zone.zone, differences);
+    }
+  }
+  CHECK(skipped < (int)(sizeof(zones) / sizeof(zones[0]))); // at least some zones compared
+  return hostTestResult("timeZoneTest");
+}